@@ -0,0 +1,51 @@
+#include <cstring>
+
+#include "arena.h"
+
+// === StringArena ===
+StringArena::StringArena() : next(nullptr), left(0), used(0), allocated(0) {}
+
+std::string_view StringArena::store(std::string_view s) {
+  if(s.empty()) return std::string_view();
+  used += s.length();
+
+  //large strings get a block of their own so the current block keeps
+  //its free space
+  if(s.length() > ARENA_BLOCK_SIZE / 4) {
+    blocks.emplace_back(new char[s.length()]);
+    allocated += s.length();
+    memcpy(blocks.back().get(), s.data(), s.length());
+    return std::string_view(blocks.back().get(), s.length());
+  }
+
+  if(s.length() > left) {
+    blocks.emplace_back(new char[ARENA_BLOCK_SIZE]);
+    allocated += ARENA_BLOCK_SIZE;
+    next = blocks.back().get();
+    left = ARENA_BLOCK_SIZE;
+  }
+  memcpy(next, s.data(), s.length());
+  std::string_view stored(next, s.length());
+  next += s.length();
+  left -= s.length();
+  return stored;
+}
+
+void StringArena::absorb(StringArena &&other) {
+  //other's blocks go in front of the current block, which keeps filling
+  blocks.insert(blocks.end() - (blocks.empty() ? 0 : 1),
+                std::make_move_iterator(other.blocks.begin()), std::make_move_iterator(other.blocks.end()));
+  used += other.used;
+  allocated += other.allocated;
+  other.blocks.clear();
+  other.next = nullptr;
+  other.left = other.used = other.allocated = 0;
+}
+
+size_t StringArena::size() const {
+  return used;
+}
+
+size_t StringArena::capacity() const {
+  return allocated;
+}
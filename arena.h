@@ -0,0 +1,47 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#define ARENA_BLOCK_SIZE 65536 //bytes
+
+//append-only storage for event strings. strings are packed into large
+//blocks that are never moved or freed before the arena, so the views
+//returned by store stay valid for the arena's lifetime.
+class StringArena {
+private:
+  std::vector<std::unique_ptr<char[]> > blocks;
+  char *next;
+  size_t left;
+  size_t used;
+  size_t allocated;
+
+public:
+  // === Constructors ===
+
+  //empty arena, no blocks are allocated until the first store
+  StringArena();
+  StringArena(StringArena &&) = default;
+  StringArena &operator=(StringArena &&) = default;
+  StringArena(const StringArena &) = delete;
+  StringArena &operator=(const StringArena &) = delete;
+
+  // === Modifiers ===
+
+  //copy s into the arena and return a view of the copy
+  std::string_view store(std::string_view s);
+  //take over the blocks of other, views into them stay valid
+  void absorb(StringArena &&other);
+
+  // === Accessors ===
+
+  //number of string bytes stored
+  size_t size() const;
+  //number of bytes allocated for blocks
+  size_t capacity() const;
+};
+
+#endif
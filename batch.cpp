@@ -0,0 +1,246 @@
+#include <charconv>
+#include <exception>
+#include <ostream>
+
+#include "arena.h"
+#include "batch.h"
+#include "ics.h"
+
+// === Fields ===
+
+//parse all of text as a number of at most max_digits digits
+template <typename T>
+static bool parse_digits(std::string_view text, size_t max_digits, T &value) {
+  if(text.empty() || text.length() > max_digits) return false;
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.length(), value);
+  return ec == std::errc() && end == text.data() + text.length();
+}
+
+bool parse_us_date(std::string_view text, Date &day) {
+  size_t first = text.find('/');
+  size_t second = (first == std::string_view::npos) ? first : text.find('/', first + 1);
+  if(second == std::string_view::npos) return false;
+  unsigned m, d;
+  int y;
+  if(!parse_digits(text.substr(0, first), 2, m) ||
+     !parse_digits(text.substr(first + 1, second - first - 1), 2, d) ||
+     !parse_digits(text.substr(second + 1), 4, y)) {
+    return false;
+  }
+  if(m < 1 || m > 12 || d < 1 || d > days_in_month(y, m)) return false;
+  day = Date(y, m, d);
+  return true;
+}
+
+bool parse_clock(std::string_view text, int &minute) {
+  size_t colon = text.find(':');
+  if(colon == std::string_view::npos) return false;
+  int h, m;
+  if(!parse_digits(text.substr(0, colon), 2, h) || !parse_digits(text.substr(colon + 1), 2, m)) {
+    return false;
+  }
+  if(m > 59 || h * 60 + m > Event::MINUTES_PER_DAY) return false;
+  minute = h * 60 + m;
+  return true;
+}
+
+std::string check_span(const Date &begin, const Date &end, int begin_minute, int end_minute) {
+  if(end < begin) return "ends before it begins";
+  if(end == begin && begin_minute != Event::ALL_DAY && end_minute <= begin_minute) {
+    return "ends before it begins";
+  }
+  return std::string();
+}
+
+//return text without leading and trailing blanks
+static std::string_view trim(std::string_view text) {
+  size_t first = text.find_first_not_of(" \t");
+  if(first == std::string_view::npos) return std::string_view();
+  return text.substr(first, text.find_last_not_of(" \t") - first + 1);
+}
+
+// === Records ===
+
+//return why the add r cannot be applied, empty if it can
+static std::string check_add(const BatchRecord &r) {
+  if(r.title.empty()) return "missing title";
+  if(r.tag.empty()) return "missing tag";
+  return check_span(r.begin, r.end, r.begin_minute, r.end_minute);
+}
+
+//set the dates and times of r from their fields, an empty end is the
+//begin day and empty times make an all day event. returns why they
+//cannot be read, empty if they can.
+static std::string read_span(std::string_view begin, std::string_view end, std::string_view begin_time,
+                             std::string_view end_time, BatchRecord &r) {
+  if(!parse_us_date(begin, r.begin)) return "invalid date '" + std::string(begin) + "', expected MM/DD/YYYY";
+  r.end = r.begin;
+  if(!end.empty() && !parse_us_date(end, r.end)) {
+    return "invalid date '" + std::string(end) + "', expected MM/DD/YYYY";
+  }
+  r.begin_minute = r.end_minute = Event::ALL_DAY;
+  if(begin_time.empty() && end_time.empty()) return std::string();
+  if(begin_time.empty() || end_time.empty()) return "give both times or neither";
+  if(!parse_clock(begin_time, r.begin_minute)) return "invalid time '" + std::string(begin_time) + "', expected HH:MM";
+  if(!parse_clock(end_time, r.end_minute)) return "invalid time '" + std::string(end_time) + "', expected HH:MM";
+  return std::string();
+}
+
+//read the VEVENT in block into r, returns why it cannot be read
+static std::string read_vevent(const std::string &block, BatchRecord &r) {
+  auto has = [&block](std::string_view key) { return block.find("\r\n" + std::string(key)) != std::string::npos; };
+  if(!has("DTSTART")) return "VEVENT without DTSTART";
+  if(!has("DTEND")) return "VEVENT without DTEND";
+  //journal records hold single events only
+  if(has("RRULE")) return "recurring events cannot be imported";
+  StringArena arena;
+  std::vector<Event> parsed;
+  try {
+    if(!parse_ics(block, parsed, arena) || parsed.size() != 1) return "malformed VEVENT";
+  } catch(std::exception &ex) {
+    return ex.what();
+  }
+  const Event &e = parsed[0];
+  r.title = e.get_title();
+  r.tag = e.get_tag();
+  r.uid = e.get_uid();
+  r.begin = e.get_begin();
+  r.end = e.get_end();
+  r.begin_minute = e.get_begin_minute();
+  r.end_minute = e.get_end_minute();
+  return std::string();
+}
+
+//split a CSV row into fields. quotes around a field allow commas in it,
+//a doubled quote is a quote. returns false if a quote is not closed.
+static bool split_csv(std::string_view row, std::vector<std::string> &fields) {
+  fields.assign(1, std::string());
+  bool quoted = false;
+  for(size_t i = 0; i < row.length(); ++i) {
+    char c = row[i];
+    if(quoted) {
+      if(c != '"') fields.back() += c;
+      else if(i + 1 < row.length() && row[i + 1] == '"') fields.back() += row[++i];
+      else quoted = false;
+    } else if(c == '"') {
+      quoted = true;
+    } else if(c == ',') {
+      fields.emplace_back();
+    } else {
+      fields.back() += c;
+    }
+  }
+  return !quoted;
+}
+
+//read the CSV row begin,end,begin time,end time,tag,title into r. an
+//unquoted title may hold commas. returns why it cannot be read.
+static std::string read_csv(std::string_view row, BatchRecord &r) {
+  std::vector<std::string> fields;
+  if(!split_csv(row, fields)) return "unclosed quote";
+  if(fields.size() < 6) return "expected 6 CSV fields, got " + std::to_string(fields.size());
+  for(size_t i = 6; i < fields.size(); ++i) fields[5].append(",").append(fields[i]);
+  std::string error = read_span(trim(fields[0]), trim(fields[1]), trim(fields[2]), trim(fields[3]), r);
+  r.tag = trim(fields[4]);
+  r.title = trim(fields[5]);
+  return error;
+}
+
+//read the line MM/DD/YYYY [MM/DD/YYYY] [HH:MM HH:MM] TAG title into r.
+//returns why it cannot be read.
+static std::string read_line(std::string_view line, BatchRecord &r) {
+  //take the next blank separated word off line
+  auto next = [&line] {
+    line = trim(line);
+    std::string_view word = line.substr(0, line.find_first_of(" \t"));
+    line.remove_prefix(word.length());
+    return word;
+  };
+  std::string_view begin = next();
+  std::string_view end;
+  std::string_view begin_time;
+  std::string_view end_time;
+  std::string_view word = next();
+  Date day;
+  if(parse_us_date(word, day)) {
+    end = word;
+    word = next();
+  }
+  if(word.find(':') != std::string_view::npos) {
+    begin_time = word;
+    end_time = next();
+    if(end_time.empty()) return "give both times or neither";
+    word = next();
+  }
+  std::string error = read_span(begin, end, begin_time, end_time, r);
+  r.tag = word;
+  r.title = trim(line);
+  return error;
+}
+
+void read_batch(std::istream &in, std::vector<BatchRecord> &records, std::vector<BatchError> &errors) {
+  std::string line;
+  size_t number = 0;
+  bool in_calendar = false;
+  bool first_record = true;
+  //the VEVENT being read and the line it began on
+  std::string block;
+  size_t block_line = 0;
+
+  auto finish = [&](BatchRecord &r, std::string error) {
+    if(error.empty() && r.remove.empty()) error = check_add(r);
+    if(error.empty()) records.push_back(std::move(r));
+    else errors.push_back(BatchError{r.line, std::move(error)});
+  };
+
+  while(std::getline(in, line)) {
+    ++number;
+    if(!line.empty() && line.back() == '\r') line.pop_back();
+    BatchRecord r{number, "", "", "", "", Date(), Date(), Event::ALL_DAY, Event::ALL_DAY};
+
+    if(!block.empty()) {
+      block.append(line).append("\r\n");
+      if(line == "END:VEVENT") {
+        r.line = block_line;
+        finish(r, read_vevent(block, r));
+        block.clear();
+      }
+      continue;
+    }
+    if(line == "BEGIN:VEVENT") {
+      block = line + "\r\n";
+      block_line = number;
+      continue;
+    }
+    if(line == "BEGIN:VCALENDAR" || line == "END:VCALENDAR") {
+      in_calendar = line[0] == 'B';
+      continue;
+    }
+    //calendar properties and components other than events
+    if(in_calendar) continue;
+
+    std::string_view text = trim(line);
+    if(text.empty() || text[0] == '#') continue;
+    bool header_allowed = first_record;
+    first_record = false;
+    if(text[0] == '-') {
+      r.remove = trim(text.substr(1));
+      finish(r, r.remove.empty() ? "missing uid or tag to remove" : "");
+      continue;
+    }
+    size_t comma = text.find(',');
+    if(comma < text.find_first_of(" \t")) {
+      Date day;
+      if(header_allowed && !parse_us_date(trim(text.substr(0, comma)), day)) continue;
+      finish(r, read_csv(text, r));
+    } else {
+      finish(r, read_line(text, r));
+    }
+  }
+  if(!block.empty()) errors.push_back(BatchError{block_line, "VEVENT without END:VEVENT"});
+}
+
+void write_batch_errors(const std::vector<BatchError> &errors, std::ostream &out) {
+  for(const BatchError &error : errors) out << "line " << error.line << ": " << error.message << '\n';
+  out.flush();
+}
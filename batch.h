@@ -0,0 +1,56 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "datetime.h"
+
+//a change read by read_batch, an add unless remove is set
+struct BatchRecord {
+  size_t line;        //input line the record starts on
+  std::string remove; //uid or tag of the event to remove
+  std::string title;
+  std::string tag;
+  std::string uid;    //uid to add the event with, empty to derive one
+  Date begin;
+  Date end;
+  int begin_minute;   //Event::ALL_DAY for an all day event
+  int end_minute;
+};
+
+//a record that could not be read or applied
+struct BatchError {
+  size_t line;
+  std::string message;
+};
+
+//parse MM/DD/YYYY into day. returns false for anything else, including
+//days the month does not have.
+bool parse_us_date(std::string_view text, Date &day);
+
+//parse HH:MM into minutes after midnight, 24:00 is allowed as an end.
+//returns false for anything else.
+bool parse_clock(std::string_view text, int &minute);
+
+//returns why an event from begin at begin_minute to end at end_minute
+//cannot be added, empty if it can. a timed event must end after it begins.
+std::string check_span(const Date &begin, const Date &end, int begin_minute, int end_minute);
+
+//read changes from in until end of input. records are any mix of
+//  VEVENTs, with or without the VCALENDAR around them
+//  CSV rows: begin,end,begin time,end time,tag,title
+//            end and times may be empty and a quoted title may hold commas.
+//            a first row that does not start with a date is a header.
+//  lines:    MM/DD/YYYY [MM/DD/YYYY] [HH:MM HH:MM] TAG title
+//  -KEY      removes the event with uid KEY, or the one event tagged KEY
+//blank lines and lines starting with # are skipped. a record that cannot
+//be read is appended to errors and reading goes on with the next one.
+void read_batch(std::istream &in, std::vector<BatchRecord> &records, std::vector<BatchError> &errors);
+
+//write errors one per line as "line N: message"
+void write_batch_errors(const std::vector<BatchError> &errors, std::ostream &out);
+
+#endif
@@ -0,0 +1,969 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <csignal>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "batch.h"
+#include "cal.h"
+#include "config.h"
+#include "daemon.h"
+#include "datetime.h"
+#include "freebusy.h"
+#include "ics.h"
+#include "index.h"
+#include "search.h"
+
+#define BENCH_PATH "/tmp/planner_bench.ics"
+#define BENCH_EVENTS 200000
+#define BENCH_RUNS 5
+#define BENCH_DAYS 3650000
+#define BENCH_REGRESSION 1.25 //p50 ratio to baseline reported as a regression
+
+// === Generator ===
+
+enum class Durations { FIXED, UNIFORM, LONG_TAIL };
+
+//shape of a synthetic calendar. events are spread over enough days that
+//on average overlap events are in progress on any one day.
+struct GenConfig {
+  size_t events = 1000;
+  Durations durations = Durations::UNIFORM;
+  unsigned mean_days = 4;  //mean event length in days past its first
+  double overlap = 8.0;    //mean events per day
+  unsigned seed = 1;
+};
+
+static const char *durations_name(Durations d) {
+  return d == Durations::FIXED ? "fixed" : d == Durations::UNIFORM ? "uniform" : "longtail";
+}
+
+//return number of days the events of config are spread over
+static int span_days(const GenConfig &config) {
+  double days = static_cast<double>(config.events) * (config.mean_days + 1) / config.overlap;
+  return std::max(1, static_cast<int>(days));
+}
+
+//write a calendar shaped by config to path in the format save_events writes
+static void write_calendar(const std::string &path, const GenConfig &config) {
+  std::mt19937 rng(config.seed);
+  std::uniform_int_distribution<int> start(0, span_days(config) - 1);
+  std::uniform_int_distribution<int> uniform(0, 2 * static_cast<int>(config.mean_days));
+  std::exponential_distribution<double> long_tail(1.0 / std::max(1u, config.mean_days));
+
+  std::ofstream ofs(path, std::ofstream::binary);
+  std::string buffer;
+  buffer.reserve(1 << 20);
+  buffer += "BEGIN:VCALENDAR\r\n";
+  for(size_t i = 0; i < config.events; ++i) {
+    Date begin = Date(1995, 1, 1);
+    begin.change_day(start(rng));
+    int length = static_cast<int>(config.mean_days);
+    if(config.durations == Durations::UNIFORM) length = uniform(rng);
+    else if(config.durations == Durations::LONG_TAIL) length = std::min(3650, static_cast<int>(long_tail(rng)));
+    Date end = begin;
+    end.change_day(length);
+
+    buffer.append("BEGIN:VEVENT\r\nSUMMARY:Synthetic event ").append(std::to_string(i))
+          .append("\r\nDESCRIPTION:E").append(std::to_string(i % 1000))
+          .append("\r\nDTSTART:").append(begin.to_tz_tstamp())
+          .append("\r\nDTEND:").append(end.to_tz_tstamp())
+          .append("\r\nEND:VEVENT\r\n");
+    if(buffer.length() >= (1 << 20) - 256) {
+      ofs.write(buffer.data(), static_cast<std::streamsize>(buffer.length()));
+      buffer.clear();
+    }
+  }
+  buffer += "END:VCALENDAR\r\n";
+  ofs.write(buffer.data(), static_cast<std::streamsize>(buffer.length()));
+}
+
+//return size of file at path in MB
+static double file_mb(const std::string &path) {
+  std::ifstream ifs(path, std::ifstream::ate | std::ifstream::binary);
+  return static_cast<double>(ifs.tellg()) / (1024.0 * 1024.0);
+}
+
+//the getline/substr loader Calendar::load_events used before mmap
+static void legacy_load(const std::string &path, std::vector<Event> &events,
+                        StringArena &strings) {
+  std::string line, key, value, title, tag;
+  size_t pos;
+  Date begin;
+  Date end;
+  std::ifstream ifs(path);
+  std::getline(ifs, line);
+  while(ifs.good()) {
+    if(line[0] != ' ') {
+      if(line.empty() || (pos = line.find(':')) == std::string::npos) break;
+      key   = line.substr(0, pos);
+      value = line.substr(pos+1, line.length()-pos-2);
+      if(key == "SUMMARY") title = value;
+      else if(key == "DESCRIPTION") tag = value;
+      else if(key == "DTSTART" || key == "DTEND") {
+        int year = atoi(value.substr(0,4).c_str());
+        unsigned month = static_cast<unsigned>(atoi(value.substr(4,2).c_str()));
+        unsigned day = static_cast<unsigned>(atoi(value.substr(6,2).c_str()));
+        (key == "DTSTART" ? begin : end) = Date(year, month, day);
+      } else if(key == "END" && value == "VEVENT") {
+        events.emplace_back(Event(strings.store(title), tag, begin, end));
+      }
+    }
+    std::getline(ifs, line);
+  }
+}
+
+//return best of BENCH_RUNS wall times in seconds
+template <typename F>
+static double best_time(F f) {
+  double best = 1e30;
+  for(int i = 0; i < BENCH_RUNS; ++i) {
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+    if(dt.count() < best) best = dt.count();
+  }
+  return best;
+}
+
+static void load_bench() {
+  GenConfig config;
+  config.events = BENCH_EVENTS;
+  write_calendar(BENCH_PATH, config);
+  double mb = file_mb(BENCH_PATH);
+
+  size_t legacy_count = 0;
+  size_t mmap_count = 0;
+  size_t snapshot_count = 0;
+  double legacy = best_time([&] {
+    std::vector<Event> events;
+    StringArena strings;
+    legacy_load(BENCH_PATH, events, strings);
+    legacy_count = events.size();
+  });
+  double mapped = best_time([&] {
+    std::vector<Event> events;
+    StringArena strings;
+    MappedFile file(BENCH_PATH);
+    parse_ics(file.view(), events, strings);
+    mmap_count = events.size();
+  });
+  //the first load builds the snapshot, later loads read it
+  double snapshot = best_time([&] {
+    Calendar c = Calendar();
+    c.load_events(BENCH_PATH);
+    snapshot_count = c.get_events().size();
+  });
+
+  std::cout << "load_events: " << BENCH_EVENTS << " events, "
+            << std::fixed << std::setprecision(1) << mb << " MB" << std::endl
+            << "  getline:  " << std::setw(8) << mb / legacy << " MB/s"
+            << " (" << legacy_count << " events)" << std::endl
+            << "  mmap:     " << std::setw(8) << mb / mapped << " MB/s"
+            << " (" << mmap_count << " events)" << std::endl
+            << "  snapshot: " << std::setw(8) << mb / snapshot << " MB/s"
+            << " (" << snapshot_count << " events)" << std::endl
+            << "  speedup:  " << std::setprecision(2) << legacy / mapped << "x mmap, "
+            << legacy / snapshot << "x snapshot" << std::endl;
+
+  //resident bytes per event: the fixed size Event plus its arena strings
+  StringArena strings;
+  std::vector<Event> events;
+  MappedFile file(BENCH_PATH);
+  parse_ics(file.view(), events, strings);
+  std::cout << "  memory:   " << sizeof(Event) << " bytes/event + "
+            << std::setprecision(1) << static_cast<double>(strings.size()) / static_cast<double>(events.size())
+            << " bytes/event of titles and uids" << std::endl;
+  std::remove(BENCH_PATH);
+  std::remove(BENCH_PATH SNAPSHOT_SUFFIX);
+}
+
+//the chrono year_month_day backed Date day iteration used to go through
+struct LegacyDate {
+  std::chrono::year_month_day ymd;
+  long int serial;
+
+  LegacyDate(int y, unsigned m, unsigned d)
+      : ymd{std::chrono::year{y}, std::chrono::month{m}, std::chrono::day{d}},
+        serial(std::chrono::sys_days{ymd}.time_since_epoch().count()) {}
+  LegacyDate &operator++() {
+    ymd = std::chrono::sys_days{ymd} + std::chrono::days(1);
+    serial = std::chrono::sys_days{ymd}.time_since_epoch().count();
+    return *this;
+  }
+  unsigned day() const { return static_cast<unsigned>(ymd.day()); }
+  unsigned weekday_index() const {
+    return std::chrono::weekday{std::chrono::sys_days{ymd}}.c_encoding();
+  }
+};
+
+//walk BENCH_DAYS days, once only stepping and comparing serials as the
+//concurrency sweep does and once also reading the fields print_cal reads
+//for every cell
+static void date_bench() {
+  //per day lookup so the step loops cannot be folded into a closed form
+  std::vector<unsigned> weights(1024);
+  for(size_t i = 0; i < weights.size(); ++i) weights[i] = static_cast<unsigned>(std::rand() % 100);
+
+  unsigned long legacy_sum = 0;
+  unsigned long compact_sum = 0;
+  double legacy_step = best_time([&] {
+    LegacyDate d(1900, 1, 1);
+    for(long i = 0; i < BENCH_DAYS; ++i, ++d) legacy_sum += weights[static_cast<size_t>(d.serial) & 1023];
+  });
+  double compact_step = best_time([&] {
+    Date d(1900, 1, 1);
+    for(long i = 0; i < BENCH_DAYS; ++i, ++d) compact_sum += weights[static_cast<size_t>(d.serial_time()) & 1023];
+  });
+  double legacy_fields = best_time([&] {
+    LegacyDate d(1900, 1, 1);
+    for(long i = 0; i < BENCH_DAYS; ++i, ++d) legacy_sum += d.day() + d.weekday_index();
+  });
+  double compact_fields = best_time([&] {
+    Date d(1900, 1, 1);
+    for(long i = 0; i < BENCH_DAYS; ++i, ++d) compact_sum += d.day() + d.weekday_index();
+  });
+  if(legacy_sum != compact_sum) {
+    std::cerr << "date_bench: checksum mismatch" << std::endl;
+    std::exit(1);
+  }
+
+  auto ns = [](double t) { return t * 1e9 / BENCH_DAYS; };
+  std::cout << "day iteration: " << BENCH_DAYS << " days, sizeof(Date) = " << sizeof(Date)
+            << " (was " << sizeof(LegacyDate) << ")" << std::endl
+            << std::fixed << std::setprecision(2)
+            << "  step:     " << std::setw(8) << ns(legacy_step) << " -> "
+            << ns(compact_step) << " ns/day (" << legacy_step / compact_step << "x)" << std::endl
+            << "  fields:   " << std::setw(8) << ns(legacy_fields) << " -> "
+            << ns(compact_fields) << " ns/day (" << legacy_fields / compact_fields << "x)" << std::endl;
+}
+
+//parse the BENCH_EVENTS calendar on 1 to max(4, cores) threads
+static void parse_bench() {
+  GenConfig config;
+  config.events = BENCH_EVENTS;
+  write_calendar(BENCH_PATH, config);
+  double mb = file_mb(BENCH_PATH);
+  MappedFile file(BENCH_PATH);
+  unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+
+  std::cout << "parse threads: " << BENCH_EVENTS << " events, " << std::fixed << std::setprecision(1)
+            << mb << " MB, " << cores << " cores" << std::endl;
+  double single = 0;
+  for(unsigned threads = 1; threads <= std::max(4u, cores); threads *= 2) {
+    size_t count = 0;
+    double t = best_time([&] {
+      std::vector<Event> events;
+      StringArena strings;
+      parse_ics_parallel(file.view(), events, strings, threads);
+      count = events.size();
+    });
+    if(threads == 1) single = t;
+    std::cout << "  " << std::setw(2) << threads << " threads: " << std::setw(8) << std::setprecision(1)
+              << mb / t << " MB/s (" << std::setprecision(2) << single / t << "x, "
+              << count << " events)" << std::endl;
+  }
+  std::remove(BENCH_PATH);
+}
+
+//render one month of a calendar of RECUR_SERIES endless weekly series,
+//against a calendar holding only the occurrences visible in that month as
+//single events. lazy expansion should keep the two close.
+static void recurrence_bench() {
+  const size_t RECUR_SERIES = 10000;
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> start(0, 20 * 365);
+  std::vector<Event> series;
+  series.reserve(RECUR_SERIES);
+  for(size_t i = 0; i < RECUR_SERIES; ++i) {
+    Date b = Date(2000, 1, 1);
+    b.change_day(start(rng));
+    Date e = b;
+    series.emplace_back("Weekly", "WEEK", b, e);
+    series.back().set_rule(Recurrence::parse("FREQ=WEEKLY", static_cast<int32_t>(b.serial_time())));
+  }
+  std::sort(series.begin(), series.end(), Event::starts_before);
+  EventIndex series_index(&series);
+
+  Date b = Date(2024, 3, 1);
+  Date e = Date(2024, 3, 31);
+  TimeRange month = TimeRange(b, e);
+
+  //the same occurrences stored as single events
+  std::vector<Event> visible;
+  for(const Event &weekly : series) weekly.occurrences(month, visible);
+  std::sort(visible.begin(), visible.end(), Event::starts_before);
+  EventIndex visible_index(&visible);
+
+  int null_fd = open("/dev/null", O_WRONLY);
+  double lazy = best_time([&] {
+    CalendarRange r = CalendarRange(b, e);
+    r.set_events(series_index);
+    r.print_cal(null_fd);
+  });
+  double expanded = best_time([&] {
+    CalendarRange r = CalendarRange(b, e);
+    r.set_events(visible_index);
+    r.print_cal(null_fd);
+  });
+  close(null_fd);
+
+  std::cout << "recurrence: " << RECUR_SERIES << " weekly series, "
+            << visible.size() << " occurrences in one month" << std::endl
+            << std::fixed << std::setprecision(2)
+            << "  series:   " << std::setw(8) << lazy * 1e3 << " ms" << std::endl
+            << "  singles:  " << std::setw(8) << expanded * 1e3 << " ms ("
+            << lazy / expanded << "x)" << std::endl;
+}
+
+//merge the events of several calendars over a year, through the k-way
+//merge of CalendarRange::set_events against concatenating each source's
+//events and sorting them
+static void merge_bench() {
+  const size_t MERGE_SOURCES = 8;
+  const size_t MERGE_EVENTS = 25000; //per source
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> start(0, 4 * 365);
+  std::uniform_int_distribution<int> length(0, 3);
+  std::vector<std::vector<Event> > sources(MERGE_SOURCES);
+  std::vector<EventIndex> indexes(MERGE_SOURCES);
+  std::vector<const EventIndex *> index_ptrs;
+  std::vector<std::string> names;
+  for(size_t s = 0; s < MERGE_SOURCES; ++s) {
+    sources[s].reserve(MERGE_EVENTS);
+    for(size_t i = 0; i < MERGE_EVENTS; ++i) {
+      Date b = Date(2022, 1, 1);
+      b.change_day(start(rng));
+      Date e = b;
+      e.change_day(length(rng));
+      sources[s].emplace_back("Event", "EVNT", b, e);
+    }
+    std::sort(sources[s].begin(), sources[s].end(), Event::starts_before);
+    indexes[s].build(&sources[s]);
+    index_ptrs.push_back(&indexes[s]);
+    names.push_back("source" + std::to_string(s));
+  }
+
+  Date b = Date(2024, 1, 1);
+  Date e = Date(2024, 12, 31);
+  size_t days = 0;
+  double merged = best_time([&] {
+    CalendarRange r = CalendarRange(b, e);
+    r.set_events(index_ptrs, names);
+    days = r.get_concurrency().size();
+  });
+  double resorted = best_time([&] {
+    TimeRange r = TimeRange(b, e);
+    std::vector<const Event *> all;
+    for(const EventIndex &index : indexes) index.query(r, all);
+    std::sort(all.begin(), all.end(),
+              [](const Event *x, const Event *y) { return Event::starts_before(*x, *y); });
+    std::vector<unsigned> profile = concurrency_profile(r, all);
+    days = profile.size();
+  });
+
+  std::cout << "merge: " << MERGE_SOURCES << " calendars of " << MERGE_EVENTS
+            << " events over " << days << " days" << std::endl
+            << std::fixed << std::setprecision(2)
+            << "  k-way merge:   " << std::setw(8) << merged * 1e3 << " ms" << std::endl
+            << "  concat + sort: " << std::setw(8) << resorted * 1e3 << " ms ("
+            << resorted / merged << "x)" << std::endl;
+}
+
+//the next 10 events of calendars that share their future but not their
+//history, agenda latency should not grow with the history, even with an
+//event in progress since before all of it
+static void agenda_bench() {
+  const size_t AGENDA_FUTURE = 1000;
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> length(0, 3);
+  Date today = Date(2024, 3, 1);
+  long int from = today.serial_time();
+  std::cout << "agenda: next 10 of " << AGENDA_FUTURE << " upcoming events" << std::endl
+            << std::fixed << std::setprecision(2);
+  for(size_t history : {10000ul, 100000ul, 1000000ul}) {
+    std::uniform_int_distribution<int> past(-20 * 365, -10);
+    std::uniform_int_distribution<int> future(0, 365);
+    std::vector<Event> events;
+    events.reserve(history + AGENDA_FUTURE);
+    for(size_t i = 0; i < history + AGENDA_FUTURE; ++i) {
+      Date b = today;
+      b.change_day(i < history ? past(rng) : future(rng));
+      Date e = b;
+      e.change_day(length(rng));
+      events.emplace_back("Event", "EVNT", b, e);
+    }
+    Date lease = today;
+    lease.change_day(-21 * 365);
+    Date lease_end = today;
+    lease_end.change_day(5 * 365);
+    events.emplace_back("Lease", "LEAS", lease, lease_end);
+    std::sort(events.begin(), events.end(), Event::starts_before);
+    EventIndex index(&events);
+    const int queries = 1000;
+    double agenda = best_time([&] {
+      std::vector<Event> upcoming;
+      for(int q = 0; q < queries; ++q) {
+        upcoming.clear();
+        index.upcoming(from, LONG_MAX, 10, upcoming);
+      }
+    });
+    std::cout << "  " << std::setw(8) << history << " past: " << std::setw(8)
+              << agenda / queries * 1e6 << " us" << std::endl;
+  }
+}
+
+//free runs over ten years of a packed calendar, through the boundary
+//sweep against checking each day against each event in range
+static void freebusy_bench() {
+  const size_t FREE_EVENTS = 2000;
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> start(0, 10 * 365);
+  std::uniform_int_distribution<int> length(0, 2);
+  std::vector<Event> events;
+  events.reserve(FREE_EVENTS);
+  for(size_t i = 0; i < FREE_EVENTS; ++i) {
+    Date b = Date(2015, 1, 1);
+    b.change_day(start(rng));
+    Date e = b;
+    e.change_day(length(rng));
+    events.emplace_back("Event", "EVNT", b, e);
+  }
+  std::sort(events.begin(), events.end(), Event::starts_before);
+  Date b = Date(2015, 1, 1);
+  Date e = Date(2024, 12, 31);
+  CalendarRange range = CalendarRange(b, e);
+  range.set_events(&events);
+
+  size_t sweep_runs = 0;
+  double sweep = best_time([&] { sweep_runs = free_spans(range, range.get_events(), 2).size(); });
+  size_t naive_runs = 0;
+  double naive = best_time([&] {
+    naive_runs = 0;
+    size_t run = 0;
+    for(Date d = b; d <= e; ++d) {
+      bool busy = false;
+      for(const Event *event : range.get_events()) {
+        if(event->get_begin() <= d && d <= event->get_end()) {
+          busy = true;
+          break;
+        }
+      }
+      if(!busy) {
+        ++run;
+        continue;
+      }
+      if(run >= 2) ++naive_runs;
+      run = 0;
+    }
+    if(run >= 2) ++naive_runs;
+  });
+
+  std::cout << "free/busy: " << FREE_EVENTS << " events over ten years, " << sweep_runs
+            << " free runs of 2+ days" << (sweep_runs == naive_runs ? "" : " (MISMATCH)") << std::endl
+            << std::fixed << std::setprecision(2)
+            << "  boundary sweep: " << std::setw(8) << sweep * 1e3 << " ms" << std::endl
+            << "  day x event:    " << std::setw(8) << naive * 1e3 << " ms ("
+            << naive / sweep << "x)" << std::endl;
+}
+
+//per month stats over thirty years from the occupancy built with the
+//range, against collecting each month's events and checking each day
+//against them
+static void occupancy_bench() {
+  const size_t STATS_EVENTS = 20000;
+  std::mt19937 rng(2);
+  std::uniform_int_distribution<int> start(0, 30 * 365);
+  std::uniform_int_distribution<int> length(0, 3);
+  const char *tags[] = {"WORK", "HOME", "GYM", "TRIP"};
+  std::vector<Event> events;
+  events.reserve(STATS_EVENTS);
+  for(size_t i = 0; i < STATS_EVENTS; ++i) {
+    Date b = Date(1995, 1, 1);
+    b.change_day(start(rng));
+    Date e = b;
+    e.change_day(length(rng));
+    events.emplace_back("Event", tags[i % 4], b, e);
+  }
+  std::sort(events.begin(), events.end(), Event::starts_before);
+  Date b = Date(1995, 1, 1);
+  Date e = Date(2024, 12, 31);
+  std::vector<std::string> tracked = {"WORK", "HOME"};
+  CalendarRange range = CalendarRange(b, e);
+  range.track_tags(tracked);
+  range.set_events(&events);
+  const Occupancy &occupancy = range.get_occupancy();
+
+  //month boundaries as day offsets into the range
+  std::vector<size_t> months = {0};
+  for(int y = 1995; y <= 2024; ++y) {
+    for(unsigned m = 1; m <= 12; ++m) months.push_back(months.back() + days_in_month(y, m));
+  }
+
+  size_t fast_total = 0;
+  double build = best_time([&] { range.set_events(&events); });
+  double fast = best_time([&] {
+    fast_total = 0;
+    for(size_t i = 0; i + 1 < months.size(); ++i) {
+      size_t n = months[i + 1] - months[i];
+      fast_total += occupancy.busy_days(months[i], n) + occupancy.peak(months[i], n)
+                  + occupancy.tag_days_in(tracked, months[i], n);
+    }
+  });
+  size_t naive_total = 0;
+  uint32_t work = Event::tag_key("WORK");
+  uint32_t home = Event::tag_key("HOME");
+  double naive = best_time([&] {
+    naive_total = 0;
+    const std::vector<const Event *> &in_range = range.get_events();
+    for(size_t i = 0; i + 1 < months.size(); ++i) {
+      long int first = b.serial_time() + static_cast<long int>(months[i]);
+      long int last = b.serial_time() + static_cast<long int>(months[i + 1]) - 1;
+      std::vector<const Event *> month;
+      for(const Event *event : in_range) {
+        if(event->get_begin().serial_time() <= last && event->get_end().serial_time() >= first) {
+          month.push_back(event);
+        }
+      }
+      unsigned peak = 0;
+      for(long int d = first; d <= last; ++d) {
+        unsigned count = 0;
+        bool has_work = false, has_home = false;
+        for(const Event *event : month) {
+          if(event->get_begin().serial_time() > d || event->get_end().serial_time() < d) continue;
+          ++count;
+          has_work |= event->tag_key() == work;
+          has_home |= event->tag_key() == home;
+        }
+        naive_total += (count > 0) + (has_work && has_home);
+        peak = std::max(peak, count);
+      }
+      naive_total += peak;
+    }
+  });
+
+  std::cout << "occupancy: " << STATS_EVENTS << " events over thirty years, "
+            << months.size() - 1 << " months of stats"
+            << (fast_total == naive_total ? "" : " (MISMATCH)") << std::endl
+            << std::fixed << std::setprecision(2)
+            << "  build:          " << std::setw(8) << build * 1e3 << " ms" << std::endl
+            << "  occupancy:      " << std::setw(8) << fast * 1e3 << " ms" << std::endl
+            << "  day x event:    " << std::setw(8) << naive * 1e3 << " ms ("
+            << naive / fast << "x)" << std::endl;
+}
+
+//two word queries over a large calendar through the inverted index,
+//against tokenizing every title and tag as a scan would
+static void search_bench() {
+  const size_t SEARCH_EVENTS = 50000;
+  const char *pool[] = {"dentist", "team", "meeting", "call", "review", "lunch", "standup",
+                        "planning", "trip", "gym", "doctor", "school", "dinner", "party"};
+  std::mt19937 rng(3);
+  std::uniform_int_distribution<int> word(0, 13);
+  std::uniform_int_distribution<int> start(0, 20 * 365);
+  std::vector<std::string> titles(SEARCH_EVENTS);
+  std::vector<Event> events;
+  events.reserve(SEARCH_EVENTS);
+  for(size_t i = 0; i < SEARCH_EVENTS; ++i) {
+    titles[i] = std::string(pool[word(rng)]) + " " + pool[word(rng)] + " "
+              + std::to_string(i % 997);
+    Date d = Date(2005, 1, 1);
+    d.change_day(start(rng));
+    events.emplace_back(titles[i], "EVNT", d, d);
+  }
+
+  SearchIndex index;
+  double build = best_time([&] { index.build(events); });
+  size_t indexed_hits = 0;
+  double indexed = best_time([&] {
+    indexed_hits = index.query("dentist 42").size() + index.query("team meeting").size();
+  });
+  size_t scan_hits = 0;
+  double scan = best_time([&] {
+    scan_hits = 0;
+    for(const char *query : {"dentist 42", "team meeting"}) {
+      std::vector<std::string> wanted;
+      SearchIndex::tokenize(query, wanted);
+      for(const Event &e : events) {
+        std::vector<std::string> held;
+        SearchIndex::tokenize(e.get_title(), held);
+        SearchIndex::tokenize(e.get_tag(), held);
+        bool all = true;
+        for(const std::string &w : wanted) all = all && std::count(held.begin(), held.end(), w);
+        scan_hits += all;
+      }
+    }
+  });
+
+  std::cout << "search: " << SEARCH_EVENTS << " events, " << index.size() << " words, "
+            << indexed_hits << " hits" << (indexed_hits == scan_hits ? "" : " (MISMATCH)") << std::endl
+            << std::fixed << std::setprecision(3)
+            << "  build:          " << std::setw(8) << build * 1e3 << " ms" << std::endl
+            << "  index:          " << std::setw(8) << indexed * 1e3 << " ms" << std::endl
+            << "  scan:           " << std::setw(8) << scan * 1e3 << " ms ("
+            << scan / indexed << "x)" << std::endl;
+}
+
+//import records into a 20000 event calendar in one batch, against a
+//load, add and commit per record as repeated planner -n runs do
+static void batch_bench() {
+  const size_t BATCH_RECORDS = 2000;
+  const size_t CYCLE_RECORDS = 50;
+  const std::string path = "/tmp/planner_batch_bench.ics";
+  auto reset = [&] {
+    for(const std::string &file : {path + JOURNAL_SUFFIX, path + SNAPSHOT_SUFFIX, path + LOCK_SUFFIX,
+                                   path + SEARCH_SUFFIX}) {
+      std::remove(file.c_str());
+    }
+    GenConfig config;
+    config.events = 20000;
+    write_calendar(path, config);
+  };
+  std::string lines;
+  for(size_t i = 0; i < BATCH_RECORDS; ++i) {
+    lines.append("0").append(std::to_string(1 + i % 9)).append("/1").append(std::to_string(i % 10))
+         .append("/2024 IMP Imported ").append(std::to_string(i)).append("\n");
+  }
+
+  size_t applied = 0;
+  double batch = 0;
+  for(int run = 0; run < BENCH_RUNS; ++run) {
+    reset();
+    auto t0 = std::chrono::steady_clock::now();
+    std::istringstream in(lines);
+    std::vector<BatchRecord> records;
+    std::vector<BatchError> errors;
+    read_batch(in, records, errors);
+    Calendar c = Calendar();
+    c.load_events(path);
+    applied = c.apply_batch(records, errors);
+    c.commit_events(path);
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+    if(run == 0 || dt.count() < batch) batch = dt.count();
+  }
+
+  reset();
+  std::istringstream in(lines);
+  std::vector<BatchRecord> records;
+  std::vector<BatchError> errors;
+  read_batch(in, records, errors);
+  auto t0 = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < CYCLE_RECORDS; ++i) {
+    Calendar c = Calendar();
+    c.load_events(path);
+    c.apply_record(records[i], errors);
+    c.commit_events(path);
+  }
+  std::chrono::duration<double> cycles = std::chrono::steady_clock::now() - t0;
+  double per_record = cycles.count() / CYCLE_RECORDS;
+
+  std::cout << "batch: " << applied << " records into 20000 events" << std::endl
+            << std::fixed << std::setprecision(2)
+            << "  one batch:        " << std::setw(8) << batch * 1e3 << " ms" << std::endl
+            << "  cycle per record: " << std::setw(8) << per_record * BATCH_RECORDS * 1e3 << " ms ("
+            << per_record * BATCH_RECORDS / batch << "x, from " << CYCLE_RECORDS << " cycles)" << std::endl;
+  reset();
+  std::remove(path.c_str());
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+}
+
+//parse BENCH_EVENTS all day events against the same events timed in
+//another zone than the display zone, so every DTSTART and DTEND goes
+//through a utc and a display zone conversion
+static void timezone_bench() {
+  std::string all_day, timed;
+  for(size_t i = 0; i < BENCH_EVENTS; ++i) {
+    Date d = Date(2000, 1, 1);
+    d.change_day(static_cast<int>(i % 9000));
+    std::string day = d.to_tz_tstamp().substr(0, 8);
+    std::string head = "BEGIN:VEVENT\r\nSUMMARY:Meeting\r\nDESCRIPTION:MEET\r\n";
+    all_day.append(head).append("DTSTART:").append(day).append("T000000Z\r\nDTEND:")
+           .append(day).append("T000000Z\r\nEND:VEVENT\r\n");
+    timed.append(head).append("DTSTART;TZID=America/New_York:").append(day)
+         .append("T093000\r\nDTEND;TZID=America/New_York:").append(day)
+         .append("T103000\r\nEND:VEVENT\r\n");
+  }
+  const TimeZone &display = *TimeZone::locate("Europe/Berlin");
+  size_t count = 0;
+  double dates = best_time([&] {
+    std::vector<Event> events;
+    StringArena strings;
+    parse_ics(all_day, events, strings, display);
+    count = events.size();
+  });
+  double times = best_time([&] {
+    std::vector<Event> events;
+    StringArena strings;
+    parse_ics(timed, events, strings, display);
+    count = events.size();
+  });
+
+  auto ns = [count](double t) { return t * 1e9 / static_cast<double>(count); };
+  std::cout << "timezones: " << count << " events, America/New_York shown in Europe/Berlin" << std::endl
+            << std::fixed << std::setprecision(1)
+            << "  all day:  " << std::setw(8) << ns(dates) << " ns/event" << std::endl
+            << "  timed:    " << std::setw(8) << ns(times) << " ns/event ("
+            << std::setprecision(2) << times / dates << "x)" << std::endl;
+}
+
+// === Harness ===
+
+//per operation wall times of one bench run
+struct Samples {
+  std::string op;
+  std::vector<double> seconds;
+  double per_sample; //units of work per sample for throughput
+  const char *unit;
+};
+
+//return the p'th percentile of seconds in microseconds
+static double percentile_us(std::vector<double> seconds, double p) {
+  size_t k = static_cast<size_t>(p * static_cast<double>(seconds.size() - 1) + 0.5);
+  std::nth_element(seconds.begin(), seconds.begin() + static_cast<long>(k), seconds.end());
+  return seconds[k] * 1e6;
+}
+
+template <typename F>
+static double time_once(F f) {
+  auto t0 = std::chrono::steady_clock::now();
+  f();
+  std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+  return dt.count();
+}
+
+//baseline p50s keyed by "<events> <op>"
+typedef std::map<std::string, double> Baseline;
+
+static Baseline read_baseline(const std::string &path) {
+  Baseline baseline;
+  std::ifstream ifs(path);
+  std::string events, op;
+  double p50;
+  while(ifs >> events >> op >> p50) baseline[events + " " + op] = p50;
+  return baseline;
+}
+
+//time each calendar operation on a calendar generated from config,
+//print p50/p99/throughput and append the p50s to results
+static void workload_bench(const GenConfig &config, int runs, const Baseline &baseline,
+                           Baseline &results) {
+  const std::string path = std::string("/tmp/planner_bench_").append(std::to_string(config.events)).append(".ics");
+  const std::string save_path = "/tmp/planner_bench_save.ics";
+  const size_t queries = 200;
+  write_calendar(path, config);
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+  double mb = file_mb(path);
+  double events = static_cast<double>(config.events);
+
+  std::vector<Samples> samples;
+  samples.push_back({"load_events", {}, events, "events"});
+  samples.push_back({"load_snapshot", {}, events, "events"});
+  samples.push_back({"save_events", {}, events, "events"});
+  samples.push_back({"set_events", {}, 1, "calls"});
+  samples.push_back({"print_cal", {}, 1, "calls"});
+  samples.push_back({"remove_event", {}, 1, "calls"});
+  samples.push_back({"cli_print", {}, 1, "calls"});
+  samples.push_back({"daemon_print", {}, 1, "calls"});
+
+  //cold loads parse the ics file and build the snapshot the next loads read
+  for(int i = 0; i < runs; ++i) {
+    std::remove((path + SNAPSHOT_SUFFIX).c_str());
+    samples[0].seconds.push_back(time_once([&] { Calendar().load_events(path); }));
+  }
+  for(int i = 0; i < runs; ++i) {
+    samples[1].seconds.push_back(time_once([&] { Calendar().load_events(path); }));
+  }
+
+  Calendar c = Calendar();
+  c.load_events(path);
+  for(int i = 0; i < runs; ++i) {
+    samples[2].seconds.push_back(time_once([&] { c.save_events(save_path); }));
+  }
+
+  //one month windows at random positions of the calendar
+  std::mt19937 rng(config.seed);
+  std::uniform_int_distribution<int> start(0, span_days(config) - 1);
+  EventIndex index(&c.get_events());
+  int null_fd = open("/dev/null", O_WRONLY);
+  for(size_t i = 0; i < queries; ++i) {
+    Date b = Date(1995, 1, 1);
+    b.change_day(start(rng));
+    Date e = b;
+    e.change_day(30);
+    CalendarRange range = CalendarRange(b, e);
+    samples[3].seconds.push_back(time_once([&] { range.set_events(index); }));
+    samples[4].seconds.push_back(time_once([&] { range.print_cal(null_fd); }));
+  }
+
+  //a month printed by a fresh load, as a cli run without a daemon does
+  //minus process startup, against the same month served by a daemon
+  const std::string socket_path = path + DAEMON_SOCKET_SUFFIX;
+  pid_t daemon = fork();
+  if(daemon == 0) {
+    run_daemon(path, socket_path);
+    _exit(0);
+  }
+  while(!daemon_request(socket_path, "LIST", null_fd)) usleep(1000);
+  for(int i = 0; i < runs * 4; ++i) {
+    Date b = Date(1995, 1, 1);
+    b.change_day(start(rng));
+    Date e = b;
+    e.change_day(30);
+    std::string request = "PRINT\t" + b.to_tz_tstamp() + "\t" + e.to_tz_tstamp();
+    samples[6].seconds.push_back(time_once([&] {
+      Calendar cold = Calendar();
+      cold.load_events(path);
+      cold.set_range(b.year(), b.month(), b.day(), e.year(), e.month(), e.day());
+      cold.print(null_fd);
+    }));
+    samples[7].seconds.push_back(time_once([&] { daemon_request(socket_path, request, null_fd); }));
+  }
+  kill(daemon, SIGTERM);
+  waitpid(daemon, nullptr, 0);
+  close(null_fd);
+
+  //the first removal builds the uid lookup, which is timed as part of load
+  std::vector<std::string> uids;
+  std::uniform_int_distribution<size_t> pick(0, c.get_events().size() - 1);
+  for(size_t i = 0; i <= queries && i < c.get_events().size(); ++i) {
+    uids.emplace_back(c.get_events()[pick(rng)].get_uid());
+  }
+  std::sort(uids.begin(), uids.end());
+  uids.erase(std::unique(uids.begin(), uids.end()), uids.end());
+  for(size_t i = 0; i < uids.size(); ++i) {
+    double t = time_once([&] { c.remove_event(uids[i].data()); });
+    if(i > 0) samples[5].seconds.push_back(t);
+  }
+
+  std::cout << std::fixed << std::setprecision(1)
+            << "events=" << config.events << " durations=" << durations_name(config.durations)
+            << " mean_days=" << config.mean_days << " overlap=" << config.overlap
+            << " file=" << mb << " MB" << std::endl
+            << "  " << std::left << std::setw(15) << "op" << std::right
+            << std::setw(6) << "runs" << std::setw(12) << "p50 us" << std::setw(12) << "p99 us"
+            << std::setw(18) << "throughput" << "  vs baseline" << std::endl;
+  for(const Samples &op : samples) {
+    if(op.seconds.empty()) continue;
+    double p50 = percentile_us(op.seconds, 0.5);
+    double p99 = percentile_us(op.seconds, 0.99);
+    std::string key = std::to_string(config.events) + " " + op.op;
+    results[key] = p50;
+
+    std::ostringstream throughput;
+    throughput << std::fixed << std::setprecision(0) << op.per_sample / (p50 / 1e6) << " " << op.unit << "/s";
+    std::cout << "  " << std::left << std::setw(15) << op.op << std::right
+              << std::setw(6) << op.seconds.size() << std::setprecision(1)
+              << std::setw(12) << p50 << std::setw(12) << p99 << std::setw(18) << throughput.str();
+    auto base = baseline.find(key);
+    if(base != baseline.end() && base->second > 0) {
+      double ratio = p50 / base->second;
+      std::cout << "  " << std::setprecision(2) << ratio << "x";
+      if(ratio > BENCH_REGRESSION) std::cout << " REGRESSION";
+    }
+    std::cout << std::endl;
+  }
+
+  std::remove(path.c_str());
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+  std::remove(save_path.c_str());
+  std::remove((save_path + SNAPSHOT_SUFFIX).c_str());
+}
+
+//return comma separated sizes in s, accepting 1e5 style exponents
+static std::vector<size_t> parse_sizes(const char *s) {
+  std::vector<size_t> sizes;
+  std::istringstream iss(s);
+  std::string item;
+  while(std::getline(iss, item, ',')) sizes.push_back(static_cast<size_t>(std::stod(item)));
+  return sizes;
+}
+
+static void usage() {
+  std::cerr << "usage: planner_bench [-n sizes] [-d fixed|uniform|longtail] [-m mean_days]" << std::endl
+            << "                     [-o overlap] [-r runs] [-b baseline] [-w baseline]" << std::endl
+            << "                     [-g path] [-c]" << std::endl
+            << "  -n  comma separated event counts, e.g. 1e3,1e5,1e7" << std::endl
+            << "  -b  compare p50s against baseline file" << std::endl
+            << "  -w  write p50s to baseline file" << std::endl
+            << "  -g  only write a calendar of the first size to path" << std::endl
+            << "  -c  also run the loader and Date comparison benchmarks" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  GenConfig config;
+  std::vector<size_t> sizes = {1000, 10000, 100000};
+  int runs = BENCH_RUNS;
+  std::string baseline_path, write_path, generate_path;
+  bool comparisons = false;
+
+  int option;
+  while((option = getopt(argc, argv, "n:d:m:o:r:b:w:g:ch")) != -1) {
+    switch(option) {
+    case 'n': sizes = parse_sizes(optarg); break;
+    case 'd':
+      if(std::string(optarg) == "fixed") config.durations = Durations::FIXED;
+      else if(std::string(optarg) == "longtail") config.durations = Durations::LONG_TAIL;
+      else config.durations = Durations::UNIFORM;
+      break;
+    case 'm': config.mean_days = static_cast<unsigned>(atoi(optarg)); break;
+    case 'o': config.overlap = std::max(0.01, atof(optarg)); break;
+    case 'r': runs = std::max(1, atoi(optarg)); break;
+    case 'b': baseline_path = optarg; break;
+    case 'w': write_path = optarg; break;
+    case 'g': generate_path = optarg; break;
+    case 'c': comparisons = true; break;
+    default: usage(); return 1;
+    }
+  }
+  if(sizes.empty()) {
+    usage();
+    return 1;
+  }
+
+  if(!generate_path.empty()) {
+    config.events = sizes[0];
+    write_calendar(generate_path, config);
+    return 0;
+  }
+
+  Baseline baseline = baseline_path.empty() ? Baseline() : read_baseline(baseline_path);
+  Baseline results;
+  for(size_t n : sizes) {
+    config.events = n;
+    workload_bench(config, runs, baseline, results);
+  }
+  if(!write_path.empty()) {
+    std::ofstream ofs(write_path);
+    ofs << std::fixed << std::setprecision(1);
+    for(const auto &[key, p50] : results) ofs << key << " " << p50 << std::endl;
+  }
+
+  if(comparisons) {
+    load_bench();
+    date_bench();
+    parse_bench();
+    recurrence_bench();
+    merge_bench();
+    agenda_bench();
+    freebusy_bench();
+    occupancy_bench();
+    search_bench();
+    batch_bench();
+    timezone_bench();
+  }
+  return 0;
+}
@@ -1,81 +1,574 @@
 #include <algorithm>
-#include <fstream>
+#include <climits>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
 #include <unordered_map>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "cal.h"
 #include "datetime.h"
+#include "config.h"
+#include "freebusy.h"
+#include "ics.h"
+#include "profile.h"
+#include "snapshot.h"
+
+unsigned Calendar::parse_threads = PARSE_THREADS;
 
 //CalendarRange
-Calendar::Calendar() {}
+Calendar::Calendar()
+  : index_dirty(true), dirty(false), lookup_dirty(true), search_built(false), search_base{0, 0, 0},
+    search_base_count(0), save_append_at(0), save_tail_hash(0), journal_offset(0), generation(0) {}
 
-//TODO: this is a temporary solution. currently using format
-//to make future integration with icalendar files easier.
-//in this current form this is not guaranteed to work properly
-//with ics files and does not properly check for errors.
+//header property recording the generation of a save file
+#define GENERATION_PROPERTY "X-PLANNER-GENERATION:"
+
+//return the number the digits at the start of s spell, 0 if there are none
+static uint64_t parse_number(std::string_view s) {
+  uint64_t n = 0;
+  for(size_t i = 0; i < s.length() && s[i] >= '0' && s[i] <= '9'; ++i) {
+    n = n * 10 + static_cast<uint64_t>(s[i] - '0');
+  }
+  return n;
+}
+
+//return the generation in the header of save file buf, 0 if it has none
+static uint64_t save_generation(std::string_view buf) {
+  std::string_view header = buf.substr(0, buf.find("BEGIN:VEVENT"));
+  size_t at = header.find(GENERATION_PROPERTY);
+  if(at == std::string_view::npos) return 0;
+  return parse_number(header.substr(at + strlen(GENERATION_PROPERTY)));
+}
+
+//return the generation of the save file journal buf applies to, from its
+//leading GEN record, 0 if it has none
+static uint64_t journal_generation(std::string_view buf) {
+  if(buf.substr(0, 4) != "GEN\t") return 0;
+  return parse_number(buf.substr(4));
+}
+
+//loads the binary snapshot next to path if it is current, otherwise maps
+//the save file, parses it in place, in chunks on parse_threads threads
+//when it is large, and rebuilds the snapshot. see parse_ics for the
+//supported subset of the icalendar format.
+//changes recorded in the journal next to path are replayed on top.
 void Calendar::load_events(std::string path) {
-  std::string line;
-  std::string key;
-  std::string value;
-  size_t pos;
-  std::string title;
-  std::string tag;
-  Date begin;
-  Date end;
-
-  std::ifstream ifs;
-  ifs.open(path, std::ifstream::in);
-
-  std::getline(ifs, line);
-  while(ifs.good()) {
-    if(line[0] != ' ') {
-      if(line.empty() || (pos = line.find(':')) == std::string::npos) break;
-      key   = line.substr(0, pos);
-      value = line.substr(pos+1, line.length()-pos-2);
-      if(key == "SUMMARY") title = value;
-      else if(key == "DESCRIPTION") tag = value;
-      else if(key == "DTSTART") {
-        int year = atoi(value.substr(0,4).c_str());
-        unsigned month = static_cast<unsigned>(atoi(value.substr(4,2).c_str()));
-        unsigned day = static_cast<unsigned>(atoi(value.substr(6,2).c_str()));
-        begin = Date(year, month, day);
-      } else if(key == "DTEND") {
-        int year = atoi(value.substr(0,4).c_str());
-        unsigned month = static_cast<unsigned>(atoi(value.substr(4,2).c_str()));
-        unsigned day = static_cast<unsigned>(atoi(value.substr(6,2).c_str()));
-        end = Date(year, month, day);
-      } else if(key == "END" && value == "VEVENT") {
-        events.emplace_back(Event(title, tag, begin, end));
+  PROFILE_PHASE(PHASE_LOAD);
+  loaded_path = path;
+  SnapshotSource source = snapshot_source(path);
+  journal_source = snapshot_source(path + JOURNAL_SUFFIX);
+  bool from_snapshot;
+  {
+    PROFILE_PHASE(PHASE_SNAPSHOT);
+    from_snapshot = load_snapshot(path + SNAPSHOT_SUFFIX, source, events, strings);
+  }
+  {
+    MappedFile file(path);
+    note_save_file(file.view(), source);
+    dirty = false;
+    if(!from_snapshot) {
+      PROFILE_PHASE(PHASE_PARSE);
+      parse_ics_parallel(file.view(), events, strings, parse_threads);
+    }
+  }
+  if(!from_snapshot) {
+    //keep the same order a snapshot load produces
+    std::stable_sort(events.begin(), events.end(), Event::starts_before);
+  }
+  //snapshot uids are already unique, the lookup is built on first use
+  if(from_snapshot) lookup_dirty = true;
+  else assign_uids();
+  if(!from_snapshot && source.size > 0) {
+    PROFILE_PHASE(PHASE_SNAPSHOT);
+    save_snapshot(path + SNAPSHOT_SUFFIX, source, events);
+  }
+  //the search file is built for the events in this order
+  search.clear();
+  search_built = false;
+  search_base = source;
+  search_base_count = events.size();
+  search_origin.clear();
+  {
+    PROFILE_PHASE(PHASE_JOURNAL);
+    MappedFile journal_file(path + JOURNAL_SUFFIX);
+    std::string_view records = journal_file.view();
+    //a journal of an older generation was folded into the save file by a
+    //compaction that stopped before truncating it
+    journal_offset = 0;
+    if(journal_generation(records) == generation) replay_journal(records, journal_offset);
+    else journal_offset = records.length();
+  }
+  index_dirty = true;
+  PROFILE_COUNT(COUNT_EVENTS_LOADED, events.size());
+}
+
+//remember where events can be appended to buf, the save file contents
+//for source, and a hash of the bytes before that point
+void Calendar::note_save_file(std::string_view buf, const SnapshotSource &source) {
+  save_source = source;
+  generation = save_generation(buf);
+  size_t end = buf.rfind("END:VCALENDAR");
+  save_append_at = (end == std::string_view::npos) ? buf.length() : end;
+  size_t window = std::min<size_t>(save_append_at, REFRESH_TAIL_WINDOW);
+  save_tail_hash = fnv1a(buf.data() + save_append_at - window, window);
+}
+
+//journal records are tab separated lines, one per change, after a
+//leading GEN <generation> record once the save file has a generation:
+//  ADD <begin tstamp> <end tstamp> <tag> <uid> <title>
+//with timestamps written by format_tstamp.
+//  DEL <uid>
+//replays the complete records of buf from offset, moving offset past each
+//one as it is applied so a record that throws leaves it at that record.
+//with skip_known, records adding a uid that is already loaded are skipped
+//so records this calendar wrote itself are not applied twice.
+void Calendar::replay_journal(std::string_view buf, size_t &offset, bool skip_known) {
+  if(skip_known) ensure_lookup();
+  size_t pos = offset;
+  while(pos < buf.length()) {
+    size_t eol = buf.find('\n', pos);
+    //a record without a newline was cut short by a crash, ignore it
+    if(eol == std::string_view::npos) break;
+    std::string_view line = buf.substr(pos, eol - pos);
+    pos = eol + 1;
+
+    std::string_view fields[6];
+    size_t n = 0;
+    while(n < 5) {
+      size_t tab = line.find('\t');
+      if(tab == std::string_view::npos) break;
+      fields[n++] = line.substr(0, tab);
+      line.remove_prefix(tab + 1);
+    }
+    fields[n++] = line;
+
+    if(n == 6 && fields[0] == "ADD") {
+      IcsTime begin, end;
+      parse_ics_span(fields[1], fields[2], begin, end);
+      if(!skip_known || !uid_index.count(fields[4])) {
+        Event e(fields[5], fields[3], begin.day, end.day, fields[4]);
+        if(begin.minute != Event::ALL_DAY) e.set_times(begin.minute, end.minute);
+        add_event(e);
+      }
+    } else if(n == 2 && fields[0] == "DEL") {
+      erase_uid(fields[1]);
+    }
+    offset = pos;
+  }
+}
+
+//give events loaded without a UID property one derived from their
+//contents, so the same file always produces the same uids, and build
+//the uid and tag lookup.
+void Calendar::assign_uids() {
+  uid_index.clear();
+  tag_index.clear();
+  uid_index.reserve(events.size());
+  tag_index.reserve(events.size());
+  for(size_t i = 0; i < events.size(); ++i) {
+    if(events[i].get_uid().empty() || uid_index.count(events[i].get_uid())) {
+      events[i].set_uid(make_uid(events[i]));
+    }
+    uid_index.emplace(events[i].get_uid(), i);
+    tag_index.emplace(events[i].tag_key(), i);
+  }
+  lookup_dirty = false;
+}
+
+//build the uid and tag lookup if events changed without maintaining it
+void Calendar::ensure_lookup() {
+  if(lookup_dirty) assign_uids();
+}
+
+//return a uid derived from the contents of e that is not yet in use,
+//stored in the arena
+std::string_view Calendar::make_uid(const Event &e) {
+  std::string key = format_tstamp(e.get_begin(), e.get_begin_minute())
+                  + format_tstamp(e.get_end(), e.get_end_minute());
+  key.append(e.get_tag()).append(e.get_title());
+  uint64_t hash = fnv1a(key.data(), key.length());
+  char buf[48];
+  for(unsigned n = 0; n == 0 || uid_index.count(buf); ++n) {
+    if(n == 0) snprintf(buf, sizeof(buf), "%016llx@planner", static_cast<unsigned long long>(hash));
+    else snprintf(buf, sizeof(buf), "%016llx-%u@planner", static_cast<unsigned long long>(hash), n);
+  }
+  return strings.store(buf);
+}
+
+//append e, copying its title and uid into the arena and assigning it a
+//uid if it has none, and index it
+void Calendar::add_event(Event e) {
+  e.set_title(strings.store(e.get_title()));
+  if(e.get_uid().empty()) {
+    ensure_lookup();
+    e.set_uid(make_uid(e));
+  } else {
+    e.set_uid(strings.store(e.get_uid()));
+  }
+  events.push_back(e);
+  dirty = true;
+  if(!lookup_dirty) {
+    uid_index.emplace(e.get_uid(), events.size() - 1);
+    tag_index.emplace(e.tag_key(), events.size() - 1);
+  }
+  if(search_built) search.add(static_cast<uint32_t>(events.size() - 1), events.back());
+  else if(!search_origin.empty()) search_origin.push_back(SearchIndex::NO_POSITION);
+  //appends leave the index valid, get_index extends it
+}
+
+//remove the event at pos in O(1) by moving the last event into its place
+void Calendar::erase_at(size_t pos) {
+  size_t last = events.size() - 1;
+  auto unindex_tag = [this](uint32_t tag, size_t at) {
+    auto range = tag_index.equal_range(tag);
+    for(auto it = range.first; it != range.second; ++it) {
+      if(it->second == at) {
+        tag_index.erase(it);
+        return;
+      }
+    }
+  };
+
+  uid_index.erase(events[pos].get_uid());
+  unindex_tag(events[pos].tag_key(), pos);
+  if(search_built) {
+    search.remove(static_cast<uint32_t>(pos), events[pos]);
+    if(pos != last) {
+      search.remove(static_cast<uint32_t>(last), events[last]);
+      search.add(static_cast<uint32_t>(pos), events[last]);
+    }
+  } else {
+    //until now events were the save file's in order, then those added
+    if(search_origin.empty()) {
+      search_origin.assign(events.size(), SearchIndex::NO_POSITION);
+      for(size_t i = 0; i < std::min(search_base_count, events.size()); ++i) {
+        search_origin[i] = static_cast<uint32_t>(i);
       }
     }
-    std::getline(ifs, line);
+    search_origin[pos] = search_origin[last];
+    search_origin.pop_back();
+  }
+  if(pos != last) {
+    unindex_tag(events[last].tag_key(), last);
+    uid_index[events[last].get_uid()] = pos;
+    tag_index.emplace(events[last].tag_key(), pos);
+    events[pos] = std::move(events[last]);
   }
+  events.pop_back();
+  index_dirty = true;
+  dirty = true;
+}
 
-  ifs.close();
+bool Calendar::erase_uid(std::string_view uid) {
+  ensure_lookup();
+  auto it = uid_index.find(uid);
+  if(it == uid_index.end()) return false;
+  erase_at(it->second);
+  return true;
+}
+
+//appends changes made since load_events to the journal. once the journal
+//passes JOURNAL_COMPACT_SIZE it is folded back into the ics file at path.
+void Calendar::commit_events(std::string path) {
+  if(journal.empty()) return;
+  PROFILE_PHASE(PHASE_COMMIT);
+  //writers of path take turns, readers rely on appends and renames
+  FileLock lock(path + LOCK_SUFFIX);
+
+  std::string journal_path = path + JOURNAL_SUFFIX;
+  int fd = open(journal_path.c_str(), O_RDWR | O_APPEND | O_CREAT, 0644);
+  if(fd < 0) throw std::runtime_error("Unable to open journal " + journal_path);
+
+  //records apply to the save file as it is now, another writer may have
+  //compacted it since the load
+  uint64_t current;
+  {
+    MappedFile save(path);
+    current = save_generation(save.view());
+  }
+  struct stat st;
+  char last = '\n';
+  bool caught_up = false;
+  if(fstat(fd, &st) == 0) {
+    char head[32] = {};
+    if(st.st_size > 0) pread(fd, head, sizeof(head) - 1, 0);
+    //a journal left over from an interrupted compaction is already folded in
+    if(st.st_size > 0 && journal_generation(head) != current && ftruncate(fd, 0) == 0) {
+      st.st_size = 0;
+    }
+    if(st.st_size > 0) pread(fd, &last, 1, st.st_size - 1);
+    caught_up = path == loaded_path && static_cast<size_t>(st.st_size) == journal_offset &&
+                current == generation;
+  }
+  //terminate a record torn by a crash so it is not joined with ours
+  if(last != '\n') journal.insert(0, 1, '\n');
+  if(st.st_size == 0 && current != 0) journal.insert(0, "GEN\t" + std::to_string(current) + "\n");
+
+  //a single O_APPEND write keeps records from concurrent runs whole
+  ssize_t written = write(fd, journal.data(), journal.length());
+  bool compact = fstat(fd, &st) == 0 && st.st_size >= JOURNAL_COMPACT_SIZE;
+  close(fd);
+  if(written != static_cast<ssize_t>(journal.length())) {
+    throw std::runtime_error("Unable to write journal " + journal_path);
+  }
+  PROFILE_COUNT(COUNT_BYTES_WRITTEN, written);
+  journal.clear();
+  //our own records need not be replayed by refresh
+  if(caught_up) {
+    journal_offset += static_cast<size_t>(written);
+    journal_source = snapshot_source(journal_path);
+  }
+
+  if(compact) {
+    //pick up records other writers appended since the load so the save
+    //file does not drop them
+    if(path == loaded_path) refresh();
+    save_events(path);
+    truncate(journal_path.c_str(), 0);
+    if(path == loaded_path) {
+      journal_offset = 0;
+      journal_source = snapshot_source(journal_path);
+    }
+  }
+}
+
+Reload Calendar::refresh() {
+  if(loaded_path.empty()) return Reload::NONE;
+  std::string journal_path = loaded_path + JOURNAL_SUFFIX;
+  SnapshotSource save_now = snapshot_source(loaded_path);
+  SnapshotSource journal_now = snapshot_source(journal_path);
+  if(save_now == save_source && journal_now == journal_source) return Reload::NONE;
+
+  bool localized = true;
+  if(!(save_now == save_source)) {
+    //events inserted before END:VCALENDAR with the bytes before unchanged
+    MappedFile file(loaded_path);
+    std::string_view buf = file.view();
+    size_t window = std::min<size_t>(save_append_at, REFRESH_TAIL_WINDOW);
+    localized = save_now.inode == save_source.inode && buf.length() > save_source.size &&
+                buf.length() >= save_append_at &&
+                fnv1a(buf.data() + save_append_at - window, window) == save_tail_hash;
+    if(localized) {
+      PROFILE_PHASE(PHASE_PARSE);
+      StringArena scratch;
+      std::vector<Event> appended;
+      parse_ics(buf.substr(save_append_at), appended, scratch);
+      ensure_lookup();
+      //the appended events are in the save file, they leave it as clean
+      bool was_dirty = dirty;
+      for(Event &e : appended) {
+        if(uid_index.count(e.get_uid())) e.set_uid(std::string_view());
+        add_event(e);
+      }
+      dirty = was_dirty;
+      note_save_file(buf, save_now);
+    }
+  }
+  if(localized && !(journal_now == journal_source)) {
+    //records appended after the ones already replayed
+    //a journal created since the load has all its records to replay
+    localized = (journal_now.inode == journal_source.inode || journal_source.inode == 0) &&
+                journal_now.size >= journal_offset;
+    if(localized) {
+      PROFILE_PHASE(PHASE_JOURNAL);
+      MappedFile file(journal_path);
+      replay_journal(file.view(), journal_offset, true);
+      journal_source = journal_now;
+    }
+  }
+  if(localized) return Reload::INCREMENTAL;
+
+  //the change could not be localized, start over keeping unsaved changes.
+  //nothing is replaced unless the files load.
+  Calendar reloaded = Calendar();
+  reloaded.range = range;
+  reloaded.journal = journal;
+  reloaded.load_events(loaded_path);
+  *this = std::move(reloaded);
+  return Reload::FULL;
+}
+
+//load the search file, or build the index from events and write the
+//search file for the next load, then bring the index up to date
+void Calendar::ensure_search() {
+  if(search_built) return;
+  PROFILE_PHASE(PHASE_SEARCH);
+  //position in the save file of the event at i
+  auto origin = [this](size_t i) {
+    if(!search_origin.empty()) return search_origin[i];
+    return i < search_base_count ? static_cast<uint32_t>(i) : SearchIndex::NO_POSITION;
+  };
+
+  std::string path = loaded_path + SEARCH_SUFFIX;
+  if(!loaded_path.empty() && search.load(path, search_base, search_base_count)) {
+    if(!search_origin.empty()) {
+      std::vector<uint32_t> moved(search_base_count, SearchIndex::NO_POSITION);
+      for(size_t i = 0; i < events.size(); ++i) {
+        if(origin(i) != SearchIndex::NO_POSITION) moved[origin(i)] = static_cast<uint32_t>(i);
+      }
+      search.remap(moved);
+    }
+    for(size_t i = 0; i < events.size(); ++i) {
+      if(origin(i) == SearchIndex::NO_POSITION) search.add(static_cast<uint32_t>(i), events[i]);
+    }
+  } else {
+    search.build(events);
+    //events removed since the load are removed by every later load too, so
+    //the events still here are all the save file needs indexed
+    if(!loaded_path.empty() && search_base.size > 0 && snapshot_source(loaded_path) == search_base) {
+      if(search_origin.empty() && events.size() == search_base_count) {
+        search.save(path, search_base, search_base_count);
+      } else {
+        std::vector<uint32_t> saved(events.size());
+        for(size_t i = 0; i < events.size(); ++i) saved[i] = origin(i);
+        SearchIndex base = search;
+        base.remap(saved);
+        base.save(path, search_base, search_base_count);
+      }
+    }
+  }
+  search_origin.clear();
+  search_origin.shrink_to_fit();
+  search_built = true;
+}
+
+std::vector<const Event *> Calendar::search_events(std::string_view query,
+                                                   const std::optional<TimeRange> &within) {
+  ensure_search();
+  std::vector<const Event *> found;
+  std::vector<Event> occurrences;
+  for(uint32_t pos : search.query(query)) {
+    const Event &e = events[pos];
+    if(within) {
+      occurrences.clear();
+      e.occurrences(*within, occurrences);
+      if(occurrences.empty()) continue;
+    }
+    found.push_back(&e);
+  }
+  std::sort(found.begin(), found.end(),
+            [](const Event *x, const Event *y) { return Event::starts_before(*x, *y); });
+  return found;
+}
+
+void Calendar::print_search(std::string_view query, const std::optional<TimeRange> &within,
+                            std::ostream &out) {
+  for(const Event *e : search_events(query, within)) out << agenda_line(*e) << '\n';
+  out.flush();
+}
+
+std::vector<const Event *> Calendar::find_events(std::string_view key) {
+  ensure_lookup();
+  std::vector<const Event *> found;
+  auto uid = uid_index.find(key);
+  if(uid != uid_index.end()) {
+    found.push_back(&events[uid->second]);
+    return found;
+  }
+  if(key.length() > 4) return found;
+  auto range = tag_index.equal_range(Event::tag_key(key));
+  for(auto it = range.first; it != range.second; ++it) found.push_back(&events[it->second]);
+  std::sort(found.begin(), found.end(),
+            [](const Event *x, const Event *y) { return Event::starts_before(*x, *y); });
+  return found;
 }
 
 //TODO: this is a temporary solution. currently using format
 //to make future integration with icalendar files easier.
 //proper error handling is also needed still.
 void Calendar::save_events(std::string path) {
-  std::ofstream ofs;
-  ofs.open(path, std::ofstream::out);
+  //the save file already holds every loaded event
+  if(path == loaded_path && !dirty) return;
+  PROFILE_PHASE(PHASE_SAVE);
 
-  ofs << "BEGIN:VCALENDAR" << "\r\n";
+  //saving over a journal folds it in, records written to it before now
+  //belong to the old generation
+  uint64_t next;
+  {
+    MappedFile old(path);
+    next = save_generation(old.view());
+  }
+  if(snapshot_source(path + JOURNAL_SUFFIX).size > 0) ++next;
+
+  std::string out = "BEGIN:VCALENDAR\r\n";
+  if(next != 0) out.append(GENERATION_PROPERTY).append(std::to_string(next)).append("\r\n");
 
-  for(size_t i = 0; i < events.size(); i++) {
-    ofs << "BEGIN:VEVENT" << "\r\n"
-        << "SUMMARY:" << events[i].get_title() << "\r\n"
-        << "DESCRIPTION:" << events[i].get_tag() << "\r\n"
-        << "DTSTART:" << events[i].get_begin().to_tz_tstamp() << "\r\n"
-        << "DTEND:" << events[i].get_end().to_tz_tstamp() << "\r\n"
-        << "END:VEVENT" << "\r\n";
+  //events are written in start order, the order a load produces
+  const EventIndex &sorted = get_index();
+  out.reserve(sorted.size() * 192);
+  for(size_t i = 0; i < sorted.size(); i++) {
+    const Event &e = sorted[i];
+    out.append("BEGIN:VEVENT\r\n")
+       .append("UID:").append(e.get_uid()).append("\r\n")
+       .append("SUMMARY:").append(e.get_title()).append("\r\n")
+       .append("DESCRIPTION:").append(e.get_tag()).append("\r\n")
+       .append(format_ics_time("DTSTART", e.get_begin(), e.get_begin_minute())).append("\r\n")
+       .append(format_ics_time("DTEND", e.get_end(), e.get_end_minute())).append("\r\n");
+    if(e.recurs()) out.append("RRULE:").append(e.get_rule().to_string()).append("\r\n");
+    out.append("END:VEVENT\r\n");
   }
+  out.append("END:VCALENDAR\r\n");
+
+  replace_file(path, out);
+  PROFILE_COUNT(COUNT_BYTES_WRITTEN, out.length());
 
-  ofs << "END:VCALENDAR" << "\r\n";
+  //refresh the snapshot so the next load does not reparse the ics file
+  std::vector<Event> sorted_events;
+  sorted_events.reserve(sorted.size());
+  for(size_t i = 0; i < sorted.size(); i++) sorted_events.push_back(sorted[i]);
+  save_snapshot(path + SNAPSHOT_SUFFIX, snapshot_source(path), sorted_events);
 
-  ofs.close();
+  //the search file follows the order the new save file loads in
+  if(search_built || path == loaded_path) {
+    std::vector<uint32_t> rank(events.size());
+    for(size_t r = 0; r < sorted.size(); ++r) {
+      rank[static_cast<size_t>(&sorted[r] - events.data())] = static_cast<uint32_t>(r);
+    }
+    if(search_built) {
+      SearchIndex saved = search;
+      saved.remap(rank);
+      saved.save(path + SEARCH_SUFFIX, snapshot_source(path), sorted.size());
+    }
+    if(path == loaded_path) {
+      search_base = snapshot_source(path);
+      search_base_count = sorted.size();
+      if(!search_built) search_origin = std::move(rank);
+    }
+  }
+
+  //refresh must not mistake our own rewrite for an outside change
+  if(path == loaded_path) {
+    MappedFile file(path);
+    note_save_file(file.view(), snapshot_source(path));
+    dirty = false;
+  }
+}
+
+const std::vector<Event> &Calendar::get_events() const {
+  return events;
+}
+
+void Calendar::set_parse_threads(unsigned threads) {
+  parse_threads = threads;
+}
+
+const EventIndex &Calendar::get_index() {
+  if(index_dirty) {
+    PROFILE_PHASE(PHASE_INDEX);
+    index.build(&events);
+    index_dirty = false;
+  } else if(index.size() < events.size()) {
+    PROFILE_PHASE(PHASE_INDEX);
+    index.extend();
+  }
+  return index;
 }
 
 void Calendar::set_range(int by, unsigned bm, unsigned bd, int ey, unsigned em, unsigned ed) {
@@ -84,18 +577,45 @@ void Calendar::set_range(int by, unsigned bm, unsigned bd, int ey, unsigned em,
   range = CalendarRange(begin, end);
 }
 
-void Calendar::print() {
-  range.set_events(&events);
+void Calendar::print(int fd) {
+  range.set_events(get_index());
 
   //print out calendar with events
-  std::cout << range.print_cal();
+  std::cout.flush();
+  range.print_cal(fd);
+}
+
+void Calendar::print_day(int fd) {
+  range.set_events(get_index());
+  std::cout.flush();
+  range.print_day(fd);
+}
+
+void Calendar::print(std::ostream &out) {
+  range.set_events(get_index());
+  out << range.print_cal();
+}
+
+void Calendar::print_day(std::ostream &out) {
+  range.set_events(get_index());
+  out << range.print_day();
 }
 
 void Calendar::new_event() {
   std::string title;
   std::string tag;
+  Date b_dt;
+  Date e_dt;
+  int b_min, e_min;
+  prompt_event(title, tag, b_dt, e_dt, b_min, e_min);
+  add_new_event(title, tag, b_dt, e_dt, b_min, e_min);
+}
+
+void Calendar::prompt_event(std::string &title, std::string &tag, Date &b_dt, Date &e_dt,
+                            int &b_min, int &e_min) {
   std::string begin;
   std::string end;
+  std::string times;
 
   //read in event details from cin
   std::cout << "Enter event title: ";
@@ -106,48 +626,160 @@ void Calendar::new_event() {
   std::cin >> begin;
   std::cout << "Enter event end as MM/DD/YYYY: ";
   std::cin >> end;
+  std::cout << "Enter start and end time as HH:MM HH:MM, or nothing for all day: ";
+  std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  std::getline(std::cin, times);
 
-  size_t del_idx;
-  unsigned begin_m;
-  unsigned begin_d;
-  int begin_y;
-  unsigned end_m;
-  unsigned end_d;
-  int end_y;
-
-  //TODO: make a helper function and check for exceptions
-  //parse input data
-  del_idx = begin.find('/');
-  begin_m = static_cast<unsigned>(std::stoi(begin.substr(0, del_idx)));
-  begin.erase(0, del_idx + 1);
-  del_idx = begin.find('/');
-  begin_d = static_cast<unsigned>(std::stoi(begin.substr(0, del_idx)));
-  begin.erase(0, del_idx + 1);
-  begin_y = std::stoi(begin);
-
-  del_idx = end.find('/');
-  end_m = static_cast<unsigned>(std::stoi(end.substr(0, del_idx)));
-  end.erase(0, del_idx + 1);
-  del_idx = end.find('/');
-  end_d = static_cast<unsigned>(std::stoi(end.substr(0, del_idx)));
-  end.erase(0, del_idx + 1);
-  end_y = std::stoi(end);
-
-  Date b_dt = Date(begin_y, begin_m, begin_d);
-  Date e_dt = Date(end_y, end_m, end_d);
-  events.push_back(Event(title, tag, b_dt, e_dt));
-}
-
-void Calendar::list_events() {
-  for(size_t i = 0; i < events.size(); i++) {
-    std::cout << std::setw(4) << events[i].get_tag()
-              << ": " << events[i].get_begin()
-              << " to " << std::setw(11) << events[i].get_end() 
-              << "  " << events[i].get_title() << std::endl;
-  }
-}
-
-void Calendar::remove_event(std::optional<char *> tag_arg) {
+  if(!parse_us_date(begin, b_dt)) {
+    throw std::invalid_argument("Invalid start date " + begin + ", expected MM/DD/YYYY");
+  }
+  if(!parse_us_date(end, e_dt)) {
+    throw std::invalid_argument("Invalid end date " + end + ", expected MM/DD/YYYY");
+  }
+
+  b_min = e_min = Event::ALL_DAY;
+  std::istringstream clocks(times);
+  std::string b_clock, e_clock;
+  if(clocks >> b_clock >> e_clock) {
+    if(!parse_clock(b_clock, b_min) || !parse_clock(e_clock, e_min)) {
+      throw std::invalid_argument("Invalid time, expected HH:MM");
+    }
+  }
+  std::string error = check_span(b_dt, e_dt, b_min, e_min);
+  if(!error.empty()) throw std::invalid_argument("Event " + error);
+}
+
+void Calendar::add_new_event(std::string_view title, std::string_view tag, Date &begin, Date &end,
+                             int begin_minute, int end_minute, std::string_view uid) {
+  Event added(title, tag, begin, end, uid);
+  added.set_times(begin_minute, end_minute);
+  add_event(added);
+
+  Event &e = events.back();
+  journal.append("ADD\t").append(format_tstamp(e.get_begin(), e.get_begin_minute()))
+         .append("\t").append(format_tstamp(e.get_end(), e.get_end_minute()))
+         .append("\t").append(e.get_tag())
+         .append("\t").append(e.get_uid())
+         .append("\t").append(e.get_title()).append("\n");
+}
+
+size_t Calendar::apply_batch(const std::vector<BatchRecord> &records, std::vector<BatchError> &errors) {
+  size_t adds = 0;
+  for(const BatchRecord &r : records) adds += r.remove.empty();
+  events.reserve(events.size() + adds);
+  size_t applied = 0;
+  for(const BatchRecord &r : records) applied += apply_record(r, errors);
+  return applied;
+}
+
+bool Calendar::apply_record(const BatchRecord &r, std::vector<BatchError> &errors) {
+  if(r.remove.empty()) {
+    ensure_lookup();
+    if(!r.uid.empty() && uid_index.count(r.uid)) {
+      errors.push_back(BatchError{r.line, "UID " + r.uid + " is already in the calendar"});
+      return false;
+    }
+    Date begin = r.begin;
+    Date end = r.end;
+    add_new_event(r.title, r.tag, begin, end, r.begin_minute, r.end_minute, r.uid);
+    return true;
+  }
+  std::vector<const Event *> matched = find_events(r.remove);
+  if(matched.size() != 1) {
+    errors.push_back(BatchError{r.line, matched.empty() ? r.remove + " not found" :
+                                r.remove + " matches " + std::to_string(matched.size()) +
+                                " events, remove one by UID"});
+    return false;
+  }
+  std::string uid(matched[0]->get_uid());
+  erase_uid(uid);
+  journal += "DEL\t" + uid + "\n";
+  return true;
+}
+
+void Calendar::list_events(std::ostream &out) {
+  const EventIndex &sorted = get_index();
+  for(size_t i = 0; i < sorted.size(); i++) {
+    out << std::setw(4) << sorted[i].get_tag()
+              << ": " << sorted[i].get_begin()
+              << " to " << std::setw(11) << sorted[i].get_end() 
+              << "  " << sorted[i].get_title();
+    if(sorted[i].is_timed()) {
+      out << "  " << std::setfill('0')
+          << std::setw(2) << sorted[i].get_begin_minute() / 60 << ":"
+          << std::setw(2) << sorted[i].get_begin_minute() % 60 << "-"
+          << std::setw(2) << sorted[i].get_end_minute() / 60 << ":"
+          << std::setw(2) << sorted[i].get_end_minute() % 60 << std::setfill(' ');
+    }
+    if(sorted[i].recurs()) out << "  (" << sorted[i].get_rule().to_string() << ")";
+    out << std::endl;
+  }
+}
+
+void Calendar::print_agenda(const Date &from, size_t count, unsigned days, std::ostream &out) {
+  long int first = from.serial_time();
+  long int last = (days == 0) ? LONG_MAX : first + days - 1;
+  std::vector<Event> upcoming;
+  get_index().upcoming(first, last, count, upcoming);
+  for(const Event &e : upcoming) out << agenda_line(e) << '\n';
+  out.flush();
+}
+
+void Calendar::print_free(unsigned min_days, std::ostream &out) {
+  range.set_events(get_index());
+  write_spans(free_spans(range, range.get_events(), min_days), out);
+}
+
+void Calendar::print_stats(const std::vector<std::string> &tags, std::ostream &out) {
+  range.track_tags(tags);
+  range.set_events(get_index());
+  write_stats(range, tags, out);
+  range.track_tags({});
+}
+
+size_t Calendar::print_conflicts(const Event &e, std::ostream &out) {
+  Date begin = e.get_begin();
+  Date end = e.get_end();
+  CalendarRange days(begin, end);
+  days.set_events(get_index());
+  std::vector<const Event *> conflicts = conflicting_events(e, days.get_events());
+  if(!conflicts.empty()) out << "Overlaps " << conflicts.size() << " event(s):\n";
+  for(const Event *c : conflicts) out << "  " << agenda_line(*c) << '\n';
+  out.flush();
+  return conflicts.size();
+}
+
+//"MON 2024-03-04 09:00-10:00 STAN Title", with "all day" for the times
+//and the last day after the title if the event spans several
+std::string Calendar::agenda_line(const Event &e) {
+  const Date &b = e.get_begin();
+  char line[64];
+  int len = snprintf(line, sizeof(line), "%s %04d-%02u-%02u ", WEEKDAY_ABREV[b.weekday_index()].c_str(),
+                     b.year(), b.month(), b.day());
+  if(e.is_timed()) {
+    len += snprintf(line + len, sizeof(line) - static_cast<size_t>(len), "%02d:%02d-%02d:%02d ",
+                    e.get_begin_minute() / 60, e.get_begin_minute() % 60,
+                    e.get_end_minute() / 60, e.get_end_minute() % 60);
+  } else {
+    len += snprintf(line + len, sizeof(line) - static_cast<size_t>(len), "all day     ");
+  }
+  len += snprintf(line + len, sizeof(line) - static_cast<size_t>(len), "%-4.*s ",
+                  static_cast<int>(e.get_tag().length()), e.get_tag().data());
+  std::string agenda(line, static_cast<size_t>(len));
+  agenda.append(e.get_title());
+  if(e.get_end() != b) {
+    char until[24];
+    len = snprintf(until, sizeof(until), " (to %04d-%02u-%02u)", e.get_end().year(),
+                   e.get_end().month(), e.get_end().day());
+    agenda.append(until, static_cast<size_t>(len));
+  }
+  return agenda;
+}
+
+//removes the event with uid or tag tag_arg, prompting for it if not given.
+//a tag shared by several events is ambiguous, the matching events are
+//listed instead so one can be removed by uid.
+void Calendar::remove_event(std::optional<char *> tag_arg, std::ostream &out) {
   std::string tag;
 
   if(tag_arg.has_value()) {
@@ -156,15 +788,22 @@ void Calendar::remove_event(std::optional<char *> tag_arg) {
     std::cout << "Enter Event Tag: ";
     std::cin >> tag;
   }
-  Date d = Date();
 
-  Event e = Event(tag, tag, d, d);
-  
-  std::sort(events.begin(), events.end(), Event::tag_alpha);
-  auto lbound = std::lower_bound(events.begin(), events.end(), e, Event::tag_alpha);
-  if (lbound->get_tag().compare(tag) == 0) {
-    events.erase(lbound);
-  } else {
-    std::cout << tag << "not found." << std::endl;
+  std::vector<const Event *> matched = find_events(tag);
+  if(matched.empty()) {
+    out << tag << " not found." << std::endl;
+    return;
+  } else if(matched.size() > 1) {
+    out << tag << " matches " << matched.size() << " events, remove one by UID:" << std::endl;
+    for(size_t i = 0; i < matched.size(); ++i) {
+      const Event &e = *matched[i];
+      out << "  " << e.get_uid() << "  " << e.get_begin()
+                << " to " << e.get_end() << "  " << e.get_title() << std::endl;
+    }
+    return;
   }
-}
\ No newline at end of file
+
+  std::string uid(matched[0]->get_uid());
+  erase_uid(uid);
+  journal += "DEL\t" + uid + "\n";
+}
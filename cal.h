@@ -1,26 +1,156 @@
 #ifndef CAL_H
 #define CAL_H
 
+#include <iostream>
 #include <string>
+#include <string_view>
 #include <optional>
+#include <unordered_map>
 #include <vector>
+#include "arena.h"
+#include "batch.h"
 #include "datetime.h"
+#include "index.h"
+#include "search.h"
+#include "snapshot.h"
+
+//what Calendar::refresh had to do to catch up with the files on disk
+enum class Reload { NONE, INCREMENTAL, FULL };
 
 class Calendar {
 
 private:
   CalendarRange range;
+  //storage for event titles and uids
+  StringArena strings;
   std::vector<Event> events;
+  //interval index over events, rebuilt on use after events change
+  EventIndex index;
+  bool index_dirty;
+  //records of changes not yet appended to the journal
+  std::string journal;
+  //events differ from the save file at loaded_path, so save_events has
+  //something to write
+  bool dirty;
+
+  //positions of events by uid and by tag, kept in sync with events once
+  //built. building is deferred so read-only commands never pay for it.
+  std::unordered_map<std::string_view, size_t> uid_index;
+  std::unordered_multimap<uint32_t, size_t> tag_index;
+  bool lookup_dirty;
+
+  //word index over titles and tags, built on the first search. the search
+  //file next to the save file indexes the events as the save file loads,
+  //changes since are applied on top as the journal is to a snapshot.
+  SearchIndex search;
+  bool search_built;
+  //the save file the search file must be built from and its number of
+  //events. once events are removed without the index built, the position
+  //in the save file of each event, SearchIndex::NO_POSITION if added since.
+  SnapshotSource search_base;
+  size_t search_base_count;
+  std::vector<uint32_t> search_origin;
+
+  //the save file and journal as last read, so refresh can tell an append
+  //from a rewrite. save_append_at is where events can be inserted, the
+  //start of END:VCALENDAR, and save_tail_hash covers the bytes before it.
+  std::string loaded_path;
+  SnapshotSource save_source;
+  size_t save_append_at;
+  uint64_t save_tail_hash;
+  SnapshotSource journal_source;
+  size_t journal_offset;
+  //generation of the save file as last read. the journal starts with the
+  //generation it applies to, a journal of an older generation was already
+  //folded into the save file and is ignored.
+  uint64_t generation;
+  //threads load_events parses with, shared by every calendar
+  static unsigned parse_threads;
+
+  void replay_journal(std::string_view buf, size_t &offset, bool skip_known = false);
+  void note_save_file(std::string_view buf, const SnapshotSource &source);
+  void assign_uids();
+  void ensure_lookup();
+  void ensure_search();
+  void add_event(Event e);
+  void erase_at(size_t pos);
+  bool erase_uid(std::string_view uid);
+  std::string_view make_uid(const Event &e);
 
 public:
   Calendar();
   void load_events(std::string path);
+  //replace the save file at path with the loaded events through a
+  //temporary file and rename. does nothing if path is the loaded file and
+  //no event changed. throws std::runtime_error if the file cannot be written.
   void save_events(std::string path);
+  //append changes to the journal at path, holding the advisory lock of
+  //path so concurrent writers are serialized. readers take no lock.
+  void commit_events(std::string path);
+  //whether there are changes commit_events has yet to write
+  bool has_changes() const { return !journal.empty(); }
+  //catch up with changes other processes made to the loaded save file and
+  //journal, parsing only appended events and journal records when the
+  //rest of the file is unchanged. throws if they cannot be read, keeping
+  //the calendar as it was apart from journal records before a bad one.
+  Reload refresh();
   void set_range(int by, unsigned bm, unsigned bd, int ey, unsigned em, unsigned ed);
-  void print();
+  //write the calendar over the range to fd
+  void print(int fd = 1);
+  //write the day view of the first day of the range to fd
+  void print_day(int fd = 1);
+  //render the calendar, or the day view, over the range into out in full
+  //before anything is written
+  void print(std::ostream &out);
+  void print_day(std::ostream &out);
   void new_event();
-  void remove_event(std::optional<char *> tag_arg = std::nullopt);
-  void list_events();
+  //add an event and record it in the journal. minutes are times after
+  //midnight, Event::ALL_DAY for an all day event. an empty uid is derived
+  //from the event.
+  void add_new_event(std::string_view title, std::string_view tag, Date &begin, Date &end,
+                     int begin_minute = Event::ALL_DAY, int end_minute = Event::ALL_DAY,
+                     std::string_view uid = std::string_view());
+  void remove_event(std::optional<char *> tag_arg = std::nullopt, std::ostream &out = std::cout);
+  void list_events(std::ostream &out = std::cout);
+  //apply records in order, recording them in the journal as
+  //add_new_event and remove_event do so one commit_events writes them
+  //all. a removal matching no event or several, or an add with a uid in
+  //use, is appended to errors and skipped. returns the number applied.
+  size_t apply_batch(const std::vector<BatchRecord> &records, std::vector<BatchError> &errors);
+  //apply_batch for one record, returns false if it was skipped
+  bool apply_record(const BatchRecord &record, std::vector<BatchError> &errors);
+  //write the first count events ending on or after from, and beginning
+  //within days days of it unless days is 0, one line each
+  void print_agenda(const Date &from, size_t count, unsigned days, std::ostream &out = std::cout);
+  //write the runs of at least min_days days of the range without events
+  void print_free(unsigned min_days, std::ostream &out = std::cout);
+  //write the busy days, peak and days with each of tags per month of the
+  //range, see write_stats
+  void print_stats(const std::vector<std::string> &tags, std::ostream &out = std::cout);
+  //write the agenda line of each event overlapping e under a heading,
+  //nothing if there are none. returns their number.
+  size_t print_conflicts(const Event &e, std::ostream &out = std::cout);
+  //return the events whose title and tag hold every word of query, in
+  //start order, only those with an occurrence in within if given
+  std::vector<const Event *> search_events(std::string_view query,
+                                           const std::optional<TimeRange> &within = std::nullopt);
+  //write the agenda line of each event search_events finds
+  void print_search(std::string_view query, const std::optional<TimeRange> &within = std::nullopt,
+                    std::ostream &out = std::cout);
+  //return the agenda line for e
+  static std::string agenda_line(const Event &e);
+  //prompt on cin for the fields of a new event. begin_minute and
+  //end_minute are Event::ALL_DAY unless times are entered.
+  static void prompt_event(std::string &title, std::string &tag, Date &begin, Date &end,
+                           int &begin_minute, int &end_minute);
+  //return the event with uid key, else the events tagged key, in start order
+  std::vector<const Event *> find_events(std::string_view key);
+  //return all loaded events
+  const std::vector<Event> &get_events() const;
+  //return the interval index over the loaded events, brought up to date
+  const EventIndex &get_index();
+  //set the threads load_events parses save files with, 0 for one per core
+  static void set_parse_threads(unsigned threads);
 };
 
 #endif
\ No newline at end of file
@@ -1,16 +1,21 @@
 #include <string>
 #include "color.h"
 
-std::string fg_colors[] = {
+const std::string_view fg_colors[] = {
   BLUE, YELLOW, MAGENTA, GREEN, CYAN, RED,
 };
 
-std::string bg_colors[] = {
+const std::string_view bg_colors[] = {
   BGBLUE, BGYELLOW, BGMAGENTA, BGGREEN, BGCYAN, BGRED,
 };
 
-std::string color(std::string s, std::string c) { 
-  return c + s + RESET;
+std::string color(std::string_view s, std::string_view c) {
+  std::string result;
+  result.reserve(c.length() + s.length() + sizeof(RESET) - 1);
+  result.append(c).append(s).append(RESET);
+  return result;
 }
 
-
+void append_color(std::string &out, std::string_view s, std::string_view c) {
+  out.append(c).append(s).append(RESET);
+}
@@ -2,6 +2,7 @@
 #define COLOR_H
 
 #include <string>
+#include <string_view>
 
 #define RESET "\x1b[0m"
 #define BLACK "\x1b[30m"
@@ -25,10 +26,14 @@
 
 #define NUM_COLORS 6
 
-extern std::string fg_colors[NUM_COLORS];
+extern const std::string_view fg_colors[NUM_COLORS];
 
-extern std::string bg_colors[NUM_COLORS];
+extern const std::string_view bg_colors[NUM_COLORS];
 
-std::string color(std::string s, std::string c);
+//return s wrapped in escape sequence c and RESET
+std::string color(std::string_view s, std::string_view c);
+
+//append s wrapped in escape sequence c and RESET to out
+void append_color(std::string &out, std::string_view s, std::string_view c);
 
 #endif
@@ -1,7 +1,25 @@
 #ifndef PLANNER_CONFIG_H
 #define PLANNER_CONFIG_H
 
+#ifndef DEFAULT_SAVE_PATH
 #define DEFAULT_SAVE_PATH "/Users/ct/projects/planner/tests/save.dat"
+#endif
 #define DEFAULT_DAY_WIDTH 10 //minimum=6
+#define JOURNAL_SUFFIX ".journal"
+#define JOURNAL_COMPACT_SIZE 65536 //bytes
+#define REFRESH_TAIL_WINDOW 4096 //bytes before an append point that must be unchanged
+#define SNAPSHOT_SUFFIX ".snap" //cache any load rebuilds, even for read-only commands
+#define SEARCH_SUFFIX ".search" //cache --search rebuilds, even though it only reads
+#define LOCK_SUFFIX ".lock" //advisory lock serializing writers of a save file
+#define RENDER_FLUSH_SIZE 65536 //bytes buffered before print_cal writes
+#define DAEMON_SOCKET_SUFFIX ".sock"
+#define DAEMON_CLIENT_TIMEOUT 1000 //ms a daemon client may stall a read or write
+#define INDEX_SHORT_EVENT_DAYS 31 //longest event EventIndex finds by its begin date
+#define PARSE_THREADS 0 //threads load_events parses with, 0 for one per core
+#define PARSE_CHUNK_SIZE (1 << 20) //bytes, smallest chunk worth a thread
+#define ZONEINFO_DIR "/usr/share/zoneinfo" //overridden by $TZDIR
+#define ZONE_RULE_LAST_YEAR 2100 //last year TZ footer rules are expanded for
+#define DAY_VIEW_FIRST_HOUR 7 //hours always shown by the day view
+#define DAY_VIEW_LAST_HOUR 19
 
 #endif
@@ -0,0 +1,264 @@
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cal.h"
+#include "config.h"
+#include "daemon.h"
+#include "freebusy.h"
+#include "ics.h"
+#include "watch.h"
+
+//first byte of every response
+static const char RESPONSE_OK = '+';
+static const char RESPONSE_ERROR = '-';
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int) {
+  stop_requested = 1;
+}
+
+//fill addr for path, throws if path does not fit
+static void socket_address(const std::string &path, sockaddr_un &addr) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if(path.length() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error("Socket path too long " + path);
+  }
+  memcpy(addr.sun_path, path.c_str(), path.length() + 1);
+}
+
+//return a socket connected to the daemon at path, or -1
+static int connect_daemon(const std::string &path) {
+  sockaddr_un addr;
+  socket_address(path, addr);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0) return -1;
+  if(connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static bool write_all(int fd, std::string_view data) {
+  while(!data.empty()) {
+    ssize_t n = write(fd, data.data(), data.length());
+    if(n < 0) {
+      if(errno == EINTR) continue;
+      return false;
+    }
+    data.remove_prefix(static_cast<size_t>(n));
+  }
+  return true;
+}
+
+//split line on tabs into at most max fields, the last keeps any tabs
+static std::vector<std::string_view> split_fields(std::string_view line, size_t max) {
+  std::vector<std::string_view> fields;
+  while(fields.size() + 1 < max) {
+    size_t tab = line.find('\t');
+    if(tab == std::string_view::npos) break;
+    fields.push_back(line.substr(0, tab));
+    line.remove_prefix(tab + 1);
+  }
+  fields.push_back(line);
+  return fields;
+}
+
+//handle one request from client, changes are committed to the journal of
+//save_path before the response is sent. throws if the request fails.
+static void handle_request(Calendar &cal, const std::string &save_path, int client,
+                           std::string_view request) {
+  std::vector<std::string_view> fields = split_fields(request, 5);
+  std::ostringstream out;
+  bool changed = false;
+
+  if(fields[0] == "PRINT" && fields.size() == 3) {
+    Date begin = parse_tstamp(fields[1]);
+    Date end = parse_tstamp(fields[2]);
+    cal.set_range(begin.year(), begin.month(), begin.day(), end.year(), end.month(), end.day());
+    cal.print(out);
+  } else if(fields[0] == "DAY" && fields.size() == 2) {
+    Date day = parse_tstamp(fields[1]);
+    cal.set_range(day.year(), day.month(), day.day(), day.year(), day.month(), day.day());
+    cal.print_day(out);
+  } else if(fields[0] == "AGENDA" && fields.size() == 4) {
+    Date from = parse_tstamp(fields[1]);
+    cal.print_agenda(from, std::stoull(std::string(fields[2])),
+                     static_cast<unsigned>(std::stoul(std::string(fields[3]))), out);
+  } else if(fields[0] == "FREE" && fields.size() == 4) {
+    Date begin = parse_tstamp(fields[1]);
+    Date end = parse_tstamp(fields[2]);
+    cal.set_range(begin.year(), begin.month(), begin.day(), end.year(), end.month(), end.day());
+    cal.print_free(static_cast<unsigned>(std::stoul(std::string(fields[3]))), out);
+  } else if(fields[0] == "CONFLICTS" && fields.size() == 3) {
+    IcsTime begin, end;
+    parse_ics_span(fields[1], fields[2], begin, end);
+    Event e("", "", begin.day, end.day);
+    e.set_times(begin.minute, end.minute);
+    cal.print_conflicts(e, out);
+  } else if(fields[0] == "STATS" && fields.size() == 4) {
+    Date begin = parse_tstamp(fields[1]);
+    Date end = parse_tstamp(fields[2]);
+    cal.set_range(begin.year(), begin.month(), begin.day(), end.year(), end.month(), end.day());
+    cal.print_stats(split_tags(fields[3]), out);
+  } else if(fields[0] == "SEARCH" && fields.size() == 4) {
+    std::optional<TimeRange> within;
+    if(!fields[1].empty()) within = TimeRange(parse_tstamp(fields[1]), parse_tstamp(fields[2]));
+    cal.print_search(fields[3], within, out);
+  } else if(fields[0] == "LIST" && fields.size() == 1) {
+    cal.list_events(out);
+  } else if(fields[0] == "ADD" && fields.size() == 5) {
+    IcsTime begin, end;
+    parse_ics_span(fields[1], fields[2], begin, end);
+    cal.add_new_event(fields[4], fields[3], begin.day, end.day, begin.minute, end.minute);
+    changed = true;
+  } else if(fields[0] == "REMOVE" && fields.size() == 2) {
+    std::string tag(fields[1]);
+    size_t before = cal.get_events().size();
+    cal.remove_event(tag.data(), out);
+    changed = cal.get_events().size() != before;
+  } else {
+    throw std::invalid_argument("unknown request");
+  }
+
+  //the client is told of a change only once it is written. one that cannot
+  //be is dropped by starting over from the files.
+  if(changed) {
+    try {
+      cal.commit_events(save_path);
+    } catch(std::exception &) {
+      Calendar reloaded = Calendar();
+      reloaded.load_events(save_path);
+      cal = std::move(reloaded);
+      throw;
+    }
+  }
+  write_all(client, RESPONSE_OK + out.str());
+}
+
+void run_daemon(const std::string &save_path, const std::string &socket_path) {
+  sockaddr_un addr;
+  socket_address(socket_path, addr);
+
+  //a socket nobody accepts on was left behind by a daemon that died
+  int existing = connect_daemon(socket_path);
+  if(existing >= 0) {
+    close(existing);
+    throw std::runtime_error("A daemon is already serving " + socket_path);
+  }
+  //a calendar that cannot be loaded is reported before the socket exists
+  Calendar cal = Calendar();
+  cal.load_events(save_path);
+  unlink(socket_path.c_str());
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(listener < 0 || bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+     listen(listener, 64) != 0) {
+    if(listener >= 0) close(listener);
+    throw std::runtime_error("Unable to listen on " + socket_path);
+  }
+
+  //no SA_RESTART so a signal interrupts accept
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = request_stop;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+  //a client going away mid response must not kill the daemon
+  signal(SIGPIPE, SIG_IGN);
+
+  FileWatcher watcher({save_path, save_path + JOURNAL_SUFFIX});
+
+  while(!stop_requested) {
+    pollfd fds[2] = {{listener, POLLIN, 0}, {watcher.get_fd(), POLLIN, 0}};
+    if(poll(fds, watcher.get_fd() >= 0 ? 2 : 1, -1) < 0) continue;
+    //pick up edits by other processes as they happen. files that cannot
+    //be read leave the last good calendar, the next request reports why.
+    if(fds[1].revents & POLLIN && watcher.changed()) {
+      try {
+        cal.refresh();
+      } catch(std::exception &) {
+      }
+    }
+    if(!(fds[0].revents & POLLIN)) continue;
+
+    int client = accept(listener, nullptr, nullptr);
+    if(client < 0) continue;
+
+    //a client that stalls must not keep the others waiting
+    timeval timeout = {DAEMON_CLIENT_TIMEOUT / 1000, (DAEMON_CLIENT_TIMEOUT % 1000) * 1000};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    //requests are a single line, read up to its newline and drop clients
+    //that hang up or time out before sending one
+    std::string request;
+    char buf[4096];
+    ssize_t n;
+    size_t newline;
+    while((newline = request.find('\n')) == std::string::npos &&
+          (n = read(client, buf, sizeof(buf))) > 0) {
+      request.append(buf, static_cast<size_t>(n));
+    }
+    if(newline == std::string::npos) {
+      close(client);
+      continue;
+    }
+    request.resize(newline);
+
+    try {
+      //without inotify, or with its events still in flight, check on use
+      cal.refresh();
+      handle_request(cal, save_path, client, request);
+    } catch(std::exception &ex) {
+      write_all(client, std::string(1, RESPONSE_ERROR).append(ex.what()));
+    }
+    close(client);
+  }
+
+  close(listener);
+  unlink(socket_path.c_str());
+}
+
+bool daemon_request(const std::string &socket_path, const std::string &request, int out_fd) {
+  int fd = connect_daemon(socket_path);
+  if(fd < 0) return false;
+
+  if(!write_all(fd, request + "\n")) {
+    close(fd);
+    return false;
+  }
+  shutdown(fd, SHUT_WR);
+
+  //a daemon that drops the request without answering is not running it
+  char status;
+  if(read(fd, &status, 1) != 1) {
+    close(fd);
+    return false;
+  }
+
+  char buf[65536];
+  ssize_t n;
+  std::string error;
+  while((n = read(fd, buf, sizeof(buf))) > 0) {
+    if(status == RESPONSE_OK) write_all(out_fd, std::string_view(buf, static_cast<size_t>(n)));
+    else error.append(buf, static_cast<size_t>(n));
+  }
+  close(fd);
+  if(status != RESPONSE_OK) throw std::runtime_error(error);
+  return true;
+}
@@ -0,0 +1,35 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <string>
+
+//requests are one tab separated line. the response is '+' and the raw
+//output the command would have written to stdout, or '-' and why the
+//request failed:
+//  PRINT <begin tstamp> <end tstamp>
+//  DAY <tstamp>
+//  LIST
+//  AGENDA <tstamp> <count> <days>
+//  FREE <begin tstamp> <end tstamp> <days>
+//  CONFLICTS <begin tstamp> <end tstamp>
+//  STATS <begin tstamp> <end tstamp> <comma separated tags>
+//  SEARCH <begin tstamp> <end tstamp> <query>, both tstamps empty for all
+//  ADD <begin tstamp> <end tstamp> <tag> <title>
+//  REMOVE <tag or uid>
+
+//serve requests for the calendar saved at save_path on a unix socket at
+//socket_path until SIGINT or SIGTERM. clients are served one at a time and
+//dropped if they stall longer than DAEMON_CLIENT_TIMEOUT. changes are
+//appended to the journal before the response is sent. changes other
+//processes make to the save file or journal are picked up through inotify
+//as they happen. throws std::runtime_error if the socket cannot be
+//created or another daemon is serving it.
+void run_daemon(const std::string &save_path, const std::string &socket_path);
+
+//send request to the daemon at socket_path and copy its response to
+//out_fd. returns false, writing nothing, if no daemon is running or it
+//drops the request. throws std::runtime_error with the daemon's message,
+//writing nothing, if the request failed.
+bool daemon_request(const std::string &socket_path, const std::string &request, int out_fd);
+
+#endif
@@ -1,92 +1,60 @@
 #include <algorithm>
+#include <climits>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <exception>
+#include <stdexcept>
+#include <unistd.h>
 #include <iostream>
 #include <iomanip>
+#include <queue>
 #include "datetime.h"
 #include "config.h"
 #include "color.h"
+#include "index.h"
+#include "profile.h"
+#include "slots.h"
 
 // === Date ===
-Date::Date() : ymd{std::chrono::year(1970), std::chrono::month(1), std::chrono::day(1)}, serial(0) {}
+Date::Date(std::chrono::sys_days &d) : serial(static_cast<int32_t>(d.time_since_epoch().count())) {}
 
-Date::Date(std::chrono::sys_days &d) : ymd{d} {
-  update_serial();
-}
-
-Date::Date(int y, unsigned m, unsigned d) 
-    : ymd{std::chrono::year{y}, std::chrono::month{m}, std::chrono::day{d}} {
-  if(!ymd.ok()) {
+Date::Date(int y, unsigned m, unsigned d) {
+  if(m < 1 || m > 12 || d < 1 || d > days_in_month(y, m)) {
     throw std::invalid_argument("Invalid Date");
   }
-  update_serial();
-}
-
-long int Date::serial_time() const { 
-  return serial; 
-}
-
-unsigned Date::day() const {
-  return static_cast<unsigned>(ymd.day());
-}
-
-unsigned Date::month() const {
-  return static_cast<unsigned>(ymd.month());
-}
-
-int Date::year() const {
-  return static_cast<int>(ymd.year());
+  serial = days_from_civil(y, m, d);
 }
 
 std::chrono::year_month_day Date::ymd_obj() const {
-  return ymd;
-}
-
-unsigned Date::weekday_index() const {
-  std::chrono::weekday wd{ std::chrono::sys_days{ymd} };
-  return wd.c_encoding();
+  CivilDate c = civil_from_days(serial);
+  return std::chrono::year_month_day{std::chrono::year{c.year}, std::chrono::month{c.month},
+                                     std::chrono::day{c.day}};
 }
 
 std::string Date::to_tz_tstamp() const {
-  std::string year = std::to_string(this->year());
-  year = std::string(4-year.length(),'0').append(year);
-  std::string month = std::to_string(this->month());
-  month = std::string(2-month.length(),'0').append(month);
-  std::string day = std::to_string(this->day());
-  day = std::string(2-day.length(),'0').append(day);
-  return year + month + day + "T000000Z";
+  CivilDate c = civil_from_days(serial);
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%04d%02u%02uT000000Z", c.year, c.month, c.day);
+  return buf;
 }
 
 
 void Date::change_day(int delta) {
-  auto result = std::chrono::sys_days{ymd};
-  if(delta < 0) {
-    result -= std::chrono::days(abs(delta));
-  } else {
-    result += std::chrono::days(delta);
-  }
-  ymd = result;
-  validate_ymd();
-  update_serial();
+  serial += delta;
 }
 
 void Date::change_month(int delta) {
-  if(delta < 0) {
-    ymd -= std::chrono::months(abs(delta));
-  } else {
-    ymd += std::chrono::months(delta);
-  }
-  validate_ymd();
-  update_serial();
+  CivilDate c = civil_from_days(serial);
+  int months = c.year * 12 + static_cast<int>(c.month) - 1 + delta;
+  int y = (months >= 0 ? months : months - 11) / 12;
+  set_civil(y, static_cast<unsigned>(months - y * 12 + 1), c.day);
 }
 
 void Date::change_year(int delta) {
-  if(delta < 0) {
-    ymd -= std::chrono::years(abs(delta));
-  } else {
-    ymd += std::chrono::years(delta);
-  }
-  validate_ymd();
-  update_serial();
+  CivilDate c = civil_from_days(serial);
+  set_civil(c.year + delta, c.month, c.day);
 }
 
 void Date::snap_to_wk_begin() {
@@ -98,34 +66,8 @@ void Date::snap_to_wk_end() {
   change_day(DAYS_IN_WEEK);
 }
 
-void Date::update_serial() {
-  serial = std::chrono::sys_days(ymd).time_since_epoch().count();
-}
-
-void Date::validate_ymd() {
-  if(!ymd.ok()) {
-    ymd += std::chrono::months{0};
-    ymd =  std::chrono::sys_days{ymd};
-  }
-}
-
-bool Date::operator==(const Date &rhs) const {
-  return this->serial_time() == rhs.serial_time();
-}
-
-Date& Date::operator++ () {
-  this->change_day(1);
-  return *this;
-}
-
-Date Date::operator++ (int) {
-  Date result(*this);
-  ++(*this);
-  return result;
-}
-
-std::strong_ordering Date::operator<=>(const Date &rhs) const {
-  return serial_time() <=> rhs.serial_time();
+void Date::set_civil(int y, unsigned m, unsigned d) {
+  serial = days_from_civil(y, m, d);
 }
 
 std::ostream & operator<< (std::ostream &out, const Date &d) {
@@ -157,18 +99,105 @@ const Date &TimeRange::get_end() const { return end; }
 bool TimeRange::contains(const Date &d) const { return (!(d < begin || d > end)); }
 
 // === Event ===
-Event::Event() : TimeRange(), title("TITLE"), tag("TAG") {}
+Event::Event()
+    : TimeRange(), title("TITLE"), uid(), tag{'T', 'A', 'G', '\0'},
+      begin_minute(ALL_DAY), end_minute(ALL_DAY) {}
+
+Event::Event(std::string_view title, std::string_view tag, std::chrono::sys_days &begin,
+             std::chrono::sys_days &end, std::string_view uid)
+    : TimeRange(begin, end), title(title), uid(uid), tag{},
+      begin_minute(ALL_DAY), end_minute(ALL_DAY) {
+  if(!tag.empty()) memcpy(this->tag, tag.data(), std::min(tag.length(), sizeof(this->tag)));
+}
+
+Event::Event(std::string_view title, std::string_view tag, Date &begin, Date &end,
+             std::string_view uid)
+    : TimeRange(begin, end), title(title), uid(uid), tag{},
+      begin_minute(ALL_DAY), end_minute(ALL_DAY) {
+  if(!tag.empty()) memcpy(this->tag, tag.data(), std::min(tag.length(), sizeof(this->tag)));
+}
+
+decltype(Event::tag_alpha) Event::tag_alpha;
+
+decltype(Event::starts_before) Event::starts_before;
+
+std::string_view Event::get_title() const { return title; }
+
+std::string_view Event::get_tag() const {
+  return std::string_view(tag, strnlen(tag, sizeof(tag)));
+}
 
-Event::Event(std::string title, std::string tag, std::chrono::sys_days &begin,
-             std::chrono::sys_days &end)
-    : TimeRange(begin, end), title(title), tag(tag.substr(0, 4)) {}
+std::string_view Event::get_uid() const { return uid; }
 
-Event::Event(std::string title, std::string tag, Date &begin, Date &end)
-    : TimeRange(begin, end), title(title), tag(tag.substr(0, 4)) {}
+uint32_t Event::tag_key() const {
+  uint32_t key;
+  memcpy(&key, tag, sizeof(key));
+  return key;
+}
+
+uint32_t Event::tag_key(std::string_view tag) {
+  char packed[4] = {};
+  if(!tag.empty()) memcpy(packed, tag.data(), std::min(tag.length(), sizeof(packed)));
+  uint32_t key;
+  memcpy(&key, packed, sizeof(key));
+  return key;
+}
+
+void Event::set_title(std::string_view title) { this->title = title; }
+
+void Event::set_uid(std::string_view uid) { this->uid = uid; }
+
+void Event::set_rule(const Recurrence &rule) { this->rule = rule; }
+
+const Recurrence &Event::get_rule() const { return rule; }
 
-std::string Event::get_title() { return title; }
+bool Event::is_timed() const { return begin_minute != ALL_DAY; }
+
+int Event::get_begin_minute() const { return begin_minute; }
+
+int Event::get_end_minute() const { return end_minute; }
+
+void Event::set_times(int begin_minute, int end_minute) {
+  if(begin_minute < ALL_DAY || begin_minute > MINUTES_PER_DAY ||
+     end_minute < ALL_DAY || end_minute > MINUTES_PER_DAY ||
+     (begin_minute == ALL_DAY) != (end_minute == ALL_DAY)) {
+    throw std::invalid_argument("Invalid event time");
+  }
+  this->begin_minute = static_cast<int16_t>(begin_minute);
+  this->end_minute = static_cast<int16_t>(end_minute);
+}
+
+bool Event::recurs() const { return rule.recurs(); }
+
+long int Event::series_end() const {
+  if(!rule.recurs()) return get_end().serial_time();
+  if(rule.last_start() == INT32_MAX) return LONG_MAX;
+  return rule.last_start() + (get_end().serial_time() - get_begin().serial_time());
+}
 
-std::string Event::get_tag() { return tag; }
+void Event::occurrences(const TimeRange &range, std::vector<Event> &out) const {
+  long int first = range.get_begin().serial_time();
+  long int last = range.get_end().serial_time();
+  if(!rule.recurs()) {
+    if(get_begin().serial_time() <= last && get_end().serial_time() >= first) out.push_back(*this);
+    return;
+  }
+  //an occurrence overlaps range if it starts no more than its length
+  //before range begins
+  int32_t length = static_cast<int32_t>(get_end().serial_time() - get_begin().serial_time());
+  //reused across calls, set_events expands every series in the range
+  static thread_local std::vector<int32_t> starts;
+  starts.clear();
+  rule.starts(static_cast<int32_t>(get_begin().serial_time()),
+              static_cast<int32_t>(first) - length, static_cast<int32_t>(last), starts);
+  for(int32_t s : starts) {
+    std::chrono::sys_days b{std::chrono::days{s}};
+    std::chrono::sys_days e{std::chrono::days{s + length}};
+    out.emplace_back(title, get_tag(), b, e, uid);
+    out.back().begin_minute = begin_minute;
+    out.back().end_minute = end_minute;
+  }
+}
 
 
 // === CalendarRange ===
@@ -177,24 +206,93 @@ CalendarRange::CalendarRange() : TimeRange(), max_concurrent_events(0) {}
 CalendarRange::CalendarRange(Date &begin, Date &end) 
   : TimeRange(begin, end), max_concurrent_events(0) {}
 
-std::string CalendarRange::gen_key() {
-  std::string key = "";
-  for (size_t i = 0; i < events_in_range.size(); i++) {
-    long int color_idx = i % NUM_COLORS;
-    key += color(events_in_range[i].get_tag(), bg_colors[color_idx]+BLACK);
-    key += ": ";
-    key += events_in_range[i].get_title() + '\n';
+//append minute of the day as HH:MM, or as HHMM without colon
+static void append_clock(std::string &out, int minute, bool colon) {
+  char clock[8];
+  int len = snprintf(clock, sizeof(clock), colon ? "%02d:%02d" : "%02d%02d", minute / 60, minute % 60);
+  out.append(clock, static_cast<size_t>(len));
+}
+
+void CalendarRange::gen_key(int fd, std::string &out) const {
+  auto append_key = [&](size_t i) {
+    size_t color_idx = i % NUM_COLORS;
+    const Event &e = *events_in_range[i];
+    out.append(bg_colors[color_idx]).append(BLACK);
+    out.append(e.get_tag()).append(RESET ": ");
+    if(e.is_timed()) {
+      append_clock(out, e.get_begin_minute(), true);
+      out += '-';
+      append_clock(out, e.get_end_minute(), true);
+      out += ' ';
+    }
+    out.append(e.get_title()) += '\n';
+    if(out.length() >= RENDER_FLUSH_SIZE) flush_cal(fd, out);
+  };
+
+  if(source_names.empty()) {
+    for(size_t i = 0; i < events_in_range.size(); i++) append_key(i);
+    return;
   }
-  return key;
+  for(size_t s = 0; s < source_names.size(); ++s) {
+    std::string_view band = bg_colors[s % NUM_COLORS];
+    out.append(band).append(BLACK " ").append(source_names[s]).append(" " RESET "\n");
+    for(size_t i = 0; i < events_in_range.size(); i++) {
+      if(event_sources[i] == s) append_key(i);
+    }
+  }
+}
+
+//write out to fd and clear it. with fd < 0 output is kept in out.
+void CalendarRange::flush_cal(int fd, std::string &out) {
+  if(fd < 0) return;
+  size_t written = 0;
+  while(written < out.length()) {
+    ssize_t n = write(fd, out.data() + written, out.length() - written);
+    if(n < 0) {
+      if(errno == EINTR) continue;
+      throw std::runtime_error("Failed writing calendar");
+    }
+    written += static_cast<size_t>(n);
+  }
+  PROFILE_COUNT(COUNT_BYTES_WRITTEN, written);
+  out.clear();
 }
 
-std::string CalendarRange::print_cal() {
+//append the cell an event begins in: its tag, after its start time with
+//show_time if it is timed and the cell is wide enough, and an end marker
+//if it ends in the cell
+static void append_begin_cell(std::string &out, const Event &e, std::string_view fg,
+                              std::string_view bg, bool show_time, bool ends) {
+  std::string_view tag = e.get_tag();
+  size_t used = tag.length() + 2;
+  out.append(fg).append("*" RESET).append(bg).append(BLACK);
+  if(show_time && e.is_timed() && DEFAULT_DAY_WIDTH >= used + 4) {
+    append_clock(out, e.get_begin_minute(), false);
+    used += 4;
+  }
+  out.append(tag).append(RESET);
+  out.append(fg).append(DEFAULT_DAY_WIDTH - used, '=').append(RESET);
+  out.append(fg).append(ends ? "*" RESET : "=" RESET);
+}
 
-  std::string empty_day(DEFAULT_DAY_WIDTH + 1, ' ');
-  Date today = get_todays_date();
+//append "+----------" for n days and the closing "+\n"
+static void append_separator(std::string &out, unsigned blank, unsigned n) {
+  out.append(blank * (DEFAULT_DAY_WIDTH + 1), ' ');
+  for(unsigned i = blank; i < n; ++i) {
+    out += '+';
+    out.append(DEFAULT_DAY_WIDTH, '-');
+  }
+  out += "+\n";
+}
 
-  std::string cal = "";
-  std::string key = gen_key();
+void CalendarRange::render_cal(int fd, std::string &out) const {
+  PROFILE_PHASE(PHASE_RENDER);
+  //a row holds seven cells of text plus at most this many escape bytes each
+  const size_t cell_escape_bytes = 48;
+  const size_t row_bytes = DAYS_IN_WEEK * (DEFAULT_DAY_WIDTH + 1 + cell_escape_bytes) + 2;
+  out.reserve(out.length() + std::max<size_t>((max_concurrent_events + 2) * row_bytes,
+                                              RENDER_FLUSH_SIZE + row_bytes));
+  Date today = get_todays_date();
 
   //get full week containing begin
   Date wk_begin = get_begin();
@@ -202,140 +300,346 @@ std::string CalendarRange::print_cal() {
   wk_begin.snap_to_wk_begin();
   wk_end.snap_to_wk_end();
 
-  std::string separator = "";
-  std::string date_row = "";
-  std::vector<std::pair<bool, size_t> > event_slots;
-  std::vector<std::string> event_strings;
-
-  //setup event slots
+  //event shown in each row, and per week the event shown in each cell.
+  //NO_EVENT marks an empty cell.
+  const size_t NO_EVENT = SIZE_MAX;
+  std::vector<size_t> event_slots(max_concurrent_events, NO_EVENT);
+  std::vector<size_t> cells(DAYS_IN_WEEK * max_concurrent_events, NO_EVENT);
+  SlotAllocator slots;
   size_t next_to_start = 0;
-  for(size_t i = 0; i < max_concurrent_events; ++i) {
-    event_slots.emplace_back(std::make_pair(false, 0));
-    event_strings.emplace_back("");
-  }
-  
-  //setup initial separator
-  for(unsigned i = 0; i < DAYS_IN_WEEK; ++i) {
-    if(i < get_begin().weekday_index()) {
-      separator += empty_day;
-    } else {
-      separator += "+" + std::string(DEFAULT_DAY_WIDTH, '-');
-    }
-  }
-  
+
+  //the first separator leaves days before begin open
+  append_separator(out, get_begin().weekday_index(), DAYS_IN_WEEK);
+
   do {
-    // add a separator prior to each week in the range.
-    cal += separator + "+\n";
-    separator = "";
-
-    for(Date d = wk_begin; d < wk_end && d <= get_end(); ++d) {
-
-      // extend the separator for each day in the week
-      // this separator goes below the current week
-      separator += "+";
-      separator += std::string(DEFAULT_DAY_WIDTH, '-');
-
-      if(d < get_begin()) {
-        // handle range starting in the middle of a week
-        date_row += empty_day;
-        for(size_t i = 0; i < event_strings.size(); ++i) {
-          event_strings[i] += empty_day;
-        }
-      } else {
-        //set date_row for day d
-        std::string date_str = std::to_string(d.day());
-        if(d.day() == 1) {
-          date_str += " " + MONTH_ABREV[d.month()];
+    unsigned blank = (wk_begin < get_begin()) ? get_begin().weekday_index() : 0;
+    unsigned days = 0;
+
+    //assign rows for the week first so it can be written out row by row
+    for(Date d = wk_begin; d < wk_end && d <= get_end(); ++d, ++days) {
+      if(d < get_begin()) continue;
+      //assign starting events an event slot, events overlapping the
+      //range begin all start on its first day
+      slots.release_before(d.serial_time());
+      while(next_to_start < events_in_range.size() &&
+            events_in_range[next_to_start]->get_begin() <= d) {
+        size_t slot = slots.assign(events_in_range[next_to_start]->get_end().serial_time());
+        event_slots[slot] = next_to_start;
+        ++next_to_start;
+      }
+      for(size_t i = 0; i < event_slots.size(); ++i) {
+        cells[days * max_concurrent_events + i] = event_slots[i];
+        if(event_slots[i] != NO_EVENT && events_in_range[event_slots[i]]->get_end() == d) {
+          event_slots[i] = NO_EVENT;
         }
-        std::string spaces = std::string(DEFAULT_DAY_WIDTH-1-(date_str.length()), ' ');
-        if(d == today) date_str = color(date_str, RED);
-
-        date_row += "| " + date_str + spaces;
-
-        //assign starting events an event slot
-        while(!events_in_range.empty() && events_in_range[next_to_start].contains(d)) {
-          for(size_t i = 0; i < event_slots.size(); ++i) {
-            auto &[used, event_idx] = event_slots[i];
-            if(!used) {
-              used = true;
-              event_idx = next_to_start;
-              break;
-            }
-          }
-          ++next_to_start;
+      }
+    }
+
+    PROFILE_COUNT(COUNT_DAYS_ITERATED, days - blank);
+
+    //date row
+    out.append(blank * (DEFAULT_DAY_WIDTH + 1), ' ');
+    Date d = wk_begin;
+    d.change_day(static_cast<int>(blank));
+    for(unsigned k = blank; k < days; ++k, ++d) {
+      char date_str[16];
+      int len = (d.day() == 1)
+        ? snprintf(date_str, sizeof(date_str), "%u %s", d.day(), MONTH_ABREV[d.month()].c_str())
+        : snprintf(date_str, sizeof(date_str), "%u", d.day());
+      out += "| ";
+      if(d == today) out += RED;
+      out.append(date_str, static_cast<size_t>(len));
+      if(d == today) out += RESET;
+      out.append(DEFAULT_DAY_WIDTH - 1 - static_cast<size_t>(len), ' ');
+    }
+    out += "|\n";
+
+    //one row per event slot
+    for(size_t i = 0; i < max_concurrent_events; ++i) {
+      out.append(blank * (DEFAULT_DAY_WIDTH + 1), ' ');
+      d = wk_begin;
+      d.change_day(static_cast<int>(blank));
+      for(unsigned k = blank; k < days; ++k, ++d) {
+        size_t event_idx = cells[k * max_concurrent_events + i];
+        out += '|';
+        if(event_idx == NO_EVENT) {
+          out.append(DEFAULT_DAY_WIDTH, ' ');
+          continue;
         }
-        
-        //update event strings
-        for(size_t i = 0; i < event_slots.size(); ++i) {
-          auto &[used, event_idx] = event_slots[i];
-          std::string tag;
-          std::string fill;
-          long int color_idx = event_idx % NUM_COLORS;
-          event_strings[i] += "|";
-          if(used) {
-            Event current_event = events_in_range[event_idx];
-             
-            if(current_event.get_begin() == d) {
-              tag  = color(current_event.get_tag(), bg_colors[color_idx]+BLACK);
-              fill = color(std::string(DEFAULT_DAY_WIDTH-current_event.get_tag().length()-2, '='), fg_colors[color_idx]);
-              if(current_event.get_end() == d) {
-                fill += color("*", fg_colors[color_idx]);
-                used = false;
-              } else {
-                fill += color("=", fg_colors[color_idx]);
-              }
-              event_strings[i] += color("*", fg_colors[color_idx]) + tag + fill;
-            } else if (current_event.get_end() == d) {
-              fill = color(std::string(DEFAULT_DAY_WIDTH-1, '=')+"*", fg_colors[color_idx]);
-              event_strings[i] += fill;
-              used = false;
-            } else {
-              fill = color(std::string(DEFAULT_DAY_WIDTH, '='), fg_colors[color_idx]);
-              event_strings[i] += fill;
-            }
-          } else {
-            event_strings[i] += std::string(DEFAULT_DAY_WIDTH, ' ');
-          }
+        const Event &current_event = *events_in_range[event_idx];
+        std::string_view fg = fg_colors[event_idx % NUM_COLORS];
+        std::string_view bg = bg_colors[event_idx % NUM_COLORS];
+        if(current_event.get_begin() == d) {
+          append_begin_cell(out, current_event, fg, bg, true, current_event.get_end() == d);
+        } else if (current_event.get_end() == d) {
+          out.append(fg).append(DEFAULT_DAY_WIDTH - 1, '=').append("*" RESET);
+        } else {
+          out.append(fg).append(DEFAULT_DAY_WIDTH, '=').append(RESET);
         }
       }
+      out += "|\n";
     }
-    cal += date_row + "|\n";
-    date_row = "";
-    for(size_t i = 0; i < event_strings.size(); ++i) {
-      cal += event_strings[i] + "|\n";
-      event_strings[i] = "";
-    }
+
     wk_begin.change_day(DAYS_IN_WEEK);
     wk_end.change_day(DAYS_IN_WEEK);
+    //separator below the week
+    append_separator(out, 0, wk_begin <= get_end() ? DAYS_IN_WEEK : days);
+    flush_cal(fd, out);
   } while(wk_begin <= get_end());
-  cal += separator + "+\n" + key;
-  return cal;
+  gen_key(fd, out);
+  flush_cal(fd, out);
 }
 
-void CalendarRange::set_events(std::vector<Event> *events) {
-  //populate events_in range with valid events from 'events'
-  for(size_t i = 0; i < events->size(); ++i) {
-    Event e = (*events)[i];
-    if (e.get_begin() <= this->get_end() && e.get_end() >= this->get_begin()) {
-      events_in_range.push_back((*events)[i]);
+//width of the row labels of the day view
+#define DAY_VIEW_LABEL_WIDTH 8
+
+//append the day view separator for columns columns
+static void append_day_separator(std::string &out, size_t columns) {
+  out.append(DAY_VIEW_LABEL_WIDTH, ' ');
+  for(size_t c = 0; c < columns; ++c) {
+    out += '+';
+    out.append(DEFAULT_DAY_WIDTH, '-');
+  }
+  out += "+\n";
+}
+
+void CalendarRange::render_day(int fd, std::string &out) const {
+  PROFILE_PHASE(PHASE_RENDER);
+  const Date &day = get_begin();
+  char header[64];
+  int len = snprintf(header, sizeof(header), "%s %u %s %d\n", WEEKDAY_ABREV[day.weekday_index()].c_str(),
+                     day.day(), MONTH_ABREV[day.month()].c_str(), day.year());
+  out.append(header, static_cast<size_t>(len));
+
+  //the part of each timed event on this day, as hour rows
+  struct Segment {
+    size_t event;
+    int first_row;
+    int last_row;
+    size_t column;
+  };
+  std::vector<Segment> segments;
+  std::vector<size_t> all_day;
+  int first_hour = DAY_VIEW_FIRST_HOUR;
+  int last_hour = DAY_VIEW_LAST_HOUR;
+  SlotAllocator columns;
+  for(size_t i = 0; i < events_in_range.size(); ++i) {
+    const Event &e = *events_in_range[i];
+    if(e.get_begin() > day || e.get_end() < day) continue;
+    if(!e.is_timed()) {
+      all_day.push_back(i);
+      continue;
+    }
+    int begin = (e.get_begin() == day) ? e.get_begin_minute() : 0;
+    int end = (e.get_end() == day) ? e.get_end_minute() : Event::MINUTES_PER_DAY;
+    //an event ending on the hour does not reach into the next row
+    Segment segment{i, begin / 60, std::max(begin, end - 1) / 60, 0};
+    columns.release_before(segment.first_row);
+    segment.column = columns.assign(segment.last_row);
+    first_hour = std::min(first_hour, segment.first_row);
+    last_hour = std::max(last_hour, segment.last_row);
+    segments.push_back(segment);
+  }
+  size_t width = std::max<size_t>({1, columns.size(), all_day.size()});
+
+  //all day events side by side above the hours
+  append_day_separator(out, width);
+  out.append("all day").append(DAY_VIEW_LABEL_WIDTH - 7, ' ');
+  for(size_t c = 0; c < width; ++c) {
+    out += '|';
+    if(c >= all_day.size()) {
+      out.append(DEFAULT_DAY_WIDTH, ' ');
+      continue;
     }
+    size_t i = all_day[c];
+    const Event &e = *events_in_range[i];
+    append_begin_cell(out, e, fg_colors[i % NUM_COLORS], bg_colors[i % NUM_COLORS], false, true);
   }
+  out += "|\n";
+  append_day_separator(out, width);
+
+  //one row per hour, one column per concurrent timed event
+  std::vector<const Segment *> cells(width);
+  for(int hour = first_hour; hour <= last_hour; ++hour) {
+    std::fill(cells.begin(), cells.end(), nullptr);
+    for(const Segment &segment : segments) {
+      if(segment.first_row <= hour && hour <= segment.last_row) cells[segment.column] = &segment;
+    }
+    char label[16];
+    len = snprintf(label, sizeof(label), "%02d:00", hour);
+    out.append(label, static_cast<size_t>(len));
+    out.append(DAY_VIEW_LABEL_WIDTH - static_cast<size_t>(len), ' ');
+    for(const Segment *segment : cells) {
+      out += '|';
+      if(!segment) {
+        out.append(DEFAULT_DAY_WIDTH, ' ');
+        continue;
+      }
+      std::string_view fg = fg_colors[segment->event % NUM_COLORS];
+      std::string_view bg = bg_colors[segment->event % NUM_COLORS];
+      const Event &e = *events_in_range[segment->event];
+      if(hour == segment->first_row) {
+        append_begin_cell(out, e, fg, bg, e.get_begin() == day, hour == segment->last_row);
+      } else if(hour == segment->last_row) {
+        out.append(fg).append(DEFAULT_DAY_WIDTH - 1, '=').append("*" RESET);
+      } else {
+        out.append(fg).append(DEFAULT_DAY_WIDTH, '=').append(RESET);
+      }
+    }
+    out += "|\n";
+  }
+  append_day_separator(out, width);
+  gen_key(fd, out);
+  flush_cal(fd, out);
+}
+
+std::string CalendarRange::print_day() const {
+  std::string day;
+  render_day(-1, day);
+  return day;
+}
+
+void CalendarRange::print_day(int fd) const {
+  std::string buffer;
+  render_day(fd, buffer);
+}
 
-  //sort valid events by start time
-  std::sort(events_in_range.begin(), events_in_range.end(), starts_before);
+std::string CalendarRange::print_cal() const {
+  std::string cal;
+  render_cal(-1, cal);
+  return cal;
+}
 
+void CalendarRange::print_cal(int fd) const {
+  std::string buffer;
+  render_cal(fd, buffer);
+}
+
+void CalendarRange::set_events(std::vector<Event> *events) {
+  set_events(EventIndex(events));
+}
+
+void CalendarRange::track_tags(const std::vector<std::string> &tags) {
+  tracked_tags = tags;
+}
+
+void CalendarRange::set_events(const EventIndex &index) {
+  //populate events_in_range with events overlapping the range
+  events_in_range.clear();
+  event_sources.clear();
+  source_names.clear();
+  {
+    PROFILE_PHASE(PHASE_FILTER);
+    //expand only the occurrences of recurring events inside the range
+    std::vector<const Event *> series;
+    index.query_series(*this, series);
+    occurrences.clear();
+    for(const Event *e : series) e->occurrences(*this, occurrences);
+    query_source(index, 0, occurrences.size(), events_in_range);
+  }
+  PROFILE_COUNT(COUNT_EVENTS_IN_RANGE, events_in_range.size());
+  set_concurrency();
+}
+
+void CalendarRange::set_concurrency() {
   //calculate max_concurrent_events in events_in_range
-  for(Date d = get_begin(); d <= get_end(); ++d) {
-    size_t events_on_day = 0;
-    for(size_t i = 0; i < events_in_range.size(); ++i) {
-      if(events_in_range[i].contains(d)) {
-        ++events_on_day;
-      }
+  PROFILE_PHASE(PHASE_CONCURRENCY);
+  occupancy.build(*this, events_in_range, tracked_tags);
+  max_concurrent_events = occupancy.peak();
+}
+
+void CalendarRange::query_source(const EventIndex &index, size_t first_occurrence,
+                                 size_t last_occurrence, std::vector<const Event *> &out) const {
+  //the index returns single events already sorted by start time
+  long singles = static_cast<long>(out.size());
+  index.query(*this, out);
+  if(first_occurrence == last_occurrence) return;
+  //sort pointers rather than moving the occurrences themselves
+  auto before = [](const Event *x, const Event *y) { return Event::starts_before(*x, *y); };
+  long merged = static_cast<long>(out.size());
+  for(size_t i = first_occurrence; i < last_occurrence; ++i) out.push_back(&occurrences[i]);
+  std::sort(out.begin() + merged, out.end(), before);
+  std::inplace_merge(out.begin() + singles, out.begin() + merged, out.end(), before);
+}
+
+void CalendarRange::set_events(const std::vector<const EventIndex *> &sources,
+                               const std::vector<std::string> &names) {
+  if(sources.size() == 1) {
+    set_events(*sources[0]);
+    return;
+  }
+  events_in_range.clear();
+  event_sources.clear();
+  source_names = names;
+  {
+    PROFILE_PHASE(PHASE_FILTER);
+    //expand the occurrences of every source first so pointers into
+    //occurrences stay valid
+    occurrences.clear();
+    std::vector<size_t> expanded{0};
+    std::vector<const Event *> series;
+    for(const EventIndex *index : sources) {
+      series.clear();
+      index->query_series(*this, series);
+      for(const Event *e : series) e->occurrences(*this, occurrences);
+      expanded.push_back(occurrences.size());
     }
-    if(events_on_day > max_concurrent_events) {
-      max_concurrent_events = events_on_day;
+
+    //each source is a sorted stream, merge them through a heap of the
+    //stream heads rather than concatenating and sorting everything
+    std::vector<std::vector<const Event *> > streams(sources.size());
+    size_t total = 0;
+    for(size_t s = 0; s < sources.size(); ++s) {
+      query_source(*sources[s], expanded[s], expanded[s + 1], streams[s]);
+      total += streams[s].size();
+    }
+    events_in_range.reserve(total);
+    event_sources.reserve(total);
+
+    std::vector<size_t> next(sources.size(), 0);
+    auto after = [&](size_t x, size_t y) {
+      const Event &a = *streams[x][next[x]];
+      const Event &b = *streams[y][next[y]];
+      if(Event::starts_before(b, a)) return true;
+      return !Event::starts_before(a, b) && y < x;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(after)> heads(after);
+    for(size_t s = 0; s < sources.size(); ++s) {
+      if(!streams[s].empty()) heads.push(s);
+    }
+    while(!heads.empty()) {
+      size_t s = heads.top();
+      heads.pop();
+      events_in_range.push_back(streams[s][next[s]]);
+      event_sources.push_back(static_cast<uint16_t>(s));
+      if(++next[s] < streams[s].size()) heads.push(s);
     }
   }
+  PROFILE_COUNT(COUNT_EVENTS_IN_RANGE, events_in_range.size());
+  set_concurrency();
+}
+
+const std::vector<unsigned> &CalendarRange::get_concurrency() const {
+  return occupancy.get_counts();
+}
+
+const Occupancy &CalendarRange::get_occupancy() const {
+  return occupancy;
+}
+
+const std::vector<const Event *> &CalendarRange::get_events() const {
+  return events_in_range;
+}
+
+size_t CalendarRange::get_source(size_t i) const {
+  return event_sources.empty() ? 0 : event_sources[i];
+}
+
+std::vector<unsigned> concurrency_profile(const TimeRange &range,
+                                          const std::vector<const Event *> &events) {
+  Occupancy occupancy;
+  occupancy.build(range, events);
+  return occupancy.get_counts();
 }
 
 Date get_todays_date() {
@@ -2,31 +2,78 @@
 #define DATE_H
 
 #include <chrono>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
+#include "occupancy.h"
+#include "rrule.h"
   
 #define DAYS_IN_WEEK 7
-static const unsigned DAYS_IN_MONTH[13] = {0, 31, 29, 31, 30, 31, 30,
+static constexpr unsigned DAYS_IN_MONTH[13] = {0, 31, 29, 31, 30, 31, 30,
                                               31, 31, 30, 31, 30, 31};
 
 static const std::string MONTH_ABREV[13] = {"", "JAN", "FEB", "MAR", "APR", "MAY", "JUN",
                                                 "JUL", "AUG", "SEP", "OCT", "NOV", "DEC"};
+//indexed by Date::weekday_index
+static const std::string WEEKDAY_ABREV[DAYS_IN_WEEK] = {"SUN", "MON", "TUE", "WED", "THU", "FRI", "SAT"};
 
+//=== Civil calendar arithmetic ===
+
+struct CivilDate {
+  int year;
+  unsigned month;
+  unsigned day;
+};
+
+//return true if y is a leap year in the proleptic gregorian calendar
+constexpr bool is_leap_year(int y) {
+  return y % 4 == 0 && (y % 100 != 0 || y % 400 == 0);
+}
+
+//return the number of days in month m of year y
+constexpr unsigned days_in_month(int y, unsigned m) {
+  return (m == 2 && !is_leap_year(y)) ? 28 : DAYS_IN_MONTH[m];
+}
+
+//return days since 1970-1-1 of y-m-d. a day past the end of the month
+//rolls over into the following month(s).
+constexpr int32_t days_from_civil(int y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  const int era = (y >= 0 ? y : y - 399) / 400;
+  const unsigned yoe = static_cast<unsigned>(y - era * 400);
+  const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + static_cast<int32_t>(doe) - 719468;
+}
+
+//return the year, month and day of days since 1970-1-1
+constexpr CivilDate civil_from_days(int32_t z) {
+  z += 719468;
+  const int era = (z >= 0 ? z : z - 146096) / 146097;
+  const unsigned doe = static_cast<unsigned>(z - era * 146097);
+  const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const unsigned mp = (5 * doy + 2) / 153;
+  const unsigned d = doy - (153 * mp + 2) / 5 + 1;
+  const unsigned m = mp < 10 ? mp + 3 : mp - 9;
+  return CivilDate{static_cast<int>(yoe) + era * 400 + (m <= 2), m, d};
+}
+
+//a calendar day stored as a 32 bit count of days since 1970-1-1. year,
+//month, day and weekday are derived from the count when asked for.
 class Date {
 private:
-  std::chrono::year_month_day ymd;
-  long int serial;
+  int32_t serial;
 
-  //updates serial value for ymd
-  void update_serial();
-  //corrects invalid dates in ymd
-  void validate_ymd();
+  //set serial from y-m-d, rolling invalid days over into the next month
+  void set_civil(int y, unsigned m, unsigned d);
 
 public:
   //=== Constructors ===
 
   //default initialize to 1970-1-1
-  Date();
+  constexpr Date() : serial(0) {}
   //copy constructor
   //Date(const Date& dt);
   //initialize from std::chrono::time_point object
@@ -39,17 +86,21 @@ public:
   //=== Accessors ===
 
   //return date as days since epoch (1970-1-1)
-  long int serial_time() const; //return date as days since epoch 
+  constexpr long int serial_time() const { return serial; }
   //return day
-  unsigned day() const;
+  constexpr unsigned day() const { return civil_from_days(serial).day; }
   //return month
-  unsigned month() const;
+  constexpr unsigned month() const { return civil_from_days(serial).month; }
   //return year
-  int year() const;
+  constexpr int year() const { return civil_from_days(serial).year; }
   //retunr std::chrono::year_month_day object
   std::chrono::year_month_day ymd_obj() const;
   //return day of week S=0, M=1, T=2, W=3, T=4, F=5, S=6
-  unsigned weekday_index() const;
+  constexpr unsigned weekday_index() const {
+    //1970-1-1 was a thursday
+    int32_t wd = (serial + 4) % DAYS_IN_WEEK;
+    return static_cast<unsigned>(wd < 0 ? wd + DAYS_IN_WEEK : wd);
+  }
   //return date as string representing tz timestamp
   std::string to_tz_tstamp() const;
 
@@ -69,12 +120,21 @@ public:
   //=== Operators ===
 
   //equals operator
-  bool operator==(const Date &rhs) const;
+  constexpr bool operator==(const Date &rhs) const { return serial == rhs.serial; }
   //increment operators
-  Date& operator++ ();
-  Date operator++ (int);
+  constexpr Date& operator++ () {
+    ++serial;
+    return *this;
+  }
+  constexpr Date operator++ (int) {
+    Date result(*this);
+    ++serial;
+    return result;
+  }
   //spaceship operator
-  std::strong_ordering operator<=>(const Date &rhs) const;
+  constexpr std::strong_ordering operator<=>(const Date &rhs) const {
+    return serial <=> rhs.serial;
+  }
   //stream operator, outputs date as YYYY-MM-DD
   friend std::ostream & operator<< (std::ostream &out, const Date &d);
 };
@@ -105,51 +165,130 @@ public:
   bool contains(const Date &d) const;
 };
 
+//an event references its title and uid, which are normally stored in the
+//StringArena of the Calendar that owns it. the tag is stored inline.
+//a recurring event is the first occurrence of its series. a timed event
+//also has start and end times, in minutes after local midnight of its
+//begin and end days; an all day event has ALL_DAY for both.
 class Event : public TimeRange {
 private:
-  std::string title;
-  std::string tag;  
+  std::string_view title;
+  std::string_view uid;
+  char tag[4];
+  int16_t begin_minute;
+  int16_t end_minute;
+  Recurrence rule;
 public:
+  static constexpr int ALL_DAY = -1;
+  static constexpr int MINUTES_PER_DAY = 1440;
 
   // === Constructors ===
 
   //Default initialize with title = "TITLE" & tag = "TAG"
   Event();
-  //initialize from two std::chrono::sys_days objects
-  Event(std::string title, std::string tag, std::chrono::sys_days &begin, std::chrono::sys_days &end);
+  //initialize from two std::chrono::sys_days objects. title and uid must
+  //outlive the event, tag is truncated to four characters and copied.
+  Event(std::string_view title, std::string_view tag, std::chrono::sys_days &begin,
+        std::chrono::sys_days &end, std::string_view uid = std::string_view());
   //initialize from two Date objects
-  Event(std::string title, std::string tag, Date &begin, Date &end);
+  Event(std::string_view title, std::string_view tag, Date &begin, Date &end,
+        std::string_view uid = std::string_view());
 
   // === Accessors ===
 
   //return event title
-  std::string get_title();
+  std::string_view get_title() const;
   //return event tag
-  std::string get_tag();
+  std::string_view get_tag() const;
+  //return event uid, empty until assigned by a Calendar
+  std::string_view get_uid() const;
+  //return the tag packed into an integer, for hashing
+  uint32_t tag_key() const;
+  //return tag truncated to four characters and packed like tag_key
+  static uint32_t tag_key(std::string_view tag);
+  //true if the event has start and end times
+  bool is_timed() const;
+  //return the start time in minutes after midnight, ALL_DAY if untimed
+  int get_begin_minute() const;
+  //return the end time in minutes after midnight, ALL_DAY if untimed.
+  //an event ending at midnight ends at MINUTES_PER_DAY of the day before.
+  int get_end_minute() const;
+  //return the recurrence rule, frequency NONE for a single event
+  const Recurrence &get_rule() const;
+  //true if the event is the first occurrence of a recurring series
+  bool recurs() const;
+  //return the end serial of the last occurrence, LONG_MAX if endless
+  long int series_end() const;
+  //append the occurrences of the series overlapping range to out as
+  //single events. a single event overlapping range is appended as is.
+  void occurrences(const TimeRange &range, std::vector<Event> &out) const;
+
+  // === Modifiers ===
+
+  //set event title, title must outlive the event
+  void set_title(std::string_view title);
+  //set event uid, uid must outlive the event
+  void set_uid(std::string_view uid);
+  //set the recurrence rule
+  void set_rule(const Recurrence &rule);
+  //set start and end times in minutes after midnight, ALL_DAY for both
+  //makes the event an all day event
+  void set_times(int begin_minute, int end_minute);
 
   struct {
-    bool operator()(Event x, Event y) const {
-      return x.tag.compare(y.tag) < 0;
+    bool operator()(const Event &x, const Event &y) const {
+      return x.get_tag().compare(y.get_tag()) < 0;
     }
   }static tag_alpha;
+
+  //all day events sort before timed events starting on the same day
+  struct {
+    bool operator()(const Event &x, const Event &y) const {
+      if (x.get_begin() != y.get_begin())
+        return x.get_begin() < y.get_begin();
+      if (x.begin_minute != y.begin_minute)
+        return x.begin_minute < y.begin_minute;
+      if (x.get_end() != y.get_end())
+        return x.get_end() < y.get_end();
+      return x.end_minute < y.end_minute;
+    }
+  } static starts_before;
 };
 
 
+class EventIndex;
+
 class CalendarRange : public TimeRange {
 private:
-  std::vector<Event> events_in_range;
+  std::vector<const Event *> events_in_range;
+  //occurrences of recurring events in the range, expanded by set_events
+  std::vector<Event> occurrences;
+  //with several sources, the source of each event in events_in_range and
+  //the source names, indexed alike
+  std::vector<uint16_t> event_sources;
+  std::vector<std::string> source_names;
+  //number of events on each day of the range, and the days of each of
+  //tracked_tags
+  Occupancy occupancy;
+  std::vector<std::string> tracked_tags;
   size_t max_concurrent_events;
 
-  struct {
-    bool operator()(Event x, Event y) {
-      if (x.get_begin() == y.get_begin())
-        return x.get_end() < y.get_end();
-      else
-        return x.get_begin() < y.get_begin();
-    }
-  } static starts_before;
-
-  std::string gen_key();
+  //append the events of index overlapping the range to out in
+  //starts_before order, merged with occurrences[first_occurrence..last_occurrence)
+  void query_source(const EventIndex &index, size_t first_occurrence, size_t last_occurrence,
+                    std::vector<const Event *> &out) const;
+  //build occupancy and max_concurrent_events from events_in_range
+  void set_concurrency();
+  //append the colour key to out, flushing to fd as it fills. with several
+  //sources the key is grouped under a band in each source's colour.
+  void gen_key(int fd, std::string &out) const;
+  //render the calendar into out one week at a time, writing each week to
+  //fd. with fd < 0 the whole calendar is left in out.
+  void render_cal(int fd, std::string &out) const;
+  //render the day view into out, writing it to fd. with fd < 0 the whole
+  //view is left in out.
+  void render_day(int fd, std::string &out) const;
+  static void flush_cal(int fd, std::string &out);
 
 public:
 
@@ -162,13 +301,48 @@ public:
 
   // === Modifiers ===
 
-  //poulate events_in_rannge with events 
+  //poulate events_in_range with indexed events overlapping the range
+  void set_events(const EventIndex &index);
+  //poulate events_in_range with the events of several sources overlapping
+  //the range, k-way merging the sorted stream of each source. ties keep
+  //the source order. names label the sources in the key.
+  void set_events(const std::vector<const EventIndex *> &sources,
+                  const std::vector<std::string> &names);
+  //poulate events_in_range with events overlapping the range. events
+  //must outlive the CalendarRange.
   void set_events(std::vector<Event> * events);
+  //collect the days of events tagged with each of tags in the occupancy
+  //from the next set_events on
+  void track_tags(const std::vector<std::string> &tags);
 
+  // === Accessors ===
 
-  std::string print_cal(); //print out calendar events over calendar range
+  //return number of events on each day of the range, index 0 = begin
+  const std::vector<unsigned> &get_concurrency() const;
+  //return the coverage of the range by its events
+  const Occupancy &get_occupancy() const;
+  //return the events overlapping the range in starts_before order
+  const std::vector<const Event *> &get_events() const;
+  //return the source the i'th event came from, 0 with a single source
+  size_t get_source(size_t i) const;
+
+  //return calendar events over calendar range as a string
+  std::string print_cal() const;
+  //write calendar events over calendar range to fd a week at a time
+  //through one reused buffer, so memory use does not grow with the range
+  void print_cal(int fd) const;
+  //return the day view of the first day of the range as a string
+  std::string print_day() const;
+  //write the first day of the range to fd as an hour by hour day view,
+  //timed events side by side in columns and all day events above
+  void print_day(int fd) const;
 };
 
+//return the number of events on each day of range, index 0 = range begin.
+//computed with one pass over the event boundaries and one over the days.
+std::vector<unsigned> concurrency_profile(const TimeRange &range,
+                                          const std::vector<const Event *> &events);
+
 Date get_todays_date();
 
 #endif
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <cstdio>
+#include <string_view>
+
+#include "freebusy.h"
+
+// === Free/busy ===
+
+//return the TimeRange of day serials first to last, offsets from range begin
+static TimeRange serial_span(const TimeRange &range, long int first, long int last) {
+  long int origin = range.get_begin().serial_time();
+  Date b = range.get_begin();
+  Date e = range.get_begin();
+  b.change_day(static_cast<int>(first - origin));
+  e.change_day(static_cast<int>(last - origin));
+  return TimeRange(b, e);
+}
+
+std::vector<TimeRange> busy_spans(const TimeRange &range, const std::vector<const Event *> &events) {
+  long int first = range.get_begin().serial_time();
+  long int last = range.get_end().serial_time();
+  std::vector<TimeRange> spans;
+  bool open = false;
+  long int span_begin = 0;
+  long int span_end = 0;
+  for(const Event *e : events) {
+    //clipping to the range keeps start order
+    long int b = std::max(first, e->get_begin().serial_time());
+    long int end = std::min(last, e->get_end().serial_time());
+    if(b > end) continue;
+    if(open && b <= span_end + 1) {
+      span_end = std::max(span_end, end);
+      continue;
+    }
+    if(open) spans.push_back(serial_span(range, span_begin, span_end));
+    span_begin = b;
+    span_end = end;
+    open = true;
+  }
+  if(open) spans.push_back(serial_span(range, span_begin, span_end));
+  return spans;
+}
+
+std::vector<TimeRange> free_spans(const TimeRange &range, const std::vector<const Event *> &events,
+                                  unsigned min_days) {
+  std::vector<TimeRange> gaps;
+  long int next = range.get_begin().serial_time();
+  auto gap_until = [&](long int end) {
+    if(end >= next && end - next + 1 >= std::max<long int>(min_days, 1)) {
+      gaps.push_back(serial_span(range, next, end));
+    }
+  };
+  for(const TimeRange &busy : busy_spans(range, events)) {
+    gap_until(busy.get_begin().serial_time() - 1);
+    next = busy.get_end().serial_time() + 1;
+  }
+  gap_until(range.get_end().serial_time());
+  return gaps;
+}
+
+void write_spans(const std::vector<TimeRange> &spans, std::ostream &out) {
+  for(const TimeRange &span : spans) {
+    long int days = span.get_end().serial_time() - span.get_begin().serial_time() + 1;
+    out << span.get_begin() << " to " << span.get_end() << "  " << days
+        << (days == 1 ? " day" : " days") << '\n';
+  }
+  out.flush();
+}
+
+//return the minute since the epoch e begins at and the one it ends before
+static std::pair<long int, long int> minute_span(const Event &e) {
+  long int begin = e.get_begin().serial_time() * Event::MINUTES_PER_DAY;
+  long int end = e.get_end().serial_time() * Event::MINUTES_PER_DAY;
+  if(e.is_timed()) return {begin + e.get_begin_minute(), end + e.get_end_minute()};
+  return {begin, end + Event::MINUTES_PER_DAY};
+}
+
+bool events_overlap(const Event &a, const Event &b) {
+  auto [a_begin, a_end] = minute_span(a);
+  auto [b_begin, b_end] = minute_span(b);
+  return a_begin < b_end && b_begin < a_end;
+}
+
+std::vector<const Event *> conflicting_events(const Event &e, const std::vector<const Event *> &events) {
+  std::vector<const Event *> conflicts;
+  for(const Event *other : events) {
+    if(events_overlap(e, *other)) conflicts.push_back(other);
+  }
+  return conflicts;
+}
+
+// === Stats ===
+
+std::vector<std::string> split_tags(std::string_view list) {
+  std::vector<std::string> tags;
+  while(!list.empty()) {
+    size_t comma = std::min(list.find(','), list.length());
+    if(comma > 0) tags.emplace_back(list.substr(0, comma));
+    list.remove_prefix(std::min(comma + 1, list.length()));
+  }
+  return tags;
+}
+
+//write one row of write_stats over days [day, day + n) of occupancy
+static void write_stats_row(std::ostream &out, std::string_view label, const Occupancy &occupancy,
+                            const std::vector<std::string> &tags, size_t day, size_t n) {
+  char cell[16];
+  auto column = [&](size_t value) {
+    snprintf(cell, sizeof(cell), "%6zu", value);
+    out << cell;
+  };
+  out << label;
+  for(size_t pad = label.length(); pad < 8; ++pad) out << ' ';
+  column(n);
+  column(occupancy.busy_days(day, n));
+  column(occupancy.peak(day, n));
+  for(const std::string &tag : tags) column(occupancy.tag_days_in({tag}, day, n));
+  if(tags.size() > 1) column(occupancy.tag_days_in(tags, day, n));
+  out << '\n';
+}
+
+void write_stats(const CalendarRange &range, const std::vector<std::string> &tags, std::ostream &out) {
+  const Occupancy &occupancy = range.get_occupancy();
+  char cell[24];
+  out << "month     days  busy  peak";
+  for(const std::string &tag : tags) {
+    snprintf(cell, sizeof(cell), "%6.5s", tag.c_str());
+    out << cell;
+  }
+  if(tags.size() > 1) out << "   all";
+  out << '\n';
+
+  long int origin = range.get_begin().serial_time();
+  size_t day = 0;
+  while(day < occupancy.size()) {
+    CivilDate civil = civil_from_days(static_cast<int32_t>(origin + static_cast<long int>(day)));
+    size_t n = std::min(occupancy.size() - day,
+                        static_cast<size_t>(days_in_month(civil.year, civil.month) - civil.day + 1));
+    snprintf(cell, sizeof(cell), "%04d-%02u", civil.year, civil.month);
+    write_stats_row(out, cell, occupancy, tags, day, n);
+    day += n;
+  }
+  write_stats_row(out, "total", occupancy, tags, 0, occupancy.size());
+  out.flush();
+}
@@ -0,0 +1,43 @@
+#ifndef FREEBUSY_H
+#define FREEBUSY_H
+
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "datetime.h"
+
+//free/busy queries over the events of a CalendarRange. events must be in
+//start order, as CalendarRange keeps them, so busy time is found in one
+//pass that merges each event into the span before it. the cost grows
+//with the number of events in the range, never with days times events.
+
+//return the spans of days in range covered by at least one event, in
+//order and with touching spans merged
+std::vector<TimeRange> busy_spans(const TimeRange &range, const std::vector<const Event *> &events);
+
+//return the runs of at least min_days consecutive days in range that no
+//event covers, in order
+std::vector<TimeRange> free_spans(const TimeRange &range, const std::vector<const Event *> &events,
+                                  unsigned min_days);
+
+//write spans one per line as "YYYY-MM-DD to YYYY-MM-DD  N days"
+void write_spans(const std::vector<TimeRange> &spans, std::ostream &out);
+
+//return true if a and b overlap. the times of timed events are compared,
+//all day events cover their days whole.
+bool events_overlap(const Event &a, const Event &b);
+
+//return the events that overlap e, in the order given
+std::vector<const Event *> conflicting_events(const Event &e, const std::vector<const Event *> &events);
+
+//return the comma separated tags of list, none if list is empty
+std::vector<std::string> split_tags(std::string_view list);
+
+//write a row per month of range, then a total row, with the days in
+//range, the days with events, the most events on one day and the days
+//with an event of each of tags. with several tags a last column counts
+//the days with an event of every one. range must track tags.
+void write_stats(const CalendarRange &range, const std::vector<std::string> &tags, std::ostream &out);
+
+#endif
@@ -0,0 +1,380 @@
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ics.h"
+
+// === MappedFile ===
+MappedFile::MappedFile(const std::string &path) : data(nullptr), size(0) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if(fd < 0) return;
+
+  struct stat st;
+  if(fstat(fd, &st) == 0 && st.st_size > 0) {
+    void *addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if(addr != MAP_FAILED) {
+      data = static_cast<const char *>(addr);
+      size = static_cast<size_t>(st.st_size);
+      madvise(addr, size, MADV_SEQUENTIAL);
+    }
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if(data) munmap(const_cast<char *>(data), size);
+}
+
+std::string_view MappedFile::view() const {
+  return std::string_view(data, size);
+}
+
+// === Writing ===
+void replace_file(const std::string &path, std::string_view data, bool durable) {
+  std::string tmp_path = path + ".tmp.XXXXXX";
+  int fd = mkstemp(tmp_path.data());
+  if(fd < 0) throw std::runtime_error("Unable to create " + tmp_path);
+
+  bool ok = fchmod(fd, 0644) == 0;
+  size_t written = 0;
+  while(ok && written < data.length()) {
+    ssize_t n = write(fd, data.data() + written, data.length() - written);
+    if(n < 0 && errno == EINTR) continue;
+    ok = n > 0;
+    if(ok) written += static_cast<size_t>(n);
+  }
+  //the data must be on disk before the rename makes it the file at path
+  ok = ok && (!durable || fsync(fd) == 0);
+  ok = (close(fd) == 0) && ok;
+  if(!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+    throw std::runtime_error("Unable to write " + path);
+  }
+
+  //make the rename itself durable
+  if(!durable) return;
+  size_t slash = path.rfind('/');
+  std::string dir = (slash == std::string::npos) ? "." : path.substr(0, slash + 1);
+  int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if(dir_fd >= 0) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+}
+
+// === FileLock ===
+FileLock::FileLock(const std::string &path) {
+  fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if(fd < 0) throw std::runtime_error("Unable to open lock " + path);
+  while(flock(fd, LOCK_EX) != 0) {
+    if(errno != EINTR) {
+      close(fd);
+      throw std::runtime_error("Unable to lock " + path);
+    }
+  }
+}
+
+FileLock::~FileLock() {
+  //closing the descriptor releases the lock
+  close(fd);
+}
+
+// === Parsing ===
+
+uint64_t fnv1a(const char *data, size_t len) {
+  uint64_t hash = 14695981039346656037ull;
+  for(size_t i = 0; i < len; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+//parse exactly len ascii digits starting at s
+static unsigned parse_digits(const char *s, size_t len) {
+  unsigned n = 0;
+  for(size_t i = 0; i < len; ++i) {
+    unsigned digit = static_cast<unsigned>(s[i] - '0');
+    if(digit > 9) throw std::invalid_argument("Invalid Timestamp");
+    n = n * 10 + digit;
+  }
+  return n;
+}
+
+Date parse_tstamp(std::string_view value) {
+  if(value.length() < 8) throw std::invalid_argument("Invalid Timestamp");
+  int year = static_cast<int>(parse_digits(value.data(), 4));
+  unsigned month = parse_digits(value.data() + 4, 2);
+  unsigned day = parse_digits(value.data() + 6, 2);
+  return Date(year, month, day);
+}
+
+#define SECONDS_PER_DAY 86400
+
+//the zone of the last TZID seen, so runs of events in one zone look it
+//up once
+struct ZoneCache {
+  std::string_view tzid;
+  const TimeZone *zone = nullptr;
+};
+
+//return the value of parameter name in params, unquoted
+static std::string_view param_value(std::string_view params, std::string_view name) {
+  while(!params.empty()) {
+    size_t semi = params.find(';');
+    std::string_view param = params.substr(0, semi);
+    params = (semi == std::string_view::npos) ? std::string_view() : params.substr(semi + 1);
+    if(param.length() > name.length() && param.substr(0, name.length()) == name &&
+       param[name.length()] == '=') {
+      std::string_view value = param.substr(name.length() + 1);
+      if(value.length() >= 2 && value.front() == '"' && value.back() == '"') {
+        value = value.substr(1, value.length() - 2);
+      }
+      return value;
+    }
+  }
+  return std::string_view();
+}
+
+static IcsTime convert_time(std::string_view value, std::string_view params,
+                            const TimeZone &display, ZoneCache &cache) {
+  Date day = parse_tstamp(value);
+  if(value.length() < 15 || value[8] != 'T') return IcsTime{day, Event::ALL_DAY};
+  unsigned hour = parse_digits(value.data() + 9, 2);
+  unsigned minute = parse_digits(value.data() + 11, 2);
+  unsigned second = parse_digits(value.data() + 13, 2);
+  if(hour > 23 || minute > 59 || second > 60) throw std::invalid_argument("Invalid Timestamp");
+  bool utc = value.length() > 15 && value[15] == 'Z';
+
+  int64_t local = day.serial_time() * SECONDS_PER_DAY + hour * 3600 + minute * 60 + second;
+  const TimeZone *zone = utc ? &TimeZone::utc() : &display;
+  std::string_view tzid = utc ? std::string_view() : param_value(params, "TZID");
+  if(!tzid.empty()) {
+    if(tzid != cache.tzid) {
+      cache.tzid = tzid;
+      cache.zone = TimeZone::locate(tzid);
+    }
+    if(cache.zone) zone = cache.zone;
+  }
+  if(zone != &display) local = display.to_local(zone->to_utc(local));
+
+  int64_t days = local / SECONDS_PER_DAY - (local % SECONDS_PER_DAY < 0);
+  std::chrono::sys_days d{std::chrono::days{days}};
+  return IcsTime{Date(d), static_cast<int>((local - days * SECONDS_PER_DAY) / 60)};
+}
+
+IcsTime parse_ics_time(std::string_view value, std::string_view params, const TimeZone &display) {
+  ZoneCache cache;
+  return convert_time(value, params, display, cache);
+}
+
+//whether value is a date or midnight utc, which all day events have
+//always been saved with
+static bool dated(std::string_view value) {
+  return value.length() < 15 || value[8] != 'T' || value.substr(9, 7) == "000000Z";
+}
+
+//bring end, the end of an event beginning at begin, to the form Event
+//keeps: a timed event ending at midnight ends at MINUTES_PER_DAY of the
+//day before, and a timed event whose end has no time ends with its day
+static void normalize_end(const IcsTime &begin, IcsTime &end) {
+  if(begin.minute == Event::ALL_DAY) return;
+  if(end.minute == Event::ALL_DAY) {
+    end.minute = Event::MINUTES_PER_DAY;
+  } else if(end.minute == 0 && begin.day < end.day) {
+    end.day.change_day(-1);
+    end.minute = Event::MINUTES_PER_DAY;
+  }
+}
+
+//convert the DTSTART and DTEND of one event, either empty if it has none.
+//the event is all day only if both ends are dated, one timed end makes
+//midnight utc at the other a time too.
+static void convert_span(std::string_view begin_value, std::string_view begin_params,
+                         std::string_view end_value, std::string_view end_params,
+                         const TimeZone &display, ZoneCache &cache, IcsTime &begin, IcsTime &end) {
+  begin = end = IcsTime{Date(), Event::ALL_DAY};
+  if(dated(begin_value) && dated(end_value)) {
+    if(!begin_value.empty()) begin.day = parse_tstamp(begin_value);
+    if(!end_value.empty()) end.day = parse_tstamp(end_value);
+    return;
+  }
+  if(!begin_value.empty()) begin = convert_time(begin_value, begin_params, display, cache);
+  if(!end_value.empty()) end = convert_time(end_value, end_params, display, cache);
+  normalize_end(begin, end);
+}
+
+void parse_ics_span(std::string_view begin_value, std::string_view end_value,
+                    IcsTime &begin, IcsTime &end, const TimeZone &display) {
+  ZoneCache cache;
+  convert_span(begin_value, std::string_view(), end_value, std::string_view(), display, cache,
+               begin, end);
+}
+
+//append day and minute as YYYYMMDDTHHMM00, minute may be MINUTES_PER_DAY
+static void append_local_tstamp(std::string &out, Date day, int minute) {
+  if(minute == Event::MINUTES_PER_DAY) {
+    day.change_day(1);
+    minute = 0;
+  }
+  char buf[32];
+  int len = snprintf(buf, sizeof(buf), "%04d%02u%02uT%02d%02d00",
+                     day.year(), day.month(), day.day(), minute / 60, minute % 60);
+  out.append(buf, static_cast<size_t>(len));
+}
+
+std::string format_tstamp(const Date &day, int minute) {
+  if(minute == Event::ALL_DAY) return day.to_tz_tstamp();
+  std::string stamp;
+  append_local_tstamp(stamp, day, minute);
+  return stamp;
+}
+
+std::string format_ics_time(std::string_view key, const Date &day, int minute,
+                            const TimeZone &display) {
+  std::string line(key);
+  if(minute == Event::ALL_DAY) return line.append(":").append(day.to_tz_tstamp());
+  if(!display.get_name().empty()) {
+    line.append(";TZID=").append(display.get_name()).append(":");
+    append_local_tstamp(line, day, minute);
+    return line;
+  }
+  //a zone without a name can only be written as utc
+  int64_t utc = display.to_utc(day.serial_time() * SECONDS_PER_DAY + minute * 60);
+  int64_t days = utc / SECONDS_PER_DAY - (utc % SECONDS_PER_DAY < 0);
+  std::chrono::sys_days d{std::chrono::days{days}};
+  line.append(";TZID=UTC:");
+  append_local_tstamp(line, Date(d), static_cast<int>((utc - days * SECONDS_PER_DAY) / 60));
+  return line;
+}
+
+//TODO: this is still not a complete icalendar parser. it understands
+//the subset of properties written by Calendar::save_events.
+bool parse_ics(std::string_view buf, std::vector<Event> &events, StringArena &arena,
+               const TimeZone &display) {
+  std::string_view title;
+  std::string_view tag;
+  std::string_view uid;
+  std::string_view rrule;
+  std::string_view begin_value, begin_params;
+  std::string_view end_value, end_params;
+  ZoneCache zones;
+
+  size_t pos = 0;
+  while(pos < buf.length()) {
+    const char *nl = static_cast<const char *>(
+        memchr(buf.data() + pos, '\n', buf.length() - pos));
+    size_t eol = nl ? static_cast<size_t>(nl - buf.data()) : buf.length();
+    std::string_view line = buf.substr(pos, eol - pos);
+    pos = eol + 1;
+
+    if(!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    //folded continuation lines are not supported yet
+    if(!line.empty() && line[0] == ' ') continue;
+
+    size_t colon = line.find(':');
+    if(line.empty() || colon == std::string_view::npos) return false;
+    std::string_view key   = line.substr(0, colon);
+    std::string_view value = line.substr(colon + 1);
+    std::string_view params;
+    size_t semi = key.find(';');
+    if(semi != std::string_view::npos) {
+      params = key.substr(semi + 1);
+      key = key.substr(0, semi);
+    }
+
+    //every event starts from scratch so chunks can be parsed on their own
+    if(key == "BEGIN" && value == "VEVENT") {
+      title = tag = uid = rrule = std::string_view();
+      begin_value = begin_params = end_value = end_params = std::string_view();
+    }
+    else if(key == "UID") uid = value;
+    else if(key == "RRULE") rrule = value;
+    else if(key == "SUMMARY") title = value;
+    else if(key == "DESCRIPTION") tag = value;
+    else if(key == "DTSTART") {
+      begin_value = value;
+      begin_params = params;
+    }
+    else if(key == "DTEND") {
+      end_value = value;
+      end_params = params;
+    }
+    else if(key == "END" && value == "VEVENT") {
+      //whether the event is all day depends on both ends
+      IcsTime begin, end;
+      convert_span(begin_value, begin_params, end_value, end_params, display, zones, begin, end);
+      events.emplace_back(arena.store(title), tag, begin.day, end.day, arena.store(uid));
+      if(begin.minute != Event::ALL_DAY) events.back().set_times(begin.minute, end.minute);
+      if(!rrule.empty()) {
+        events.back().set_rule(Recurrence::parse(rrule, static_cast<int32_t>(begin.day.serial_time())));
+      }
+    }
+  }
+  return true;
+}
+
+void parse_ics_parallel(std::string_view buf, std::vector<Event> &events, StringArena &arena,
+                        unsigned threads, size_t min_chunk, const TimeZone &display) {
+  if(threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  //a few chunks per thread even out chunks of denser events
+  size_t chunks = std::min<size_t>(threads * 4, buf.length() / std::max<size_t>(min_chunk, 1));
+  if(threads == 1 || chunks < 2) {
+    parse_ics(buf, events, arena, display);
+    return;
+  }
+
+  //chunks start on BEGIN:VEVENT lines, the first one also holds the header
+  std::vector<size_t> starts{0};
+  for(size_t i = 1; i < chunks; ++i) {
+    size_t at = buf.find("\nBEGIN:VEVENT", std::max(i * (buf.length() / chunks), starts.back()));
+    if(at == std::string_view::npos) break;
+    starts.push_back(at + 1);
+  }
+  starts.push_back(buf.length());
+  size_t n = starts.size() - 1;
+
+  struct Chunk {
+    std::vector<Event> events;
+    StringArena arena;
+    bool complete = true;
+    std::exception_ptr error;
+  };
+  std::vector<Chunk> parsed(n);
+  std::atomic<size_t> next(0);
+  auto work = [&] {
+    for(size_t i = next++; i < n; i = next++) {
+      try {
+        parsed[i].complete = parse_ics(buf.substr(starts[i], starts[i + 1] - starts[i]),
+                                       parsed[i].events, parsed[i].arena, display);
+      } catch(...) {
+        parsed[i].error = std::current_exception();
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  for(size_t t = 1; t < std::min<size_t>(threads, n); ++t) pool.emplace_back(work);
+  work();
+  for(std::thread &t : pool) t.join();
+
+  //merge in file order, stopping where the sequential parse would have
+  size_t total = 0;
+  for(const Chunk &chunk : parsed) total += chunk.events.size();
+  events.reserve(events.size() + total);
+  for(Chunk &chunk : parsed) {
+    if(chunk.error) std::rethrow_exception(chunk.error);
+    events.insert(events.end(), chunk.events.begin(), chunk.events.end());
+    arena.absorb(std::move(chunk.arena));
+    if(!chunk.complete) break;
+  }
+}
@@ -0,0 +1,115 @@
+#ifndef ICS_H
+#define ICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "arena.h"
+#include "config.h"
+#include "datetime.h"
+#include "zone.h"
+
+//read-only memory mapping of a whole file. a missing or empty file
+//maps to an empty view so callers can treat it as an empty calendar.
+class MappedFile {
+private:
+  const char *data;
+  size_t size;
+
+public:
+  // === Constructors ===
+
+  //map file at path read-only
+  MappedFile(const std::string &path);
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // === Accessors ===
+
+  //return contents of the mapping
+  std::string_view view() const;
+};
+
+//replace the file at path with data. data goes to a temporary file next
+//to path that is fsynced and renamed over path, so a crash or a full disk
+//leaves either the old or the new file. throws std::runtime_error on
+//failure, leaving path untouched. caches that are checked on load and
+//rebuilt when bad pass durable false to skip the fsyncs.
+void replace_file(const std::string &path, std::string_view data, bool durable = true);
+
+//exclusive advisory lock on the file at path, created if missing, held
+//until destruction. blocks while another process holds it.
+class FileLock {
+private:
+  int fd;
+
+public:
+  // === Constructors ===
+
+  //lock path, throws std::runtime_error if it cannot be opened
+  FileLock(const std::string &path);
+  ~FileLock();
+  FileLock(const FileLock &) = delete;
+  FileLock &operator=(const FileLock &) = delete;
+};
+
+//64 bit FNV-1a hash of len bytes at data
+uint64_t fnv1a(const char *data, size_t len);
+
+//parse the leading YYYYMMDD digits of an ics timestamp into a Date.
+//throws std::invalid_argument if the digits are missing or invalid.
+Date parse_tstamp(std::string_view value);
+
+//a DTSTART or DTEND converted to the display zone
+struct IcsTime {
+  Date day;
+  int minute; //minutes after midnight, Event::ALL_DAY for a date
+};
+
+//parse a DATE or DATE-TIME value with the property parameters params
+//(e.g. "TZID=Europe/Berlin") into display zone time. utc times end in
+//Z, times with an unknown TZID or none are taken as display zone times.
+//throws std::invalid_argument if value is malformed.
+IcsTime parse_ics_time(std::string_view value, std::string_view params = std::string_view(),
+                       const TimeZone &display = TimeZone::local());
+
+//parse the begin and end timestamps of one event, as journal records and
+//daemon requests carry them, into the form Event keeps. the event is all
+//day only if both are dates or T000000Z, which all day events have always
+//been saved with. a timed event ending at midnight ends at MINUTES_PER_DAY
+//of the day before, and a timed event whose end has no time ends with its
+//day. throws std::invalid_argument if either is malformed.
+void parse_ics_span(std::string_view begin_value, std::string_view end_value,
+                    IcsTime &begin, IcsTime &end, const TimeZone &display = TimeZone::local());
+
+//return the timestamp journal records and daemon requests carry for a
+//day and time: to_tz_tstamp for an all day date, else a floating
+//YYYYMMDDTHHMMSS in the display zone
+std::string format_tstamp(const Date &day, int minute);
+
+//return the ics property key (DTSTART or DTEND) for a day and time,
+//with parameters and value. timed values name the display zone in a
+//TZID parameter so other calendars read them correctly.
+std::string format_ics_time(std::string_view key, const Date &day, int minute,
+                            const TimeZone &display = TimeZone::local());
+
+//parse VEVENTs in buf and append them to events. keys and values are
+//string_views into buf; titles and uids are copied into arena when an
+//Event is built. an RRULE outside the subset Recurrence supports leaves
+//the event as a single occurrence. times are converted to display.
+//returns false if parsing stopped early at a line that is not a property.
+bool parse_ics(std::string_view buf, std::vector<Event> &events, StringArena &arena,
+               const TimeZone &display = TimeZone::local());
+
+//parse_ics on up to threads threads, one per core for 0. buf is split
+//into chunks of at least min_chunk bytes on BEGIN:VEVENT lines, each
+//parsed into its own events and arena, which are appended to events and
+//arena in file order. the result is the same as parse_ics gives.
+void parse_ics_parallel(std::string_view buf, std::vector<Event> &events, StringArena &arena,
+                        unsigned threads, size_t min_chunk = PARSE_CHUNK_SIZE,
+                        const TimeZone &display = TimeZone::local());
+
+#endif
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <climits>
+#include <numeric>
+
+#include "config.h"
+#include "index.h"
+
+// === EventIndex ===
+EventIndex::EventIndex() : events(nullptr) {}
+
+EventIndex::EventIndex(const std::vector<Event> *events) : events(nullptr) {
+  build(events);
+}
+
+void EventIndex::build(const std::vector<Event> *events) {
+  this->events = events;
+  size_t n = events->size();
+
+  order.resize(n);
+  std::iota(order.begin(), order.end(), 0);
+  //loads produce sorted events, only journal replays append out of order
+  auto before = [events](uint32_t x, uint32_t y) {
+    return Event::starts_before((*events)[x], (*events)[y]);
+  };
+  if(!std::is_sorted(order.begin(), order.end(), before)) {
+    std::stable_sort(order.begin(), order.end(), before);
+  }
+
+  singles.clear();
+  begins.clear();
+  ends.clear();
+  longs.clear();
+  long_begins.clear();
+  long_ends.clear();
+  long_max_end.clear();
+  series.clear();
+  singles.reserve(n);
+  begins.reserve(n);
+  ends.reserve(n);
+  std::vector<uint32_t> sorted;
+  sorted.swap(order);
+  order.reserve(n);
+  for(uint32_t i : sorted) push(i);
+}
+
+void EventIndex::push(uint32_t i) {
+  const Event &e = (*events)[i];
+  order.push_back(i);
+  if(e.recurs()) {
+    series.push_back(i);
+    return;
+  }
+  long int begin = e.get_begin().serial_time();
+  long int end = e.get_end().serial_time();
+  if(end - begin > INDEX_SHORT_EVENT_DAYS) {
+    longs.push_back(i);
+    long_begins.push_back(begin);
+    long_ends.push_back(end);
+    long_max_end.push_back(long_max_end.empty() ? end : std::max(long_max_end.back(), end));
+    return;
+  }
+  singles.push_back(i);
+  begins.push_back(begin);
+  ends.push_back(end);
+}
+
+void EventIndex::extend() {
+  size_t n = events->size();
+  for(size_t i = order.size(); i < n; ++i) {
+    if(!order.empty() && Event::starts_before((*events)[i], (*events)[order.back()])) {
+      build(events);
+      return;
+    }
+    push(static_cast<uint32_t>(i));
+  }
+}
+
+size_t EventIndex::size() const {
+  return order.size();
+}
+
+const Event &EventIndex::operator[](size_t i) const {
+  return (*events)[order[i]];
+}
+
+//return the first position of long events that may end on or after from
+//among those beginning before position last
+static size_t first_long(const std::vector<long int> &long_max_end, size_t last, long int from) {
+  return static_cast<size_t>(
+      std::lower_bound(long_max_end.begin(), long_max_end.begin() + static_cast<long>(last), from)
+      - long_max_end.begin());
+}
+
+void EventIndex::query(const TimeRange &range, std::vector<const Event *> &out) const {
+  long int range_begin = range.get_begin().serial_time();
+  long int range_end = range.get_end().serial_time();
+  size_t start = out.size();
+
+  //short candidates begin no later than the range ends and no earlier than
+  //the longest a short event lasts before it begins
+  size_t last = static_cast<size_t>(
+      std::upper_bound(begins.begin(), begins.end(), range_end) - begins.begin());
+  size_t first = static_cast<size_t>(
+      std::lower_bound(begins.begin(), begins.begin() + static_cast<long>(last),
+                       range_begin - INDEX_SHORT_EVENT_DAYS) - begins.begin());
+  for(size_t i = first; i < last; ++i) {
+    if(ends[i] >= range_begin) out.push_back(&(*events)[singles[i]]);
+  }
+
+  //long candidates start at the first position where one ends inside the range
+  size_t middle = out.size();
+  last = static_cast<size_t>(
+      std::upper_bound(long_begins.begin(), long_begins.end(), range_end) - long_begins.begin());
+  for(size_t i = first_long(long_max_end, last, range_begin); i < last; ++i) {
+    if(long_ends[i] >= range_begin) out.push_back(&(*events)[longs[i]]);
+  }
+  std::inplace_merge(out.begin() + static_cast<long>(start), out.begin() + static_cast<long>(middle),
+                     out.end(), [](const Event *x, const Event *y) { return Event::starts_before(*x, *y); });
+}
+
+void EventIndex::query_series(const TimeRange &range, std::vector<const Event *> &out) const {
+  long int range_begin = range.get_begin().serial_time();
+  long int range_end = range.get_end().serial_time();
+  for(uint32_t i : series) {
+    const Event &e = (*events)[i];
+    //series are in start order, later ones start after the range
+    if(e.get_begin().serial_time() > range_end) break;
+    if(e.series_end() >= range_begin) out.push_back(&e);
+  }
+}
+
+//return the Date of day serial
+static Date serial_date(long int serial) {
+  std::chrono::sys_days d{std::chrono::days{serial}};
+  return Date(d);
+}
+
+void EventIndex::upcoming(long int from, long int last, size_t count,
+                          std::vector<Event> &out) const {
+  if(count == 0) return;
+  auto before = [](const Event *x, const Event *y) { return Event::starts_before(*x, *y); };
+
+  //short events from the first that can still be in progress on from, long
+  //ones from the first position where one ends on or after from. each list
+  //is in starts_before order, so its first count make the merged first count.
+  std::vector<const Event *> found;
+  size_t i = static_cast<size_t>(
+      std::lower_bound(begins.begin(), begins.end(), from - INDEX_SHORT_EVENT_DAYS) - begins.begin());
+  for(; i < singles.size() && found.size() < count && begins[i] <= last; ++i) {
+    if(ends[i] >= from) found.push_back(&(*events)[singles[i]]);
+  }
+  size_t shorts = found.size();
+  for(i = first_long(long_max_end, longs.size(), from);
+      i < longs.size() && found.size() - shorts < count && long_begins[i] <= last; ++i) {
+    if(long_ends[i] >= from) found.push_back(&(*events)[longs[i]]);
+  }
+  std::inplace_merge(found.begin(), found.begin() + static_cast<long>(shorts), found.end(), before);
+  if(found.size() > count) found.resize(count);
+
+  //occurrences starting after the count'th single cannot make the list
+  long int horizon = (found.size() == count) ? found.back()->get_begin().serial_time() : last;
+  std::vector<Event> occurring;
+  if(!series.empty()) {
+    long int latest = LONG_MIN;
+    for(uint32_t s : series) latest = std::max(latest, (*events)[s].series_end());
+    //endless series have no last day, widen the window until the events
+    //in it are enough
+    long int span = 31;
+    std::vector<const Event *> expanding;
+    while(true) {
+      //a horizon before from is an event still in progress on from
+      long int end = std::max(from, std::min(horizon, from + span));
+      TimeRange window(serial_date(from), serial_date(end));
+      occurring.clear();
+      expanding.clear();
+      query_series(window, expanding);
+      for(const Event *e : expanding) e->occurrences(window, occurring);
+      size_t known = occurring.size() + static_cast<size_t>(
+          std::count_if(found.begin(), found.end(),
+                        [end](const Event *e) { return e->get_begin().serial_time() <= end; }));
+      if(end >= horizon || end >= latest || known >= count || span > (1l << 20)) break;
+      span *= 2;
+    }
+  }
+
+  std::vector<const Event *> merged;
+  merged.reserve(found.size() + occurring.size());
+  for(const Event &e : occurring) merged.push_back(&e);
+  std::sort(merged.begin(), merged.end(), before);
+  long middle = static_cast<long>(merged.size());
+  merged.insert(merged.end(), found.begin(), found.end());
+  std::inplace_merge(merged.begin(), merged.begin() + middle, merged.end(), before);
+  for(size_t k = 0; k < merged.size() && k < count; ++k) out.push_back(*merged[k]);
+}
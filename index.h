@@ -0,0 +1,71 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <cstdint>
+#include <vector>
+#include "datetime.h"
+
+//interval index over a vector of events. events are kept as a permutation
+//sorted by Event::starts_before. single events lasting at most
+//INDEX_SHORT_EVENT_DAYS are also kept with their begin dates, so the ones
+//overlapping a range begin at most that many days before it and are found
+//with two binary searches and a scan over the candidates between them.
+//longer events are kept apart with a running maximum of end dates, so one
+//of them does not make that scan start earlier, and recurring series,
+//which may never end, are kept apart from both.
+class EventIndex {
+private:
+  const std::vector<Event> *events;
+  std::vector<uint32_t> order;
+  std::vector<uint32_t> singles;      //short single events in starts_before order
+  std::vector<long int> begins;       //begin serial of events[singles[i]]
+  std::vector<long int> ends;         //end serial of events[singles[i]]
+  std::vector<uint32_t> longs;        //long single events in starts_before order
+  std::vector<long int> long_begins;  //begin serial of events[longs[i]]
+  std::vector<long int> long_ends;    //end serial of events[longs[i]]
+  std::vector<long int> long_max_end; //max of long_ends[0..i]
+  std::vector<uint32_t> series;       //recurring events in starts_before order
+
+  //add events[i], which starts no earlier than any indexed event
+  void push(uint32_t i);
+
+public:
+  // === Constructors ===
+
+  //empty index
+  EventIndex();
+  //index over events. events must outlive the index and not be modified
+  //without calling build again.
+  EventIndex(const std::vector<Event> *events);
+
+  // === Modifiers ===
+
+  //(re)build the index over events. O(N) if events is already sorted.
+  void build(const std::vector<Event> *events);
+  //index events appended since the last build or extend. O(new events)
+  //if none of them starts before the last indexed event, else rebuilds.
+  void extend();
+
+  // === Accessors ===
+
+  //number of indexed events
+  size_t size() const;
+  //return the i'th event in starts_before order
+  const Event &operator[](size_t i) const;
+  //append single events overlapping range to out in starts_before order
+  void query(const TimeRange &range, std::vector<const Event *> &out) const;
+  //append recurring events with occurrences that may overlap range to out
+  //in starts_before order
+  void query_series(const TimeRange &range, std::vector<const Event *> &out) const;
+  //append to out, in starts_before order, the first count events or
+  //occurrences that end on or after day serial from and begin no later
+  //than day serial last. short single events are found with a binary
+  //search on begin dates and a scan that stops at the count'th, long ones
+  //from the first whose running maximum end reaches from, and series are
+  //expanded only up to where those scans stopped. the cost grows with the
+  //short events of the INDEX_SHORT_EVENT_DAYS before from and the long
+  //events after the oldest one still in progress, not with older history.
+  void upcoming(long int from, long int last, size_t count, std::vector<Event> &out) const;
+};
+
+#endif
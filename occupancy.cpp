@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+#include "datetime.h"
+#include "occupancy.h"
+
+// === Occupancy ===
+Occupancy::Occupancy() {}
+
+void Occupancy::set_days(std::vector<uint64_t> &bits, size_t first_day, size_t last_day) {
+  size_t first_word = first_day / 64;
+  size_t last_word = last_day / 64;
+  uint64_t head = ~0ull << (first_day % 64);
+  uint64_t tail = ~0ull >> (63 - last_day % 64);
+  if(first_word == last_word) {
+    bits[first_word] |= head & tail;
+    return;
+  }
+  bits[first_word] |= head;
+  for(size_t w = first_word + 1; w < last_word; ++w) bits[w] = ~0ull;
+  bits[last_word] |= tail;
+}
+
+void Occupancy::build(const TimeRange &range, const std::vector<const Event *> &events,
+                      const std::vector<std::string> &tags) {
+  long int first = range.get_begin().serial_time();
+  long int last = range.get_end().serial_time();
+  size_t days = static_cast<size_t>(last - first + 1);
+
+  tag_keys.clear();
+  tag_days.clear();
+  for(const std::string &tag : tags) {
+    tag_keys.push_back(Event::tag_key(tag));
+    tag_days.emplace_back((days + 63) / 64, 0);
+  }
+
+  //each event adds one at its first day in range and removes one the day
+  //after its last, so a running sum over the days gives the counts
+  std::vector<int> delta(days + 1, 0);
+  for(const Event *e : events) {
+    long int b = std::max(e->get_begin().serial_time(), first);
+    long int end = std::min(e->get_end().serial_time(), last);
+    if(b > end) continue;
+    size_t b_day = static_cast<size_t>(b - first);
+    size_t e_day = static_cast<size_t>(end - first);
+    ++delta[b_day];
+    --delta[e_day + 1];
+    for(size_t t = 0; t < tag_keys.size(); ++t) {
+      if(e->tag_key() == tag_keys[t]) set_days(tag_days[t], b_day, e_day);
+    }
+  }
+  counts.assign(days, 0);
+  int running = 0;
+  for(size_t d = 0; d < days; ++d) {
+    running += delta[d];
+    counts[d] = static_cast<unsigned>(running);
+  }
+}
+
+size_t Occupancy::size() const {
+  return counts.size();
+}
+
+const std::vector<unsigned> &Occupancy::get_counts() const {
+  return counts;
+}
+
+unsigned Occupancy::peak(size_t day, size_t n) const {
+  unsigned most = 0;
+  for(size_t d = day; d < day + n; ++d) most = std::max(most, counts[d]);
+  return most;
+}
+
+unsigned Occupancy::peak() const {
+  return peak(0, counts.size());
+}
+
+size_t Occupancy::busy_days(size_t day, size_t n) const {
+  size_t busy = 0;
+  for(size_t d = day; d < day + n; ++d) busy += counts[d] != 0;
+  return busy;
+}
+
+size_t Occupancy::tag_days_in(const std::vector<std::string> &tags, size_t day, size_t n) const {
+  if(n == 0 || tags.empty()) return 0;
+  size_t first_word = day / 64;
+  size_t last_word = (day + n - 1) / 64;
+
+  //intersect the bitsets of the tags word by word
+  std::vector<uint64_t> both;
+  for(const std::string &tag : tags) {
+    uint32_t key = Event::tag_key(tag);
+    size_t t = static_cast<size_t>(std::find(tag_keys.begin(), tag_keys.end(), key) - tag_keys.begin());
+    if(t == tag_keys.size()) throw std::invalid_argument("Tag " + tag + " is not tracked");
+    const uint64_t *bits = tag_days[t].data();
+    if(both.empty()) {
+      both.assign(bits + first_word, bits + last_word + 1);
+      continue;
+    }
+    for(size_t w = 0; w < both.size(); ++w) both[w] &= bits[first_word + w];
+  }
+  both.front() &= ~0ull << (day % 64);
+  both.back() &= ~0ull >> (63 - (day + n - 1) % 64);
+
+  size_t total = 0;
+  for(uint64_t word : both) total += static_cast<size_t>(std::popcount(word));
+  return total;
+}
@@ -0,0 +1,58 @@
+#ifndef OCCUPANCY_H
+#define OCCUPANCY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Event;
+class TimeRange;
+
+//event coverage of the days of a range, built in one pass over its
+//events: the number of events on each day, and for tags asked for a
+//bitset of the days with at least one event of the tag. aggregations run
+//as plain loops over those arrays, written so the compiler vectorizes
+//them. day i is the i'th day of the range.
+class Occupancy {
+private:
+  std::vector<unsigned> counts;
+  //tags tracked, as Event::tag_key, and their day bitsets, 64 days a word
+  std::vector<uint32_t> tag_keys;
+  std::vector<std::vector<uint64_t> > tag_days;
+
+  //set the bits of days first to last in bits
+  static void set_days(std::vector<uint64_t> &bits, size_t first, size_t last);
+
+public:
+  // === Constructors ===
+
+  //no days
+  Occupancy();
+
+  // === Modifiers ===
+
+  //count the events of events, in start order, on each day of range and
+  //collect the day bitsets of tags
+  void build(const TimeRange &range, const std::vector<const Event *> &events,
+             const std::vector<std::string> &tags = std::vector<std::string>());
+
+  // === Accessors ===
+
+  //return the number of days
+  size_t size() const;
+  //return the number of events on each day
+  const std::vector<unsigned> &get_counts() const;
+  //return the most events on one day of days [day, day + n)
+  unsigned peak(size_t day, size_t n) const;
+  //return the most events on any one day
+  unsigned peak() const;
+  //return the number of days of [day, day + n) with at least one event
+  size_t busy_days(size_t day, size_t n) const;
+  //return the number of days of [day, day + n) with an event of every
+  //tag in tags, which must have been passed to build
+  size_t tag_days_in(const std::vector<std::string> &tags, size_t day, size_t n) const;
+};
+
+#endif
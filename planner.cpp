@@ -1,7 +1,49 @@
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <new>
 #include "cal.h"
 #include "config.h"
+#include "daemon.h"
+#include "freebusy.h"
+#include "ics.h"
+#include "profile.h"
+#include "sources.h"
 #include <getopt.h>
+#include <unistd.h>
+
+#ifdef PLANNER_PROFILE
+//count allocations for --profile
+void *operator new(size_t size) {
+  PROFILE_COUNT(COUNT_ALLOCATIONS, 1);
+  if(void *p = malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+static void print_profile() {
+  profile_report(std::cerr, profile.json);
+}
+#endif
+
+//socket of the daemon serving the calendar at DEFAULT_SAVE_PATH
+static const std::string SOCKET_PATH = std::string(DEFAULT_SAVE_PATH) + DAEMON_SOCKET_SUFFIX;
+
+//the number arg of --option holds, exiting if it is not one of at least min
+static int number_arg(const char *arg, int min, const char *option) {
+  char *end;
+  long value = strtol(arg, &end, 10);
+  if(end == arg || *end != '\0' || value < min || value > INT_MAX) {
+    std::cerr << "planner: --" << option << " expects a number of at least " << min
+              << ", got '" << arg << "'" << std::endl;
+    exit(1);
+  }
+  return static_cast<int>(value);
+}
 
 
 struct option longOpts[] = {{"help", no_argument, nullptr, 'h'},
@@ -11,10 +53,55 @@ struct option longOpts[] = {{"help", no_argument, nullptr, 'h'},
                               {"remove", optional_argument, nullptr, 'r'},
                               {"summary", no_argument, nullptr, 's'},
                               {"list", no_argument, nullptr, 'l'},
+                              {"profile", optional_argument, nullptr, 'P'},
+                              {"daemon", no_argument, nullptr, 'D'},
+                              {"day", optional_argument, nullptr, 'd'},
+                              {"threads", required_argument, nullptr, 'j'},
+                              {"calendar", required_argument, nullptr, 'c'},
+                              {"to", required_argument, nullptr, 't'},
+                              {"agenda", required_argument, nullptr, 'a'},
+                              {"agenda-days", required_argument, nullptr, 'A'},
+                              {"free", required_argument, nullptr, 'F'},
+                              {"conflicts", no_argument, nullptr, 'C'},
+                              {"stats", optional_argument, nullptr, 'S'},
+                              {"search", required_argument, nullptr, 'q'},
+                              {"batch", no_argument, nullptr, 'b'},
                               {nullptr, 0, nullptr, '\0'}};
 
 int main(int argc, char** argv) {
-  Calendar c = Calendar();
+  //calendars named with --calendar, else the one at DEFAULT_SAVE_PATH.
+  //the daemon serves only the default calendar.
+  CalendarSources c;
+  bool use_daemon = true;
+  std::string target;
+  //--agenda and --agenda-days, printed once all options are read
+  bool agenda = false;
+  size_t agenda_count = SIZE_MAX;
+  unsigned agenda_days = 0;
+  //--free, printed over the range once all options are read
+  unsigned free_days = 0;
+  //--stats and the tags it counts days of, printed over the range
+  bool stats = false;
+  std::string stats_tags;
+  //--search, over all dates unless --month or --year narrow it
+  bool search = false;
+  bool range_given = false;
+  std::string search_query;
+  auto load = [&c, &use_daemon] {
+    if(use_daemon) c.add_source(DEFAULT_SAVE_PATH);
+    c.load_events();
+  };
+  //answer request from the daemon if one is running. a request the daemon
+  //fails exits the way the same failure would without it.
+  auto served = [&use_daemon](const std::string &request) {
+    if(!use_daemon) return false;
+    try {
+      return daemon_request(SOCKET_PATH, request, STDOUT_FILENO);
+    } catch(std::exception &ex) {
+      std::cerr << "planner: " << ex.what() << std::endl;
+      exit(1);
+    }
+  };
   std::chrono::sys_days today_serial;
   Date today;
   int option, param;
@@ -25,6 +112,14 @@ int main(int argc, char** argv) {
     today = Date(today_serial);
   } 
 
+  if(profile_init(argc, argv)) {
+#ifdef PLANNER_PROFILE
+    atexit(print_profile);
+#else
+    std::cerr << "planner: built without profiling, rebuild with make profile" << std::endl;
+#endif
+  }
+
   int begin_year = today.year();
   int end_year = today.year();
   unsigned begin_month = today.month();
@@ -33,7 +128,7 @@ int main(int argc, char** argv) {
   unsigned end_day = DAYS_IN_MONTH[end_month];
   if(end_month == 2 && !std::chrono::year{end_year}.is_leap()) --end_day;
 
-  option = getopt_long(argc, argv, "hm:y:nr::sl", longOpts, 0);
+  option = getopt_long(argc, argv, "hm:y:nr::sld::j:c:t:a:A:F:CS::q:b", longOpts, 0);
   while(option) {
     if(option == -1) break;
     switch (option) {
@@ -46,6 +141,7 @@ int main(int argc, char** argv) {
       param = atoi(optarg);
       if(param < 1 || param > 12) break; //TODO handle
       begin_month = static_cast<unsigned>(param);
+      range_given = true;
       begin_day = 1;
       end_month = begin_month;
       end_day = (param == 2 && !std::chrono::year{end_year}.is_leap()) ?
@@ -56,29 +152,98 @@ int main(int argc, char** argv) {
       param = atoi(optarg);
       begin_year = param;
       end_year = param;
+      range_given = true;
       end_day = (end_month == 2 && !std::chrono::year{param}.is_leap()) ?
         DAYS_IN_MONTH[end_month]-1 : DAYS_IN_MONTH[end_month];
       break;
   
     case 'n':
-      c.load_events(DEFAULT_SAVE_PATH);
-      c.new_event();
-      c.save_events(DEFAULT_SAVE_PATH);
+    case 'C': {
+      std::string title, tag;
+      Date begin, end;
+      int begin_minute, end_minute;
+      try {
+        Calendar::prompt_event(title, tag, begin, end, begin_minute, end_minute);
+      } catch(std::exception &ex) {
+        std::cerr << "planner: " << ex.what() << std::endl;
+        exit(1);
+      }
+      //events the new one overlaps are shown before it is added
+      std::string times = format_tstamp(begin, begin_minute) + "\t" + format_tstamp(end, end_minute);
+      std::string request = "ADD\t" + times + "\t" + tag + "\t" + title;
+      if(served("CONFLICTS\t" + times)) {
+        if(option == 'n') served(request);
+        exit(0);
+      }
+      try {
+        load();
+        Event added(title, tag, begin, end);
+        added.set_times(begin_minute, end_minute);
+        c.print_conflicts(added);
+        if(option == 'C') exit(0);
+        c.add_new_event(target, title, tag, begin, end, begin_minute, end_minute);
+        c.commit_events();
+      } catch(std::exception &ex) {
+        std::cerr << "planner: " << ex.what() << std::endl;
+        exit(1);
+      }
       exit(0);
+    }
  
-    case 'r':
-      c.load_events(DEFAULT_SAVE_PATH);
+    case 'r': {
+      std::string tag;
       if(optarg) {
         if(optarg[0] != '=') {
           //TODO handle
           exit(0);
         }
-        c.remove_event(optarg+1);
+        tag = optarg+1;
       } else {
-        c.remove_event();
+        std::cout << "Enter Event Tag: ";
+        std::cin >> tag;
+      }
+      if(served("REMOVE\t" + tag)) exit(0);
+      try {
+        load();
+        c.remove_event(tag);
+        c.commit_events();
+      } catch(std::exception &ex) {
+        std::cerr << "planner: " << ex.what() << std::endl;
+        exit(1);
       }
-      c.save_events(DEFAULT_SAVE_PATH);
       exit(0);
+    }
+
+    case 'b': {
+      //adds and removals from stdin, applied together or not at all. with
+      //several calendars a failed commit says which were already written
+      std::vector<BatchRecord> records;
+      std::vector<BatchError> errors;
+      read_batch(std::cin, records, errors);
+      size_t applied = 0;
+      if(errors.empty()) {
+        try {
+          load();
+          applied = c.apply_batch(target, records, errors);
+        } catch(std::exception &ex) {
+          std::cerr << "planner: " << ex.what() << std::endl;
+          exit(1);
+        }
+      }
+      if(!errors.empty()) {
+        write_batch_errors(errors, std::cerr);
+        std::cerr << "planner: " << errors.size() << " record(s) failed, nothing was changed" << std::endl;
+        exit(1);
+      }
+      try {
+        c.commit_events();
+      } catch(std::exception &ex) {
+        std::cerr << "planner: " << ex.what() << std::endl;
+        exit(1);
+      }
+      std::cout << applied << " change(s) applied" << std::endl;
+      exit(0);
+    }
 
     case 's':
       today.change_day(0 - static_cast<int>(today.weekday_index()));
@@ -92,21 +257,145 @@ int main(int argc, char** argv) {
       break;
 
     case 'l':
-      c.load_events(DEFAULT_SAVE_PATH);
+      if(served("LIST")) exit(0);
+      load();
       c.list_events();
-      c.save_events(DEFAULT_SAVE_PATH);
+      exit(0);
+
+    case 'P':
+      //handled by profile_init
+      break;
+
+    case 'j':
+      //threads to parse the save file with, before the command using it
+      param = number_arg(optarg, 0, "threads");
+      Calendar::set_parse_threads(static_cast<unsigned>(param));
+      break;
+
+    case 'c':
+      //a calendar file or directory of them, before the command using it
+      try {
+        c.add_source(optarg);
+      } catch(std::exception &ex) {
+        std::cerr << "planner: " << ex.what() << std::endl;
+        exit(1);
+      }
+      use_daemon = false;
+      break;
+
+    case 'a':
+      param = number_arg(optarg, 1, "agenda");
+      agenda = true;
+      agenda_count = static_cast<size_t>(param);
+      break;
+
+    case 'A':
+      param = number_arg(optarg, 1, "agenda-days");
+      agenda = true;
+      agenda_days = static_cast<unsigned>(param);
+      break;
+
+    case 'F':
+      param = number_arg(optarg, 1, "free");
+      free_days = static_cast<unsigned>(param);
+      break;
+
+    case 'q':
+      search = true;
+      search_query = optarg;
+      break;
+
+    case 'S':
+      //--stats=TAG,TAG counts the days with events of each tag
+      stats = true;
+      if(optarg) stats_tags = optarg[0] == '=' ? optarg + 1 : optarg;
+      break;
+
+    case 't':
+      //the calendar --new adds to, by file name without extension
+      target = optarg;
+      break;
+
+    case 'd': {
+      //day view of today or of --day=MM/DD/YYYY
+      Date day = today;
+      if(optarg) {
+        unsigned m, d;
+        int y;
+        if(sscanf(optarg[0] == '=' ? optarg + 1 : optarg, "%u/%u/%d", &m, &d, &y) != 3) {
+          std::cerr << "planner: expected --day=MM/DD/YYYY" << std::endl;
+          exit(1);
+        }
+        day = Date(y, m, d);
+      }
+      if(served("DAY\t" + day.to_tz_tstamp())) {
+        exit(0);
+      }
+      load();
+      c.set_range(day.year(), day.month(), day.day(), day.year(), day.month(), day.day());
+      c.print_day();
+      exit(0);
+    }
+
+    case 'D':
+      try {
+        run_daemon(DEFAULT_SAVE_PATH, SOCKET_PATH);
+      } catch(std::exception &ex) {
+        std::cerr << "planner: " << ex.what() << std::endl;
+        exit(1);
+      }
       exit(0);
 
     default:
       break;
     }
-    option = getopt_long(argc, argv, "hm:y:nr::sl", longOpts, 0);
+    option = getopt_long(argc, argv, "hm:y:nr::sld::j:c:t:a:A:F:CS::q:b", longOpts, 0);
+  }
+
+  if(agenda) {
+    Date from = get_todays_date();
+    std::string request = "AGENDA\t" + from.to_tz_tstamp() + "\t" + std::to_string(agenda_count)
+                        + "\t" + std::to_string(agenda_days);
+    if(served(request)) return 0;
+    load();
+    c.print_agenda(from, agenda_count, agenda_days);
+    return 0;
   }
 
-  c.load_events(DEFAULT_SAVE_PATH);
+  Date begin = Date(begin_year, begin_month, begin_day);
+  Date end = Date(end_year, end_month, end_day);
+  if(free_days > 0) {
+    std::string request = "FREE\t" + begin.to_tz_tstamp() + "\t" + end.to_tz_tstamp() + "\t"
+                        + std::to_string(free_days);
+    if(served(request)) return 0;
+    load();
+    c.set_range(begin_year, begin_month, begin_day, end_year, end_month, end_day);
+    c.print_free(free_days);
+    return 0;
+  }
+  if(search) {
+    std::string request = "SEARCH\t" + (range_given ? begin.to_tz_tstamp() : "") + "\t"
+                        + (range_given ? end.to_tz_tstamp() : "") + "\t" + search_query;
+    if(served(request)) return 0;
+    load();
+    std::optional<TimeRange> within;
+    if(range_given) within = TimeRange(begin, end);
+    c.print_search(search_query, within);
+    return 0;
+  }
+  if(stats) {
+    std::string request = "STATS\t" + begin.to_tz_tstamp() + "\t" + end.to_tz_tstamp() + "\t"
+                        + stats_tags;
+    if(served(request)) return 0;
+    load();
+    c.set_range(begin_year, begin_month, begin_day, end_year, end_month, end_day);
+    c.print_stats(split_tags(stats_tags));
+    return 0;
+  }
+  if(served("PRINT\t" + begin.to_tz_tstamp() + "\t" + end.to_tz_tstamp())) return 0;
+  load();
   c.set_range(begin_year, begin_month, begin_day, end_year, end_month, end_day);
   c.print();
-  c.save_events(DEFAULT_SAVE_PATH);
   /*
   unsigned last_day_of_range;
   std::chrono::sys_days today_serial;
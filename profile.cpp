@@ -0,0 +1,92 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+
+#include "profile.h"
+
+Profile profile = {};
+
+static const char *PHASE_NAMES[NUM_PHASES] = {
+  "load", "parse", "snapshot", "journal", "index",
+  "filter", "concurrency", "render", "save", "commit",
+  "search",
+};
+
+static const char *COUNTER_NAMES[NUM_COUNTERS] = {
+  "events_loaded", "events_in_range", "days_iterated", "bytes_written", "allocations",
+};
+
+bool profile_init(int argc, char **argv) {
+  const char *env = getenv("PLANNER_PROFILE");
+  if(env && *env && strcmp(env, "0") != 0) {
+    profile.enabled = true;
+    profile.json = strcmp(env, "json") == 0;
+  }
+  //scanned ahead of getopt so commands that exit while parsing are covered
+  for(int i = 1; i < argc; ++i) {
+    if(strcmp(argv[i], "--profile") == 0) {
+      profile.enabled = true;
+    } else if(strcmp(argv[i], "--profile=json") == 0) {
+      profile.enabled = true;
+      profile.json = true;
+    }
+  }
+  return profile.enabled;
+}
+
+void profile_report(std::ostream &out, bool json) {
+  if(json) {
+    out << "{\"phases\":{";
+    for(int i = 0; i < NUM_PHASES; ++i) {
+      out << (i ? "," : "") << "\"" << PHASE_NAMES[i] << "\":{\"ms\":" << std::fixed
+          << std::setprecision(3) << profile.seconds[i] * 1e3 << ",\"calls\":" << profile.calls[i] << "}";
+    }
+    out << "},\"counters\":{";
+    for(int i = 0; i < NUM_COUNTERS; ++i) {
+      out << (i ? "," : "") << "\"" << COUNTER_NAMES[i] << "\":" << profile.counters[i];
+    }
+    out << "}}" << std::endl;
+    return;
+  }
+
+  out << "profile:" << std::endl;
+  for(int i = 0; i < NUM_PHASES; ++i) {
+    if(profile.calls[i] == 0) continue;
+    out << "  " << std::left << std::setw(16) << PHASE_NAMES[i] << std::right << std::fixed
+        << std::setprecision(3) << std::setw(10) << profile.seconds[i] * 1e3 << " ms"
+        << std::setw(6) << profile.calls[i] << "x" << std::endl;
+  }
+  for(int i = 0; i < NUM_COUNTERS; ++i) {
+    out << "  " << std::left << std::setw(16) << COUNTER_NAMES[i] << std::right
+        << std::setw(10) << profile.counters[i] << std::endl;
+  }
+}
+
+void profile_reset() {
+  bool enabled = profile.enabled;
+  bool json = profile.json;
+  profile = Profile{};
+  profile.enabled = enabled;
+  profile.json = json;
+}
+
+#ifdef PLANNER_PROFILE
+
+static int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+PhaseTimer::PhaseTimer(Phase phase) : phase(phase), start_ns(profile.enabled ? now_ns() : 0) {}
+
+PhaseTimer::~PhaseTimer() {
+  if(!profile.enabled) return;
+  //calendars load on several threads, phases of each are added up
+  std::atomic_ref<double>(profile.seconds[phase]).fetch_add(static_cast<double>(now_ns() - start_ns) * 1e-9,
+                                                            std::memory_order_relaxed);
+  std::atomic_ref<uint64_t>(profile.calls[phase]).fetch_add(1, std::memory_order_relaxed);
+}
+
+#endif
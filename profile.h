@@ -0,0 +1,86 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+//phase timing and counters for --profile. builds without PLANNER_PROFILE
+//defined compile every PROFILE_* macro to nothing.
+
+enum Phase {
+  PHASE_LOAD,        //load_events, including the phases below
+  PHASE_PARSE,       //ics parse and sort
+  PHASE_SNAPSHOT,    //snapshot read and rebuild
+  PHASE_JOURNAL,     //journal replay
+  PHASE_INDEX,       //EventIndex build
+  PHASE_FILTER,      //events in range query
+  PHASE_CONCURRENCY, //concurrency profile
+  PHASE_RENDER,      //print_cal
+  PHASE_SAVE,        //save_events
+  PHASE_COMMIT,      //journal append
+  PHASE_SEARCH,      //search index load or build
+  NUM_PHASES
+};
+
+enum Counter {
+  COUNT_EVENTS_LOADED,
+  COUNT_EVENTS_IN_RANGE,
+  COUNT_DAYS_ITERATED,
+  COUNT_BYTES_WRITTEN,
+  COUNT_ALLOCATIONS,
+  NUM_COUNTERS
+};
+
+struct Profile {
+  bool enabled;
+  bool json;
+  double seconds[NUM_PHASES];
+  uint64_t calls[NUM_PHASES];
+  uint64_t counters[NUM_COUNTERS];
+};
+
+extern Profile profile;
+
+//enable profiling if PLANNER_PROFILE is set in the environment or argv has
+//--profile[=json]; returns whether profiling is enabled
+bool profile_init(int argc, char **argv);
+//write the report as one line per phase and counter, or as a JSON object
+void profile_report(std::ostream &out, bool json);
+//reset all phases and counters
+void profile_reset();
+
+#ifdef PLANNER_PROFILE
+
+//adds the time between construction and destruction to a phase
+class PhaseTimer {
+private:
+  Phase phase;
+  int64_t start_ns;
+
+public:
+  PhaseTimer(Phase phase);
+  ~PhaseTimer();
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer &operator=(const PhaseTimer &) = delete;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_PHASE(phase) PhaseTimer PROFILE_CONCAT(phase_timer_, __LINE__)(phase)
+#define PROFILE_COUNT(counter, n) \
+  do { \
+    if(profile.enabled) { \
+      std::atomic_ref<uint64_t>(profile.counters[counter]) \
+          .fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed); \
+    } \
+  } while(0)
+
+#else
+
+#define PROFILE_PHASE(phase) do {} while(0)
+#define PROFILE_COUNT(counter, n) do {} while(0)
+
+#endif
+
+#endif
@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <stdexcept>
+
+#include "datetime.h"
+#include "ics.h"
+#include "rrule.h"
+
+static const char *WEEKDAY_CODES[DAYS_IN_WEEK] = {"SU", "MO", "TU", "WE", "TH", "FR", "SA"};
+
+//weekday of day serial s, S=0 ... S=6
+static int weekday(int64_t s) {
+  int64_t w = (s + 4) % DAYS_IN_WEEK;
+  return static_cast<int>(w < 0 ? w + DAYS_IN_WEEK : w);
+}
+
+static int64_t floor_div(int64_t a, int64_t b) {
+  return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+//months since year 0 of day serial s
+static int64_t month_index(int32_t s) {
+  CivilDate c = civil_from_days(s);
+  return static_cast<int64_t>(c.year) * 12 + c.month - 1;
+}
+
+// === Recurrence ===
+Recurrence::Recurrence()
+  : freq(Frequency::NONE), byday(0), ordinal(0), pad(0), interval(1), pad2(0),
+    count(0), until(INT32_MAX), last(INT32_MAX) {}
+
+template <typename F>
+void Recurrence::for_each_start(int32_t dtstart, int32_t lo_day, int32_t hi_day, F emit) const {
+  int64_t lo = std::max(lo_day, dtstart);
+  int64_t hi = std::min(hi_day, last);
+  if(lo > hi) return;
+  int64_t step = interval;
+  CivilDate first_day = civil_from_days(dtstart);
+
+  switch(freq) {
+  case Frequency::DAILY: {
+    //first period at or after lo, BYDAY only filters
+    for(int64_t s = dtstart + (lo - dtstart + step - 1) / step * step; s <= hi; s += step) {
+      if(byday && !((byday >> weekday(s)) & 1)) continue;
+      if(!emit(static_cast<int32_t>(s))) return;
+    }
+    break;
+  }
+  case Frequency::WEEKLY: {
+    int64_t week0 = dtstart - (weekday(dtstart) + 6) % DAYS_IN_WEEK;
+    uint8_t days = byday ? byday : static_cast<uint8_t>(1 << weekday(dtstart));
+    int64_t period = std::max<int64_t>(0, floor_div(lo - week0, DAYS_IN_WEEK * step));
+    for(int64_t week = week0 + period * DAYS_IN_WEEK * step; week <= hi; week += DAYS_IN_WEEK * step) {
+      for(int offset = 0; offset < DAYS_IN_WEEK; ++offset) {
+        int64_t s = week + offset;
+        if(!((days >> weekday(s)) & 1) || s < lo || s > hi) continue;
+        if(!emit(static_cast<int32_t>(s))) return;
+      }
+    }
+    break;
+  }
+  case Frequency::MONTHLY: {
+    int64_t month0 = month_index(dtstart);
+    int64_t period = std::max<int64_t>(0, floor_div(month_index(static_cast<int32_t>(lo)) - month0, step));
+    for(int64_t m = month0 + period * step; ; m += step) {
+      int y = static_cast<int>(floor_div(m, 12));
+      unsigned month = static_cast<unsigned>(m - static_cast<int64_t>(y) * 12 + 1);
+      int64_t first = days_from_civil(y, month, 1);
+      if(first > hi) return;
+      unsigned length = days_in_month(y, month);
+      if(byday == 0) {
+        //months without the day of dtstart are skipped
+        int64_t s = first + first_day.day - 1;
+        if(first_day.day <= length && s >= lo && s <= hi && !emit(static_cast<int32_t>(s))) return;
+        continue;
+      }
+      for(unsigned d = 0; d < length; ++d) {
+        int64_t s = first + d;
+        if(!((byday >> weekday(s)) & 1)) continue;
+        int nth = static_cast<int>(d / DAYS_IN_WEEK) + 1;
+        int nth_last = -static_cast<int>((length - 1 - d) / DAYS_IN_WEEK) - 1;
+        if(ordinal != 0 && ordinal != nth && ordinal != nth_last) continue;
+        if(s < lo || s > hi) continue;
+        if(!emit(static_cast<int32_t>(s))) return;
+      }
+    }
+    break;
+  }
+  case Frequency::YEARLY: {
+    int64_t period = std::max<int64_t>(0, floor_div(civil_from_days(static_cast<int32_t>(lo)).year - first_day.year, step));
+    for(int64_t y = first_day.year + period * step; ; y += step) {
+      if(days_from_civil(static_cast<int>(y), 1, 1) > hi) return;
+      //february 29th only recurs in leap years
+      if(first_day.day > days_in_month(static_cast<int>(y), first_day.month)) continue;
+      int64_t s = days_from_civil(static_cast<int>(y), first_day.month, first_day.day);
+      if(s < lo || s > hi) continue;
+      if(!emit(static_cast<int32_t>(s))) return;
+    }
+    break;
+  }
+  case Frequency::NONE:
+    break;
+  }
+}
+
+Recurrence Recurrence::parse(std::string_view value, int32_t dtstart) {
+  Recurrence rule;
+  Recurrence none;
+  bool ordinal_seen = false;
+
+  while(!value.empty()) {
+    size_t semi = value.find(';');
+    std::string_view part = value.substr(0, semi);
+    value = (semi == std::string_view::npos) ? std::string_view() : value.substr(semi + 1);
+    size_t eq = part.find('=');
+    if(eq == std::string_view::npos) return none;
+    std::string_view key = part.substr(0, eq);
+    std::string_view val = part.substr(eq + 1);
+
+    try {
+      if(key == "FREQ") {
+        if(val == "DAILY") rule.freq = Frequency::DAILY;
+        else if(val == "WEEKLY") rule.freq = Frequency::WEEKLY;
+        else if(val == "MONTHLY") rule.freq = Frequency::MONTHLY;
+        else if(val == "YEARLY") rule.freq = Frequency::YEARLY;
+        else return none;
+      } else if(key == "INTERVAL") {
+        unsigned long n = std::stoul(std::string(val));
+        if(n < 1 || n > UINT16_MAX) return none;
+        rule.interval = static_cast<uint16_t>(n);
+      } else if(key == "COUNT") {
+        unsigned long n = std::stoul(std::string(val));
+        if(n < 1 || n > UINT32_MAX) return none;
+        rule.count = static_cast<uint32_t>(n);
+      } else if(key == "UNTIL") {
+        rule.until = static_cast<int32_t>(parse_tstamp(val).serial_time());
+      } else if(key == "BYDAY") {
+        while(!val.empty()) {
+          size_t comma = val.find(',');
+          std::string_view day = val.substr(0, comma);
+          val = (comma == std::string_view::npos) ? std::string_view() : val.substr(comma + 1);
+          if(day.length() < 2) return none;
+          int n = 0;
+          if(day.length() > 2) n = std::stoi(std::string(day.substr(0, day.length() - 2)));
+          if(n < -5 || n > 5) return none;
+          //a single ordinal shared by every listed day is supported
+          if(ordinal_seen && n != rule.ordinal) return none;
+          ordinal_seen = true;
+          rule.ordinal = static_cast<int8_t>(n);
+          std::string_view code = day.substr(day.length() - 2);
+          int index = -1;
+          for(int i = 0; i < DAYS_IN_WEEK; ++i) {
+            if(code == WEEKDAY_CODES[i]) index = i;
+          }
+          if(index < 0) return none;
+          rule.byday = static_cast<uint8_t>(rule.byday | (1 << index));
+        }
+      } else if(key == "WKST") {
+        if(val != "MO") return none;
+      } else {
+        return none;
+      }
+    } catch(std::exception &) {
+      return none;
+    }
+  }
+
+  if(rule.freq == Frequency::NONE) return none;
+  if(rule.ordinal != 0 && rule.freq != Frequency::MONTHLY) return none;
+  if(rule.byday && rule.freq == Frequency::YEARLY) return none;
+
+  //COUNT is turned into the day of the last occurrence once, so windows
+  //far into the series need not count the occurrences before them
+  rule.last = rule.until;
+  if(rule.count > 0) {
+    int32_t limit = days_from_civil(9999, 12, 31);
+    uint32_t seen = 0;
+    int32_t nth = dtstart;
+    rule.for_each_start(dtstart, dtstart, limit, [&](int32_t s) {
+      nth = s;
+      return ++seen < rule.count;
+    });
+    rule.last = std::min(rule.last, nth);
+  }
+  return rule;
+}
+
+bool Recurrence::recurs() const {
+  return freq != Frequency::NONE;
+}
+
+Frequency Recurrence::get_frequency() const {
+  return freq;
+}
+
+unsigned Recurrence::get_interval() const {
+  return interval;
+}
+
+int32_t Recurrence::last_start() const {
+  return last;
+}
+
+std::string Recurrence::to_string() const {
+  static const char *FREQ_NAMES[] = {"", "DAILY", "WEEKLY", "MONTHLY", "YEARLY"};
+  std::string value = "FREQ=";
+  value += FREQ_NAMES[static_cast<int>(freq)];
+  if(interval > 1) value.append(";INTERVAL=").append(std::to_string(interval));
+  if(count > 0) value.append(";COUNT=").append(std::to_string(count));
+  if(until != INT32_MAX) {
+    std::chrono::sys_days days{std::chrono::days{until}};
+    value.append(";UNTIL=").append(Date(days).to_tz_tstamp());
+  }
+  if(byday) {
+    value += ";BYDAY=";
+    bool first = true;
+    //listed monday first, as most calendars write them
+    for(int i = 1; i <= DAYS_IN_WEEK; ++i) {
+      int wd = i % DAYS_IN_WEEK;
+      if(!((byday >> wd) & 1)) continue;
+      if(!first) value += ',';
+      if(ordinal != 0) value += std::to_string(ordinal);
+      value += WEEKDAY_CODES[wd];
+      first = false;
+    }
+  }
+  return value;
+}
+
+void Recurrence::starts(int32_t dtstart, int32_t lo, int32_t hi, std::vector<int32_t> &out) const {
+  for_each_start(dtstart, lo, hi, [&out](int32_t s) {
+    out.push_back(s);
+    return true;
+  });
+}
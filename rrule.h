@@ -0,0 +1,68 @@
+#ifndef RRULE_H
+#define RRULE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+enum class Frequency : uint8_t { NONE, DAILY, WEEKLY, MONTHLY, YEARLY };
+
+//the subset of an icalendar RRULE that planner understands: FREQ of
+//DAILY, WEEKLY, MONTHLY or YEARLY with INTERVAL, COUNT, UNTIL and BYDAY.
+//BYDAY filters DAILY rules, lists the days of each WEEKLY period (weeks
+//start on monday) and selects weekdays of each MONTHLY period, optionally
+//with one ordinal shared by all days (1MO,1TH or -1FR). occurrences are
+//generated on demand for a window, never stored. trivially copyable so
+//snapshots can store it as is.
+class Recurrence {
+private:
+  Frequency freq;
+  uint8_t byday;    //bit i set for weekday i, S=0 ... S=6
+  int8_t ordinal;   //nth BYDAY weekday of the month, 0 for every one
+  uint8_t pad;
+  uint16_t interval;
+  uint16_t pad2;
+  uint32_t count;   //0 if not limited by COUNT
+  int32_t until;    //UNTIL day serial, INT32_MAX if none
+  int32_t last;     //serial of the last occurrence, INT32_MAX if endless
+
+  //call emit for each occurrence start of a series starting on dtstart
+  //in [lo, hi], in order, until it returns false
+  template <typename F>
+  void for_each_start(int32_t dtstart, int32_t lo, int32_t hi, F emit) const;
+
+public:
+  // === Constructors ===
+
+  //no recurrence
+  Recurrence();
+
+  //parse the value of an RRULE property for a series starting on day
+  //serial dtstart. returns a rule with frequency NONE if value uses
+  //anything outside the supported subset.
+  static Recurrence parse(std::string_view value, int32_t dtstart);
+
+  // === Accessors ===
+
+  //true if the rule repeats
+  bool recurs() const;
+  Frequency get_frequency() const;
+  unsigned get_interval() const;
+  //serial of the last occurrence start, INT32_MAX if the series is endless
+  int32_t last_start() const;
+  //return the rule as an RRULE value
+  std::string to_string() const;
+
+  //append to out the starts of occurrences of a series starting on day
+  //serial dtstart that fall in [lo, hi]. the cost is proportional to the
+  //number of periods between lo and hi, not to the age of the series.
+  void starts(int32_t dtstart, int32_t lo, int32_t hi, std::vector<int32_t> &out) const;
+
+  bool operator==(const Recurrence &rhs) const = default;
+};
+
+static_assert(std::is_trivially_copyable_v<Recurrence> && sizeof(Recurrence) == 20);
+
+#endif
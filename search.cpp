@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "ics.h"
+#include "profile.h"
+#include "search.h"
+
+// === SearchIndex ===
+SearchIndex::SearchIndex() {}
+
+//true for the bytes words are made of
+static bool is_word_byte(unsigned char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+void SearchIndex::tokenize(std::string_view text, std::vector<std::string> &words) {
+  size_t i = 0;
+  while(i < text.length()) {
+    if(!is_word_byte(static_cast<unsigned char>(text[i]))) {
+      ++i;
+      continue;
+    }
+    std::string word;
+    for(; i < text.length() && is_word_byte(static_cast<unsigned char>(text[i])); ++i) {
+      char c = text[i];
+      word += (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+    if(std::find(words.begin(), words.end(), word) == words.end()) words.push_back(std::move(word));
+  }
+}
+
+//return the words e is found by
+static std::vector<std::string> event_words(const Event &e) {
+  std::vector<std::string> words;
+  SearchIndex::tokenize(e.get_title(), words);
+  SearchIndex::tokenize(e.get_tag(), words);
+  return words;
+}
+
+void SearchIndex::clear() {
+  postings.clear();
+}
+
+void SearchIndex::build(const std::vector<Event> &events) {
+  postings.clear();
+  for(size_t i = 0; i < events.size(); ++i) add(static_cast<uint32_t>(i), events[i]);
+}
+
+void SearchIndex::add(uint32_t pos, const Event &e) {
+  for(std::string &word : event_words(e)) {
+    std::vector<uint32_t> &list = postings[std::move(word)];
+    //events are added at the end, so this is almost always an append
+    if(list.empty() || list.back() < pos) {
+      list.push_back(pos);
+      continue;
+    }
+    auto at = std::lower_bound(list.begin(), list.end(), pos);
+    if(*at != pos) list.insert(at, pos);
+  }
+}
+
+void SearchIndex::remove(uint32_t pos, const Event &e) {
+  for(const std::string &word : event_words(e)) {
+    auto it = postings.find(word);
+    if(it == postings.end()) continue;
+    std::vector<uint32_t> &list = it->second;
+    auto at = std::lower_bound(list.begin(), list.end(), pos);
+    if(at != list.end() && *at == pos) list.erase(at);
+    if(list.empty()) postings.erase(it);
+  }
+}
+
+void SearchIndex::remap(const std::vector<uint32_t> &to) {
+  for(auto it = postings.begin(); it != postings.end();) {
+    std::vector<uint32_t> &list = it->second;
+    size_t kept = 0;
+    for(uint32_t pos : list) {
+      if(pos < to.size() && to[pos] != NO_POSITION) list[kept++] = to[pos];
+    }
+    list.resize(kept);
+    std::sort(list.begin(), list.end());
+    if(list.empty()) it = postings.erase(it);
+    else ++it;
+  }
+}
+
+size_t SearchIndex::size() const {
+  return postings.size();
+}
+
+std::vector<uint32_t> SearchIndex::query(std::string_view text) const {
+  std::vector<std::string> words;
+  tokenize(text, words);
+  std::vector<const std::vector<uint32_t> *> lists;
+  for(const std::string &word : words) {
+    auto it = postings.find(word);
+    if(it == postings.end()) return {};
+    lists.push_back(&it->second);
+  }
+  if(lists.empty()) return {};
+  std::sort(lists.begin(), lists.end(),
+            [](const auto *x, const auto *y) { return x->size() < y->size(); });
+
+  //keep the candidates of the shortest list found in each longer one. the
+  //search for the next candidate gallops forward from the last, so a list
+  //much longer than the candidates costs about log of the gap per candidate.
+  std::vector<uint32_t> found = *lists[0];
+  for(size_t l = 1; l < lists.size() && !found.empty(); ++l) {
+    const std::vector<uint32_t> &list = *lists[l];
+    auto from = list.begin();
+    size_t kept = 0;
+    for(uint32_t pos : found) {
+      size_t step = 1;
+      auto to = from;
+      while(to != list.end() && *to < pos) {
+        from = to;
+        to = (static_cast<size_t>(list.end() - to) > step) ? to + static_cast<ptrdiff_t>(step) : list.end();
+        step *= 2;
+      }
+      from = std::lower_bound(from, to, pos);
+      if(from == list.end()) break;
+      if(*from == pos) found[kept++] = pos;
+    }
+    found.resize(kept);
+  }
+  return found;
+}
+
+bool SearchIndex::load(const std::string &path, const SnapshotSource &source, size_t count) {
+  postings.clear();
+  MappedFile file(path);
+  std::string_view buf = file.view();
+
+  SearchHeader header;
+  if(buf.length() < sizeof(header)) return false;
+  memcpy(&header, buf.data(), sizeof(header));
+  if(header.magic != SEARCH_MAGIC || header.version != SEARCH_VERSION) return false;
+  if(!(header.source == source) || header.zone != zone_hash() || header.count != count) return false;
+
+  std::string_view body = buf.substr(sizeof(header));
+  size_t words = header.words;
+  size_t columns = (2 * (words + 1) + header.postings) * sizeof(uint32_t);
+  if(body.length() != columns + header.blob_size) return false;
+  if(fnv1a(body.data(), body.length()) != header.checksum) return false;
+
+  //the mapping is page aligned and the header a multiple of 4 bytes
+  const uint32_t *word_off = reinterpret_cast<const uint32_t *>(body.data());
+  const uint32_t *post_off = word_off + words + 1;
+  const uint32_t *positions = post_off + words + 1;
+  const char *blob = reinterpret_cast<const char *>(positions + header.postings);
+  for(size_t i = 0; i < words; ++i) {
+    if(word_off[i] > word_off[i+1] || word_off[i+1] > header.blob_size) return false;
+    if(post_off[i] > post_off[i+1] || post_off[i+1] > header.postings) return false;
+  }
+  for(size_t i = 0; i < header.postings; ++i) {
+    if(positions[i] >= count) return false;
+  }
+
+  postings.reserve(words);
+  for(size_t i = 0; i < words; ++i) {
+    std::string word(blob + word_off[i], word_off[i+1] - word_off[i]);
+    postings.emplace(std::move(word),
+                     std::vector<uint32_t>(positions + post_off[i], positions + post_off[i+1]));
+  }
+  return true;
+}
+
+bool SearchIndex::save(const std::string &path, const SnapshotSource &source, size_t count) const {
+  //words in order, so the same index always gives the same file
+  std::vector<const std::pair<const std::string, std::vector<uint32_t> > *> entries;
+  entries.reserve(postings.size());
+  for(const auto &entry : postings) entries.push_back(&entry);
+  std::sort(entries.begin(), entries.end(),
+            [](const auto *x, const auto *y) { return x->first < y->first; });
+
+  size_t words = entries.size();
+  std::vector<uint32_t> word_off(words + 1);
+  std::vector<uint32_t> post_off(words + 1);
+  std::vector<uint32_t> positions;
+  std::string blob;
+  for(size_t i = 0; i < words; ++i) {
+    word_off[i] = static_cast<uint32_t>(blob.length());
+    post_off[i] = static_cast<uint32_t>(positions.size());
+    blob += entries[i]->first;
+    positions.insert(positions.end(), entries[i]->second.begin(), entries[i]->second.end());
+  }
+  word_off[words] = static_cast<uint32_t>(blob.length());
+  post_off[words] = static_cast<uint32_t>(positions.size());
+
+  SearchHeader header;
+  header.magic = SEARCH_MAGIC;
+  header.version = SEARCH_VERSION;
+  header.count = static_cast<uint32_t>(count);
+  header.words = static_cast<uint32_t>(words);
+  header.postings = static_cast<uint32_t>(positions.size());
+  header.blob_size = static_cast<uint32_t>(blob.length());
+  header.source = source;
+  header.zone = zone_hash();
+
+  std::string out(sizeof(header), '\0');
+  out.append(reinterpret_cast<const char *>(word_off.data()), (words + 1) * sizeof(uint32_t));
+  out.append(reinterpret_cast<const char *>(post_off.data()), (words + 1) * sizeof(uint32_t));
+  out.append(reinterpret_cast<const char *>(positions.data()), positions.size() * sizeof(uint32_t));
+  out.append(blob);
+  header.checksum = fnv1a(out.data() + sizeof(header), out.length() - sizeof(header));
+  memcpy(out.data(), &header, sizeof(header));
+
+  //the search file only saves rebuilding the index, failing to write it
+  //is not an error, nor is losing it in a crash
+  try {
+    replace_file(path, out, false);
+  } catch(std::runtime_error &) {
+    return false;
+  }
+  PROFILE_COUNT(COUNT_BYTES_WRITTEN, out.length());
+  return true;
+}
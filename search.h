@@ -0,0 +1,82 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "datetime.h"
+#include "snapshot.h"
+
+#define SEARCH_MAGIC   0x4e534c50 //"PLSN"
+#define SEARCH_VERSION 1
+
+//search file layout, all integers in native byte order:
+//  SearchHeader
+//  uint32_t word_off[words+1]  offsets into blob, word i is [off[i], off[i+1])
+//  uint32_t post_off[words+1]  offsets into postings, the events of word i
+//                              are [off[i], off[i+1])
+//  uint32_t postings[postings] event positions, ascending for each word
+//  char     blob[blob_size]
+struct SearchHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count; //events of the save file, positions are in load order
+  uint32_t words;
+  uint32_t postings;
+  uint32_t blob_size;
+  SnapshotSource source;
+  uint64_t zone;     //zone_hash of the zone the load order was found in
+  uint64_t checksum; //FNV-1a over everything after the header
+};
+
+//inverted index from the words of event titles and tags to the positions
+//of the events holding them. words are runs of letters and digits,
+//lowercased; bytes outside ascii count as letters so words of other
+//scripts stay whole. each word's positions are kept ascending, so a
+//query of several words intersects them starting from the shortest.
+class SearchIndex {
+private:
+  std::unordered_map<std::string, std::vector<uint32_t> > postings;
+
+public:
+  //a position without a counterpart, see remap
+  static constexpr uint32_t NO_POSITION = UINT32_MAX;
+
+  // === Constructors ===
+
+  //empty index
+  SearchIndex();
+
+  // === Modifiers ===
+
+  void clear();
+  //index every event of events at its position
+  void build(const std::vector<Event> &events);
+  //index e at position pos
+  void add(uint32_t pos, const Event &e);
+  //remove e, indexed at position pos
+  void remove(uint32_t pos, const Event &e);
+  //move each position p to to[p], dropping those mapped to NO_POSITION
+  void remap(const std::vector<uint32_t> &to);
+  //replace the index with the search file at path. returns false, leaving
+  //the index empty, if the file is missing, corrupt, of another version
+  //or was not built for count events of source in the current zone.
+  bool load(const std::string &path, const SnapshotSource &source, size_t count);
+  //write the index as the search file for count events of source. the
+  //file is replaced atomically. returns false on failure.
+  bool save(const std::string &path, const SnapshotSource &source, size_t count) const;
+
+  // === Accessors ===
+
+  //return the number of distinct words
+  size_t size() const;
+  //return the positions of the events holding every word of text in
+  //ascending order, none if text has no words
+  std::vector<uint32_t> query(std::string_view text) const;
+  //append the words of text to words, lowercased and without repeats
+  static void tokenize(std::string_view text, std::vector<std::string> &words);
+};
+
+#endif
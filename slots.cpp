@@ -0,0 +1,27 @@
+#include "slots.h"
+
+// === SlotAllocator ===
+SlotAllocator::SlotAllocator() : num_slots(0) {}
+
+void SlotAllocator::release_before(long int day) {
+  while(!active.empty() && active.top().first < day) {
+    free_slots.push(active.top().second);
+    active.pop();
+  }
+}
+
+size_t SlotAllocator::assign(long int end) {
+  size_t slot;
+  if(free_slots.empty()) {
+    slot = num_slots++;
+  } else {
+    slot = free_slots.top();
+    free_slots.pop();
+  }
+  active.emplace(end, slot);
+  return slot;
+}
+
+size_t SlotAllocator::size() const {
+  return num_slots;
+}
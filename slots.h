@@ -0,0 +1,41 @@
+#ifndef SLOTS_H
+#define SLOTS_H
+
+#include <cstddef>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+//assigns rows to events for print_cal. events must be assigned in start
+//order; each gets the lowest row not held by an event that is still
+//active, which uses exactly as many rows as the maximum concurrency.
+class SlotAllocator {
+private:
+  //rows released by ended events, lowest first
+  std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t> > free_slots;
+  //(end serial, row) of active events, earliest end first
+  std::priority_queue<std::pair<long int, size_t>, std::vector<std::pair<long int, size_t> >,
+                      std::greater<std::pair<long int, size_t> > > active;
+  size_t num_slots;
+
+public:
+  // === Constructors ===
+
+  //no rows in use
+  SlotAllocator();
+
+  // === Modifiers ===
+
+  //release the rows of events that end before day serial
+  void release_before(long int day);
+  //return the lowest free row for an event ending on day serial end
+  size_t assign(long int end);
+
+  // === Accessors ===
+
+  //number of distinct rows handed out so far
+  size_t size() const;
+};
+
+#endif
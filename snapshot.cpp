@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <sys/stat.h>
+
+#include "ics.h"
+#include "profile.h"
+#include "snapshot.h"
+
+//size of the columns following the header for count events
+static size_t columns_size(size_t count) {
+  return count * (2 * sizeof(int32_t) + 2 * sizeof(int16_t) + 4 + sizeof(Recurrence))
+         + 2 * (count + 1) * sizeof(uint32_t);
+}
+
+uint64_t zone_hash() {
+  const std::string &name = TimeZone::local().get_name();
+  return fnv1a(name.data(), name.length());
+}
+
+SnapshotSource snapshot_source(const std::string &path) {
+  struct stat st;
+  if(stat(path.c_str(), &st) != 0) return SnapshotSource{0, 0, 0};
+  return SnapshotSource{static_cast<uint64_t>(st.st_size),
+                        st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec,
+                        static_cast<uint64_t>(st.st_ino)};
+}
+
+bool load_snapshot(const std::string &path, const SnapshotSource &source,
+                   std::vector<Event> &events, StringArena &arena) {
+  MappedFile file(path);
+  std::string_view buf = file.view();
+
+  SnapshotHeader header;
+  if(buf.length() < sizeof(header)) return false;
+  memcpy(&header, buf.data(), sizeof(header));
+  if(header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION) return false;
+  if(!(header.source == source) || header.zone != zone_hash()) return false;
+
+  std::string_view body = buf.substr(sizeof(header));
+  if(body.length() != columns_size(header.count) + header.blob_size) return false;
+  if(fnv1a(body.data(), body.length()) != header.checksum) return false;
+
+  //the mapping is page aligned and every column is a multiple of 4 bytes
+  size_t count = header.count;
+  const int32_t *begin = reinterpret_cast<const int32_t *>(body.data());
+  const int32_t *end = begin + count;
+  const int16_t *begin_min = reinterpret_cast<const int16_t *>(end + count);
+  const int16_t *end_min = begin_min + count;
+  const char *tags = reinterpret_cast<const char *>(end_min + count);
+  const char *rules = tags + 4 * count;
+  const uint32_t *title_off = reinterpret_cast<const uint32_t *>(rules + sizeof(Recurrence) * count);
+  const uint32_t *uid_off = title_off + count + 1;
+  const char *blob = reinterpret_cast<const char *>(uid_off + count + 1);
+
+  for(size_t i = 0; i < count; ++i) {
+    if(title_off[i] > title_off[i+1] || title_off[i+1] > header.blob_size) return false;
+    if(uid_off[i] > uid_off[i+1] || uid_off[i+1] > header.blob_size) return false;
+    Recurrence rule;
+    memcpy(&rule, rules + sizeof(Recurrence) * i, sizeof(rule));
+    if(rule.get_frequency() > Frequency::YEARLY || rule.get_interval() == 0) return false;
+    if((begin_min[i] == Event::ALL_DAY) != (end_min[i] == Event::ALL_DAY)) return false;
+    if(begin_min[i] > Event::MINUTES_PER_DAY || end_min[i] > Event::MINUTES_PER_DAY) return false;
+    if(begin_min[i] < Event::ALL_DAY || end_min[i] < Event::ALL_DAY) return false;
+  }
+
+  std::string_view strings = arena.store(std::string_view(blob, header.blob_size));
+  events.reserve(events.size() + count);
+  for(size_t i = 0; i < count; ++i) {
+    std::chrono::sys_days b{std::chrono::days{begin[i]}};
+    std::chrono::sys_days e{std::chrono::days{end[i]}};
+    std::string_view title = strings.substr(title_off[i], title_off[i+1] - title_off[i]);
+    std::string_view tag(tags + 4 * i, strnlen(tags + 4 * i, 4));
+    std::string_view uid = strings.substr(uid_off[i], uid_off[i+1] - uid_off[i]);
+    events.emplace_back(title, tag, b, e, uid);
+    if(begin_min[i] != Event::ALL_DAY) events.back().set_times(begin_min[i], end_min[i]);
+    Recurrence rule;
+    memcpy(&rule, rules + sizeof(Recurrence) * i, sizeof(rule));
+    if(rule.recurs()) events.back().set_rule(rule);
+  }
+  return true;
+}
+
+bool save_snapshot(const std::string &path, const SnapshotSource &source,
+                   const std::vector<Event> &events) {
+  size_t count = events.size();
+  std::vector<int32_t> begin(count);
+  std::vector<int32_t> end(count);
+  std::vector<int16_t> begin_min(count);
+  std::vector<int16_t> end_min(count);
+  std::vector<char> tags(4 * count, '\0');
+  std::vector<Recurrence> rules(count);
+  std::vector<uint32_t> title_off(count + 1);
+  std::vector<uint32_t> uid_off(count + 1);
+  std::string blob;
+
+  for(size_t i = 0; i < count; ++i) {
+    const Event &e = events[i];
+    begin[i] = static_cast<int32_t>(e.get_begin().serial_time());
+    end[i] = static_cast<int32_t>(e.get_end().serial_time());
+    begin_min[i] = static_cast<int16_t>(e.get_begin_minute());
+    end_min[i] = static_cast<int16_t>(e.get_end_minute());
+    std::string_view tag = e.get_tag();
+    memcpy(&tags[4 * i], tag.data(), tag.length());
+    rules[i] = e.get_rule();
+    title_off[i] = static_cast<uint32_t>(blob.length());
+    blob += e.get_title();
+  }
+  title_off[count] = static_cast<uint32_t>(blob.length());
+  for(size_t i = 0; i < count; ++i) {
+    uid_off[i] = static_cast<uint32_t>(blob.length());
+    blob += events[i].get_uid();
+  }
+  uid_off[count] = static_cast<uint32_t>(blob.length());
+
+  //the header goes in front once the checksum of the rest is known
+  std::string body(sizeof(SnapshotHeader), '\0');
+  body.reserve(sizeof(SnapshotHeader) + columns_size(count) + blob.length());
+  body.append(reinterpret_cast<const char *>(begin.data()), count * sizeof(int32_t));
+  body.append(reinterpret_cast<const char *>(end.data()), count * sizeof(int32_t));
+  body.append(reinterpret_cast<const char *>(begin_min.data()), count * sizeof(int16_t));
+  body.append(reinterpret_cast<const char *>(end_min.data()), count * sizeof(int16_t));
+  body.append(tags.data(), tags.size());
+  body.append(reinterpret_cast<const char *>(rules.data()), count * sizeof(Recurrence));
+  body.append(reinterpret_cast<const char *>(title_off.data()), (count + 1) * sizeof(uint32_t));
+  body.append(reinterpret_cast<const char *>(uid_off.data()), (count + 1) * sizeof(uint32_t));
+  body.append(blob);
+
+  SnapshotHeader header;
+  header.magic = SNAPSHOT_MAGIC;
+  header.version = SNAPSHOT_VERSION;
+  header.count = static_cast<uint32_t>(count);
+  header.blob_size = static_cast<uint32_t>(blob.length());
+  header.source = source;
+  header.zone = zone_hash();
+  header.checksum = fnv1a(body.data() + sizeof(header), body.length() - sizeof(header));
+  memcpy(body.data(), &header, sizeof(header));
+
+  //readers never see a partial file and concurrent writers never share a
+  //temporary one. the checksum catches one a crash left behind, so it is
+  //not fsynced
+  try {
+    replace_file(path, body, false);
+  } catch(std::runtime_error &) {
+    return false;
+  }
+  PROFILE_COUNT(COUNT_BYTES_WRITTEN, body.length());
+  return true;
+}
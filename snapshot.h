@@ -0,0 +1,63 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "arena.h"
+#include "datetime.h"
+
+#define SNAPSHOT_MAGIC   0x534e4c50 //"PLNS"
+#define SNAPSHOT_VERSION 5
+
+//identifies the version of the ics file a snapshot was built from.
+//a missing ics file has an all zero source.
+struct SnapshotSource {
+  uint64_t size;
+  int64_t mtime_ns;
+  uint64_t inode;
+
+  bool operator==(const SnapshotSource &rhs) const = default;
+};
+
+//snapshot file layout, all integers in native byte order:
+//  SnapshotHeader
+//  int32_t  begin[count]       day serials, sorted by Event::starts_before
+//  int32_t  end[count]
+//  int16_t  begin_min[count]   Event::ALL_DAY for all day events
+//  int16_t  end_min[count]
+//  char     tag[count][4]      zero padded
+//  Recurrence rule[count]      frequency NONE for single events
+//  uint32_t title_off[count+1] offsets into blob, title i is [off[i], off[i+1])
+//  uint32_t uid_off[count+1]   offsets into blob, uid i is [off[i], off[i+1])
+//  char     blob[blob_size]
+struct SnapshotHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count;
+  uint32_t blob_size;
+  SnapshotSource source;
+  uint64_t zone;     //FNV-1a of the display zone name times were converted to
+  uint64_t checksum; //FNV-1a over everything after the header
+};
+
+//return the hash identifying the display zone timed events were converted
+//to, files built from converted events are only valid in the same zone
+uint64_t zone_hash();
+
+//return the SnapshotSource of the ics file at path
+SnapshotSource snapshot_source(const std::string &path);
+
+//append events stored in the snapshot at path to events, copying the
+//string blob into arena in one piece. returns false, leaving events
+//untouched, if the snapshot is missing, corrupt, of another version or
+//was not built from source in the current display zone.
+bool load_snapshot(const std::string &path, const SnapshotSource &source,
+                   std::vector<Event> &events, StringArena &arena);
+
+//write events, which must be sorted by Event::starts_before, as a snapshot
+//of source. the file is replaced atomically. returns false on failure.
+bool save_snapshot(const std::string &path, const SnapshotSource &source,
+                   const std::vector<Event> &events);
+
+#endif
@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <climits>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "freebusy.h"
+#include "sources.h"
+
+// === CalendarSources ===
+CalendarSources::CalendarSources() {}
+
+//return true if name is a save file rather than one of the files kept
+//next to it
+static bool is_save_file(std::string_view name) {
+  auto ends_with = [name](std::string_view suffix) {
+    return name.length() > suffix.length() && name.substr(name.length() - suffix.length()) == suffix;
+  };
+  return name[0] != '.' && (ends_with(".ics") || ends_with(".dat"));
+}
+
+//return the file name of path without directories or extension
+static std::string source_name(const std::string &path) {
+  size_t slash = path.rfind('/');
+  std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+  size_t dot = name.rfind('.');
+  if(dot != std::string::npos && dot > 0) name.erase(dot);
+  return name;
+}
+
+void CalendarSources::add_source(const std::string &path) {
+  struct stat st;
+  if(stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+    //a missing file is an empty calendar, created by the first commit.
+    //--to picks a source by name, so names must be unique
+    std::string name = source_name(path);
+    size_t i = static_cast<size_t>(std::find(names.begin(), names.end(), name) - names.begin());
+    if(i < names.size()) {
+      throw std::invalid_argument("Calendars " + paths[i] + " and " + path + " are both named " + name);
+    }
+    paths.push_back(path);
+    names.push_back(name);
+    calendars.emplace_back();
+    return;
+  }
+
+  DIR *dir = opendir(path.c_str());
+  if(!dir) throw std::invalid_argument("Unable to read calendar directory " + path);
+  std::vector<std::string> files;
+  while(dirent *entry = readdir(dir)) {
+    if(is_save_file(entry->d_name)) files.push_back(entry->d_name);
+  }
+  closedir(dir);
+  if(files.empty()) throw std::invalid_argument("No calendars in " + path);
+
+  std::sort(files.begin(), files.end());
+  std::string prefix = (path.back() == '/') ? path : path + "/";
+  for(const std::string &file : files) add_source(prefix + file);
+}
+
+void CalendarSources::load_events() {
+  if(calendars.size() == 1) {
+    calendars[0].load_events(paths[0]);
+    return;
+  }
+  std::vector<std::exception_ptr> errors(calendars.size());
+  std::vector<std::thread> loaders;
+  for(size_t i = 0; i < calendars.size(); ++i) {
+    loaders.emplace_back([this, &errors, i] {
+      try {
+        calendars[i].load_events(paths[i]);
+      } catch(...) {
+        errors[i] = std::current_exception();
+      }
+    });
+  }
+  for(std::thread &t : loaders) t.join();
+  for(std::exception_ptr &error : errors) {
+    if(error) std::rethrow_exception(error);
+  }
+}
+
+void CalendarSources::commit_events() {
+  std::string written;
+  for(size_t i = 0; i < calendars.size(); ++i) {
+    bool changed = calendars[i].has_changes();
+    try {
+      calendars[i].commit_events(paths[i]);
+    } catch(std::exception &ex) {
+      if(written.empty()) throw;
+      throw std::runtime_error(std::string(ex.what()) + ", changes to " + written +
+                               " were written, the rest were not");
+    }
+    if(changed) written += (written.empty() ? "" : ", ") + names[i];
+  }
+}
+
+void CalendarSources::set_range(int by, unsigned bm, unsigned bd, int ey, unsigned em, unsigned ed) {
+  Date begin = Date(by, bm, bd);
+  Date end   = Date(ey, em, ed);
+  range = CalendarRange(begin, end);
+}
+
+size_t CalendarSources::find_source(std::string_view source) const {
+  if(source.empty()) return 0;
+  size_t i = static_cast<size_t>(std::find(names.begin(), names.end(), source) - names.begin());
+  if(i == names.size()) throw std::invalid_argument("No calendar named " + std::string(source));
+  return i;
+}
+
+void CalendarSources::add_new_event(std::string_view source, std::string_view title,
+                                    std::string_view tag, Date &begin, Date &end,
+                                    int begin_minute, int end_minute) {
+  calendars.at(find_source(source)).add_new_event(title, tag, begin, end, begin_minute, end_minute);
+}
+
+size_t CalendarSources::apply_batch(std::string_view target, const std::vector<BatchRecord> &records,
+                                    std::vector<BatchError> &errors) {
+  size_t added_to = find_source(target);
+  if(calendars.size() == 1) return calendars[0].apply_batch(records, errors);
+  size_t applied = 0;
+  for(const BatchRecord &r : records) {
+    size_t i = added_to;
+    if(!r.remove.empty()) {
+      //the source holding the key, else the target, which reports it missing
+      std::vector<size_t> holding;
+      for(size_t s = 0; s < calendars.size(); ++s) {
+        if(!calendars[s].find_events(r.remove).empty()) holding.push_back(s);
+      }
+      if(holding.size() > 1) {
+        errors.push_back(BatchError{r.line, r.remove + " is in several calendars, remove one by UID"});
+        continue;
+      }
+      if(!holding.empty()) i = holding[0];
+    }
+    applied += calendars[i].apply_record(r, errors);
+  }
+  return applied;
+}
+
+void CalendarSources::remove_event(std::string_view key, std::ostream &out) {
+  std::vector<std::pair<size_t, const Event *> > matched;
+  for(size_t i = 0; i < calendars.size(); ++i) {
+    for(const Event *e : calendars[i].find_events(key)) matched.emplace_back(i, e);
+  }
+
+  //a single source holding the key decides on its own, as it would alone
+  if(matched.empty() || std::all_of(matched.begin(), matched.end(),
+                                    [&](const auto &m) { return m.first == matched[0].first; })) {
+    std::string arg(key);
+    calendars.at(matched.empty() ? 0 : matched[0].first).remove_event(arg.data(), out);
+    return;
+  }
+
+  std::stable_sort(matched.begin(), matched.end(), [](const auto &x, const auto &y) {
+    return Event::starts_before(*x.second, *y.second);
+  });
+  out << key << " matches " << matched.size() << " events, remove one by UID:" << std::endl;
+  for(const auto &[i, e] : matched) {
+    out << "  " << e->get_uid() << "  " << e->get_begin()
+        << " to " << e->get_end() << "  " << e->get_title() << "  [" << names[i] << "]" << std::endl;
+  }
+}
+
+size_t CalendarSources::size() const {
+  return calendars.size();
+}
+
+const std::string &CalendarSources::get_name(size_t i) const {
+  return names.at(i);
+}
+
+Calendar &CalendarSources::operator[](size_t i) {
+  return calendars.at(i);
+}
+
+void CalendarSources::set_events() {
+  std::vector<const EventIndex *> indexes;
+  indexes.reserve(calendars.size());
+  for(Calendar &c : calendars) indexes.push_back(&c.get_index());
+  range.set_events(indexes, names);
+}
+
+void CalendarSources::print(int fd) {
+  set_events();
+  std::cout.flush();
+  range.print_cal(fd);
+}
+
+void CalendarSources::print_day(int fd) {
+  set_events();
+  std::cout.flush();
+  range.print_day(fd);
+}
+
+void CalendarSources::print_free(unsigned min_days, std::ostream &out) {
+  set_events();
+  write_spans(free_spans(range, range.get_events(), min_days), out);
+}
+
+void CalendarSources::print_stats(const std::vector<std::string> &tags, std::ostream &out) {
+  range.track_tags(tags);
+  set_events();
+  write_stats(range, tags, out);
+  range.track_tags({});
+}
+
+size_t CalendarSources::print_conflicts(const Event &e, std::ostream &out) {
+  if(calendars.size() == 1) return calendars[0].print_conflicts(e, out);
+  Date begin = e.get_begin();
+  Date end = e.get_end();
+  CalendarRange days(begin, end);
+  std::vector<const EventIndex *> indexes;
+  for(Calendar &c : calendars) indexes.push_back(&c.get_index());
+  days.set_events(indexes, names);
+  const std::vector<const Event *> &events = days.get_events();
+  std::vector<size_t> conflicts;
+  for(size_t i = 0; i < events.size(); ++i) {
+    if(events_overlap(e, *events[i])) conflicts.push_back(i);
+  }
+  if(!conflicts.empty()) out << "Overlaps " << conflicts.size() << " event(s):\n";
+  for(size_t i : conflicts) {
+    out << "  " << Calendar::agenda_line(*events[i]) << "  [" << names[days.get_source(i)] << "]\n";
+  }
+  out.flush();
+  return conflicts.size();
+}
+
+void CalendarSources::print_search(std::string_view query, const std::optional<TimeRange> &within,
+                                   std::ostream &out) {
+  if(calendars.size() == 1) {
+    calendars[0].print_search(query, within, out);
+    return;
+  }
+  std::vector<std::pair<size_t, const Event *> > found;
+  for(size_t i = 0; i < calendars.size(); ++i) {
+    for(const Event *e : calendars[i].search_events(query, within)) found.emplace_back(i, e);
+  }
+  std::stable_sort(found.begin(), found.end(), [](const auto &x, const auto &y) {
+    return Event::starts_before(*x.second, *y.second);
+  });
+  for(const auto &[i, e] : found) out << Calendar::agenda_line(*e) << "  [" << names[i] << "]\n";
+  out.flush();
+}
+
+void CalendarSources::list_events(std::ostream &out) {
+  for(size_t i = 0; i < calendars.size(); ++i) {
+    if(calendars.size() > 1) out << "== " << names[i] << " ==" << std::endl;
+    calendars[i].list_events(out);
+  }
+}
+
+void CalendarSources::print_agenda(const Date &from, size_t count, unsigned days,
+                                   std::ostream &out) {
+  if(calendars.size() == 1) {
+    calendars[0].print_agenda(from, count, days, out);
+    return;
+  }
+  //the first count of each source hold the first count of all of them
+  long int first = from.serial_time();
+  long int last = (days == 0) ? LONG_MAX : first + days - 1;
+  std::vector<std::vector<Event> > upcoming(calendars.size());
+  std::vector<std::pair<size_t, const Event *> > merged;
+  for(size_t i = 0; i < calendars.size(); ++i) {
+    calendars[i].get_index().upcoming(first, last, count, upcoming[i]);
+    for(const Event &e : upcoming[i]) merged.emplace_back(i, &e);
+  }
+  std::stable_sort(merged.begin(), merged.end(), [](const auto &x, const auto &y) {
+    return Event::starts_before(*x.second, *y.second);
+  });
+  for(size_t k = 0; k < merged.size() && k < count; ++k) {
+    out << Calendar::agenda_line(*merged[k].second) << "  [" << names[merged[k].first] << "]\n";
+  }
+  out.flush();
+}
@@ -0,0 +1,100 @@
+#ifndef SOURCES_H
+#define SOURCES_H
+
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "cal.h"
+#include "datetime.h"
+
+//several calendars shown as one. each source is a save file with its own
+//snapshot and journal, loaded on its own thread. views k-way merge the
+//sorted events of every source and changes are written back to the
+//source the event belongs to.
+class CalendarSources {
+private:
+  std::vector<std::string> paths;
+  //file name of each path without its extension, labels the source
+  std::vector<std::string> names;
+  std::vector<Calendar> calendars;
+  CalendarRange range;
+
+  //merge the events of every source over the range
+  void set_events();
+  //return the index of the source called source, 0 if empty. throws
+  //std::invalid_argument if there is no such source.
+  size_t find_source(std::string_view source) const;
+
+public:
+  // === Constructors ===
+
+  //no sources
+  CalendarSources();
+
+  // === Modifiers ===
+
+  //add the save file at path, or every .ics and .dat file in the
+  //directory at path in name order. sources are named by file name
+  //without extension. throws std::invalid_argument if a directory holds
+  //no calendars or a name is already taken.
+  void add_source(const std::string &path);
+  //load every source, each on its own thread. rethrows the first error.
+  void load_events();
+  //append changes to each source's journal in turn. the sources are not
+  //committed atomically: if one fails, the error names the sources whose
+  //changes were already written.
+  void commit_events();
+  void set_range(int by, unsigned bm, unsigned bd, int ey, unsigned em, unsigned ed);
+  //add an event to the source called source, the first one if empty.
+  //throws std::invalid_argument if there is no such source.
+  void add_new_event(std::string_view source, std::string_view title, std::string_view tag,
+                     Date &begin, Date &end, int begin_minute = Event::ALL_DAY,
+                     int end_minute = Event::ALL_DAY);
+  //apply records in order, adds to the source called target, the first
+  //one if empty, and removals to the source holding the key. see
+  //Calendar::apply_batch. throws std::invalid_argument if there is no
+  //source called target.
+  size_t apply_batch(std::string_view target, const std::vector<BatchRecord> &records,
+                     std::vector<BatchError> &errors);
+  //remove the event with uid or tag key from the source holding it. a key
+  //matching events of several sources lists them instead.
+  void remove_event(std::string_view key, std::ostream &out = std::cout);
+
+  // === Accessors ===
+
+  //return the number of sources
+  size_t size() const;
+  //return the name labelling source i
+  const std::string &get_name(size_t i) const;
+  //return the calendar of source i
+  Calendar &operator[](size_t i);
+  //write the merged calendar over the range to fd
+  void print(int fd = 1);
+  //write the merged day view of the first day of the range to fd
+  void print_day(int fd = 1);
+  //write the first count events of all sources ending on or after from,
+  //and beginning within days days of it unless days is 0, one line each
+  //labelled with its source when there are several
+  void print_agenda(const Date &from, size_t count, unsigned days, std::ostream &out = std::cout);
+  //write the runs of at least min_days days of the range without events
+  //in any source
+  void print_free(unsigned min_days, std::ostream &out = std::cout);
+  //write the busy days, peak and days with each of tags per month of the
+  //range over all sources, see write_stats
+  void print_stats(const std::vector<std::string> &tags, std::ostream &out = std::cout);
+  //write the agenda line of each event of any source overlapping e under
+  //a heading, nothing if there are none. returns their number.
+  size_t print_conflicts(const Event &e, std::ostream &out = std::cout);
+  //write the agenda line of each event of any source whose title and tag
+  //hold every word of query, only those with an occurrence in within if
+  //given, labelled with its source when there are several
+  void print_search(std::string_view query, const std::optional<TimeRange> &within = std::nullopt,
+                    std::ostream &out = std::cout);
+  //list the events of every source, under a header per source when
+  //there are several
+  void list_events(std::ostream &out = std::cout);
+};
+
+#endif
@@ -1,11 +1,57 @@
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <sstream>
 #include <string>
 #include <vector>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "color.h"
+#include "arena.h"
+#include "batch.h"
 #include "cal.h"  
+#include "config.h"
+#include "daemon.h"
 #include "datetime.h"
+#include "freebusy.h"
+#include "ics.h"
+#include "index.h"
+#include "profile.h"
+#include "rrule.h"
+#include "search.h"
+#include "slots.h"
+#include "snapshot.h"
+#include "sources.h"
+#include "watch.h"
+#include "zone.h"
+
+//heap allocations made by the test binary, see allocation_tests
+static size_t allocation_count = 0;
+
+void *operator new(size_t size) {
+  ++allocation_count;
+  if(void *p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, size_t) noexcept { std::free(p); }
 
 void date_tests() {
   std::cout << NUM_COLORS << std::endl;
@@ -61,6 +107,29 @@ void date_tests() {
     }
 
   }
+
+  //the serial based arithmetic must agree with std::chrono on every day
+  //of a wide range, including negative serials and century leap rules
+  static_assert(days_from_civil(1970, 1, 1) == 0);
+  static_assert(civil_from_days(11016).year == 2000 && civil_from_days(11016).month == 2);
+  static_assert(sizeof(Date) == 4);
+  for(int32_t serial = -200000; serial < 200000; ++serial) {
+    std::chrono::sys_days days{std::chrono::days{serial}};
+    std::chrono::year_month_day ymd{days};
+    Date d = Date(days);
+    assert(d.ymd_obj() == ymd);
+    assert(d.weekday_index() == std::chrono::weekday{days}.c_encoding());
+    assert(days_from_civil(d.year(), d.month(), d.day()) == serial);
+  }
+  Date leap = Date(2004, 2, 29);
+  leap.change_year(1);
+  assert(leap == Date(2005, 3, 1));
+  Date month_end = Date(2003, 1, 31);
+  month_end.change_month(-2);
+  assert(month_end == Date(2002, 12, 1));
+  Date stepped = Date(1999, 12, 31);
+  assert((stepped++) == Date(1999, 12, 31) && stepped == Date(2000, 1, 1));
+  std::cout << "Civil calendar arithmetic agrees with std::chrono" << std::endl;
 }
 
 
@@ -160,20 +229,1884 @@ void calendarrange_tests() {
   std::cout << cr3.print_cal();
 }
 
+void index_tests() {
+  StringArena titles;
+  std::vector<Event> events;
+  std::srand(4);
+  for(int i = 0; i < 500; ++i) {
+    Date b = Date(2020, 1, 1);
+    b.change_day(std::rand() % 1000);
+    Date e = b;
+    e.change_day((i % 50 == 0) ? std::rand() % 400 : std::rand() % 8);
+    events.emplace_back(titles.store("Event " + std::to_string(i)), "IDX", b, e);
+  }
+  EventIndex index(&events);
+  assert(index.size() == events.size());
+  for(size_t i = 1; i < index.size(); ++i) {
+    assert(!Event::starts_before(index[i], index[i-1]));
+  }
+
+  //compare range queries against a linear scan
+  for(int q = 0; q < 200; ++q) {
+    Date b = Date(2019, 12, 1);
+    b.change_day(std::rand() % 1100);
+    Date e = b;
+    e.change_day(std::rand() % 60);
+    TimeRange range = TimeRange(b, e);
+
+    std::vector<const Event *> found;
+    index.query(range, found);
+    size_t expected = 0;
+    for(size_t i = 0; i < events.size(); ++i) {
+      if(events[i].get_begin() <= e && events[i].get_end() >= b) ++expected;
+    }
+    assert(found.size() == expected);
+    for(size_t i = 0; i < found.size(); ++i) {
+      assert(found[i]->get_begin() <= e && found[i]->get_end() >= b);
+      if(i > 0) assert(!Event::starts_before(*found[i], *found[i-1]));
+    }
+  }
+
+  //extending with late and early starting events matches a rebuild
+  for(int i = 0; i < 2; ++i) {
+    Date b = Date(i == 0 ? 2030 : 2019, 1, 1);
+    events.emplace_back(titles.store("Appended"), "IDX", b, b);
+    index.extend();
+    EventIndex rebuilt(&events);
+    assert(index.size() == rebuilt.size());
+    for(size_t j = 0; j < index.size(); ++j) assert(&index[j] == &rebuilt[j]);
+  }
+}
+
+//the per day scan CalendarRange::set_events used before concurrency_profile
+std::vector<unsigned> concurrency_by_scan(const TimeRange &range,
+                                          const std::vector<const Event *> &events) {
+  std::vector<unsigned> profile;
+  for(Date d = range.get_begin(); d <= range.get_end(); ++d) {
+    unsigned events_on_day = 0;
+    for(size_t i = 0; i < events.size(); ++i) {
+      if(events[i]->contains(d)) ++events_on_day;
+    }
+    profile.push_back(events_on_day);
+  }
+  return profile;
+}
+
+void concurrency_tests() {
+  std::vector<Event> events;
+  std::srand(5);
+  for(int i = 0; i < 2000; ++i) {
+    Date b = Date(2022, 1, 1);
+    b.change_day(std::rand() % 800);
+    Date e = b;
+    e.change_day(std::rand() % 20);
+    events.emplace_back("Event", "CONC", b, e);
+  }
+  Date b = Date(2022, 6, 1);
+  Date e = Date(2023, 5, 31);
+  TimeRange year = TimeRange(b, e);
+  EventIndex index(&events);
+  std::vector<const Event *> in_range;
+  index.query(year, in_range);
+
+  auto t0 = std::chrono::steady_clock::now();
+  std::vector<unsigned> scanned = concurrency_by_scan(year, in_range);
+  auto t1 = std::chrono::steady_clock::now();
+  std::vector<unsigned> swept = concurrency_profile(year, in_range);
+  auto t2 = std::chrono::steady_clock::now();
+  assert(scanned == swept);
+
+  CalendarRange cr = CalendarRange(b, e);
+  cr.set_events(index);
+  assert(cr.get_concurrency() == swept);
+
+  std::chrono::duration<double, std::micro> scan_us = t1 - t0;
+  std::chrono::duration<double, std::micro> sweep_us = t2 - t1;
+  std::cout << "concurrency over " << swept.size() << " days, "
+            << in_range.size() << " events: scan " << scan_us.count()
+            << "us, sweep " << sweep_us.count() << "us" << std::endl;
+}
+
+void slot_tests() {
+  SlotAllocator slots;
+  assert(slots.assign(5) == 0);
+  assert(slots.assign(2) == 1);
+  assert(slots.assign(9) == 2);
+  //row 1 ends on day 2 and is free again from day 3
+  slots.release_before(2);
+  assert(slots.assign(4) == 3);
+  slots.release_before(3);
+  assert(slots.assign(3) == 1);
+  //rows 0, 1 and 3 free, the lowest are reused first
+  slots.release_before(6);
+  assert(slots.assign(7) == 0);
+  assert(slots.assign(7) == 1);
+  assert(slots.size() == 4);
+
+  //compare with a linear first free row scan on random events
+  std::vector<Event> events;
+  std::srand(6);
+  for(int i = 0; i < 300; ++i) {
+    Date b = Date(2021, 1, 1);
+    b.change_day(std::rand() % 200);
+    Date e = b;
+    e.change_day(std::rand() % 15);
+    events.emplace_back("Event", "SLOT", b, e);
+  }
+  EventIndex index(&events);
+  std::vector<long int> row_end;
+  SlotAllocator heap;
+  for(size_t i = 0; i < index.size(); ++i) {
+    long int b = index[i].get_begin().serial_time();
+    long int e = index[i].get_end().serial_time();
+    size_t row = 0;
+    while(row < row_end.size() && row_end[row] >= b) ++row;
+    if(row == row_end.size()) row_end.push_back(e);
+    else row_end[row] = e;
+    heap.release_before(b);
+    assert(heap.assign(e) == row);
+  }
+  assert(heap.size() == row_end.size());
+}
+
+//return allocations made rendering January 2024 from an index over
+//in_range events in that month plus far_away events in other years
+size_t month_render_allocations(size_t in_range, size_t far_away) {
+  std::vector<Event> events;
+  for(size_t i = 0; i < in_range; ++i) {
+    Date b = Date(2024, 1, static_cast<unsigned>(1 + i % 28));
+    Date e = b;
+    e.change_day(static_cast<int>(i % 4));
+    events.emplace_back("A long title that does not fit in place", "ALOC", b, e);
+  }
+  for(size_t i = 0; i < far_away; ++i) {
+    Date b = Date(2010, 1, 1);
+    b.change_day(static_cast<int>(i % 3000));
+    if(b.year() == 2024) b.change_year(2);
+    events.emplace_back("A long title that does not fit in place", "FAR", b, b);
+  }
+  EventIndex index(&events);
+  Date b = Date(2024, 1, 1);
+  Date e = Date(2024, 1, 31);
+
+  size_t before = allocation_count;
+  {
+    CalendarRange cr = CalendarRange(b, e);
+    cr.set_events(index);
+    std::string cal = cr.print_cal();
+    assert(!cal.empty());
+  }
+  return allocation_count - before;
+}
+
+void allocation_tests() {
+  //rendering a month does not copy events, so the allocations it makes
+  //depend on the events shown, not on the size of the calendar
+  size_t small = month_render_allocations(20, 100);
+  size_t large = month_render_allocations(20, 20000);
+  std::cout << "month render allocations: " << small << std::endl;
+  assert(small == large);
+  assert(small < 400);
+
+  //streaming to a file writes the same calendar, and reuses one buffer
+  //however many weeks the range covers
+  StringArena titles;
+  std::vector<Event> events;
+  for(int i = 0; i < 1200; ++i) {
+    Date b = Date(2000, 1, 1);
+    b.change_day(i * 9);
+    Date e = b;
+    e.change_day(i % 12);
+    events.emplace_back(titles.store("Stream " + std::to_string(i)), "STRM", b, e);
+  }
+  EventIndex index(&events);
+  auto stream_allocations = [&](int y, const std::string &path) {
+    Date b = Date(2000, 1, 1);
+    Date e = Date(y, 12, 31);
+    CalendarRange cr = CalendarRange(b, e);
+    cr.set_events(index);
+    FILE *f = fopen(path.c_str(), "w");
+    size_t before = allocation_count;
+    cr.print_cal(fileno(f));
+    size_t allocations = allocation_count - before;
+    fclose(f);
+    std::ifstream ifs(path);
+    std::string written((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    assert(written == cr.print_cal());
+    std::remove(path.c_str());
+    return allocations;
+  };
+  size_t one_year = stream_allocations(2000, "/tmp/planner_stream_test.out");
+  size_t many_years = stream_allocations(2029, "/tmp/planner_stream_test.out");
+  std::cout << "streamed render allocations: " << one_year << std::endl;
+  assert(one_year == many_years);
+}
+
+void arena_tests() {
+  StringArena arena;
+  std::string_view first = arena.store("first");
+  std::vector<std::string_view> stored;
+  for(int i = 0; i < 20000; ++i) {
+    stored.push_back(arena.store("title number " + std::to_string(i)));
+  }
+  std::string large(ARENA_BLOCK_SIZE, 'x');
+  std::string_view large_view = arena.store(large);
+
+  //earlier views stay valid as blocks are added
+  assert(first == "first");
+  for(int i = 0; i < 20000; ++i) {
+    assert(stored[i] == "title number " + std::to_string(i));
+  }
+  assert(large_view == large);
+  assert(arena.store("").empty());
+  assert(arena.capacity() >= arena.size());
+
+  //tags are stored inline in the event, truncated to four characters
+  Date d = Date(2024, 1, 1);
+  Event e = Event(first, "TAGGED", d, d);
+  assert(e.get_tag() == "TAGG");
+  assert(e.tag_key() == Event::tag_key("TAGG"));
+  assert(e.tag_key() == Event::tag_key("TAGGED"));
+  assert(e.tag_key() != Event::tag_key("TAG"));
+}
+
+void ics_tests() {
+  Date d = parse_tstamp("20231204T000000Z");
+  assert(d == Date(2023, 12, 4));
+  try {
+    parse_tstamp("2023X204T000000Z");
+    assert(false);
+  } catch (std::exception &ex) {
+    std::cout << "Caught expected exception for invalid timestamp:"
+              << std::endl << ex.what() << std::endl;
+  }
+
+  std::vector<Event> events;
+  StringArena arena;
+  parse_ics("BEGIN:VCALENDAR\r\n"
+            "BEGIN:VEVENT\r\n"
+            "SUMMARY:First\r\n"
+            "DESCRIPTION:ONE\r\n"
+            "DTSTART:20230101T000000Z\r\n"
+            "DTEND:20230103T000000Z\r\n"
+            "END:VEVENT\r\n"
+            "BEGIN:VEVENT\n"
+            "SUMMARY:Second\n"
+            "DESCRIPTION:TWO\n"
+            "DTSTART:20230105T000000Z\n"
+            "DTEND:20230105T000000Z\n"
+            "END:VEVENT\n"
+            "END:VCALENDAR\r\n", events, arena);
+  assert(events.size() == 2);
+  assert(events[0].get_title() == "First");
+  assert(events[0].get_tag() == "ONE");
+  assert(events[0].get_end() == Date(2023, 1, 3));
+  assert(events[1].get_title() == "Second");
+  assert(events[1].get_begin() == Date(2023, 1, 5));
+
+  //missing files load as an empty calendar
+  Calendar missing = Calendar();
+  missing.load_events("tests/does_not_exist.dat");
+  assert(missing.get_events().empty());
+}
+
+void journal_tests() {
+  std::string path = "/tmp/planner_journal_test.dat";
+  std::string journal_path = path + JOURNAL_SUFFIX;
+  std::remove(journal_path.c_str());
+  {
+    std::ofstream ofs(path);
+    ofs << "BEGIN:VCALENDAR\r\n"
+        << "BEGIN:VEVENT\r\nSUMMARY:Kept\r\nDESCRIPTION:KEEP\r\n"
+        << "DTSTART:20230101T000000Z\r\nDTEND:20230102T000000Z\r\nEND:VEVENT\r\n"
+        << "BEGIN:VEVENT\r\nSUMMARY:Dropped\r\nDESCRIPTION:DROP\r\n"
+        << "DTSTART:20230103T000000Z\r\nDTEND:20230104T000000Z\r\nEND:VEVENT\r\n"
+        << "END:VCALENDAR\r\n";
+    std::ofstream jfs(journal_path);
+    jfs << "ADD\t20230201T000000Z\t20230205T000000Z\tNEW\tnew@test\tAdded later\n"
+        << "ADD\t20230301T000000Z\t20230301T000000Z\tPART\tpart@test";
+  }
+
+  //complete records are replayed, a torn trailing record is ignored
+  Calendar cal = Calendar();
+  cal.load_events(path);
+  std::vector<Event> events = cal.get_events();
+  assert(events.size() == 3);
+  assert(events[2].get_title() == "Added later");
+  assert(events[2].get_uid() == "new@test");
+  assert(events[2].get_end() == Date(2023, 2, 5));
+
+  char tag[] = "DROP";
+  cal.remove_event(tag);
+  cal.commit_events(path);
+
+  //removal was appended to the journal and the ics file was not rewritten
+  Calendar reloaded = Calendar();
+  reloaded.load_events(path);
+  events = reloaded.get_events();
+  assert(events.size() == 2);
+  assert(events[0].get_tag() == "KEEP");
+  assert(events[1].get_tag() == "NEW");
+  std::ifstream ifs(path);
+  std::string contents((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  assert(contents.find("Dropped") != std::string::npos);
+
+  //a journal past JOURNAL_COMPACT_SIZE is folded into the ics file
+  {
+    std::ofstream jfs(journal_path, std::ofstream::app);
+    jfs << std::string(JOURNAL_COMPACT_SIZE, '#') << "\n";
+  }
+  char keep[] = "KEEP";
+  reloaded.remove_event(keep);
+  reloaded.commit_events(path);
+  std::ifstream compacted(path);
+  contents.assign(std::istreambuf_iterator<char>(compacted), std::istreambuf_iterator<char>());
+  assert(contents.find("Dropped") == std::string::npos);
+  assert(contents.find("Kept") == std::string::npos);
+  assert(contents.find("Added later") != std::string::npos);
+  std::ifstream compacted_journal(journal_path);
+  assert(compacted_journal.peek() == std::ifstream::traits_type::eof());
+
+  std::remove(path.c_str());
+  std::remove(journal_path.c_str());
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+}
+
+void uid_tests() {
+  std::string path = "/tmp/planner_uid_test.dat";
+  std::string journal_path = path + JOURNAL_SUFFIX;
+  std::remove(journal_path.c_str());
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+  {
+    std::ofstream ofs(path);
+    ofs << "BEGIN:VCALENDAR\r\n"
+        << "BEGIN:VEVENT\r\nUID:first@test\r\nSUMMARY:First\r\nDESCRIPTION:SAME\r\n"
+        << "DTSTART:20230101T000000Z\r\nDTEND:20230102T000000Z\r\nEND:VEVENT\r\n"
+        << "BEGIN:VEVENT\r\nSUMMARY:Second\r\nDESCRIPTION:SAME\r\n"
+        << "DTSTART:20230103T000000Z\r\nDTEND:20230104T000000Z\r\nEND:VEVENT\r\n"
+        << "BEGIN:VEVENT\r\nSUMMARY:Third\r\nDESCRIPTION:ONLY\r\n"
+        << "DTSTART:20230105T000000Z\r\nDTEND:20230106T000000Z\r\nEND:VEVENT\r\n"
+        << "END:VCALENDAR\r\n";
+  }
+
+  //events without a UID property get the same derived uid on every load
+  Calendar cal = Calendar();
+  cal.load_events(path);
+  std::vector<Event> events = cal.get_events();
+  assert(events.size() == 3);
+  assert(events[0].get_uid() == "first@test");
+  assert(!events[1].get_uid().empty());
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+  Calendar again = Calendar();
+  again.load_events(path);
+  assert(again.get_events()[1].get_uid() == events[1].get_uid());
+  assert(again.get_events()[2].get_uid() == events[2].get_uid());
+
+  //a tag shared by two events is ambiguous and removes nothing
+  char same[] = "SAME";
+  cal.remove_event(same);
+  assert(cal.get_events().size() == 3);
+
+  //a unique tag or a uid removes exactly that event
+  char only[] = "ONLY";
+  cal.remove_event(only);
+  assert(cal.get_events().size() == 2);
+  std::string second_uid(events[1].get_uid());
+  std::vector<char> uid_arg(second_uid.begin(), second_uid.end());
+  uid_arg.push_back('\0');
+  cal.remove_event(uid_arg.data());
+  assert(cal.get_events().size() == 1);
+  assert(cal.get_events()[0].get_title() == "First");
+  cal.commit_events(path);
+
+  //removals are replayed by uid
+  Calendar reloaded = Calendar();
+  reloaded.load_events(path);
+  assert(reloaded.get_events().size() == 1);
+  assert(reloaded.get_events()[0].get_uid() == "first@test");
+
+  //uids are written back to the ics file
+  reloaded.save_events(path);
+  std::remove(journal_path.c_str());
+  std::ifstream ifs(path);
+  std::string contents((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  assert(contents.find("UID:first@test\r\n") != std::string::npos);
+
+  std::remove(path.c_str());
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+}
+
+void snapshot_tests() {
+  std::string path = "/tmp/planner_snapshot_test.dat";
+  std::string snap_path = path + SNAPSHOT_SUFFIX;
+  std::remove(snap_path.c_str());
+  {
+    std::ofstream ofs(path);
+    ofs << "BEGIN:VCALENDAR\r\n"
+        << "BEGIN:VEVENT\r\nSUMMARY:Later\r\nDESCRIPTION:LATE\r\n"
+        << "DTSTART:20230301T000000Z\r\nDTEND:20230302T000000Z\r\nEND:VEVENT\r\n"
+        << "BEGIN:VEVENT\r\nSUMMARY:Earlier\r\nDESCRIPTION:EARLYTAG\r\n"
+        << "DTSTART:20230103T000000Z\r\nDTEND:20230104T000000Z\r\nEND:VEVENT\r\n"
+        << "END:VCALENDAR\r\n";
+  }
+
+  //first load parses the ics file and builds the snapshot
+  Calendar parsed = Calendar();
+  parsed.load_events(path);
+  std::vector<Event> expected = parsed.get_events();
+  assert(expected.size() == 2);
+  assert(expected[0].get_title() == "Earlier");
+  assert(expected[0].get_tag() == "EARL");
+  assert(expected[1].get_title() == "Later");
+
+  std::vector<Event> events;
+  StringArena arena;
+  SnapshotSource source = snapshot_source(path);
+  assert(load_snapshot(snap_path, source, events, arena));
+  assert(events.size() == 2);
+  for(size_t i = 0; i < events.size(); ++i) {
+    assert(events[i].get_title() == expected[i].get_title());
+    assert(events[i].get_tag() == expected[i].get_tag());
+    assert(events[i].get_begin() == expected[i].get_begin());
+    assert(events[i].get_end() == expected[i].get_end());
+  }
+
+  //a snapshot of another version of the ics file is stale
+  SnapshotSource other = source;
+  ++other.mtime_ns;
+  events.clear();
+  assert(!load_snapshot(snap_path, other, events, arena));
+  assert(events.empty());
+
+  //a corrupt snapshot is rejected and rebuilt from the ics file
+  {
+    std::fstream fs(snap_path, std::fstream::in | std::fstream::out | std::fstream::binary);
+    fs.seekp(-1, std::fstream::end);
+    fs.put('#');
+  }
+  assert(!load_snapshot(snap_path, source, events, arena));
+  Calendar rebuilt = Calendar();
+  rebuilt.load_events(path);
+  assert(rebuilt.get_events().size() == 2);
+  assert(rebuilt.get_events()[1].get_title() == "Later");
+  assert(load_snapshot(snap_path, source, events, arena));
+
+  //a snapshot that cannot be written is reported, not thrown
+  assert(!save_snapshot("/nonexistent/planner" + std::string(SNAPSHOT_SUFFIX), source,
+                        rebuilt.get_events()));
+
+  std::remove(path.c_str());
+  std::remove(snap_path.c_str());
+}
+
+//return everything written to a file by f(fd)
+template <typename F>
+std::string capture_fd(F f) {
+  std::string path = "/tmp/planner_capture_test.out";
+  FILE *file = fopen(path.c_str(), "w");
+  f(fileno(file));
+  fclose(file);
+  std::ifstream ifs(path);
+  std::string contents((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  std::remove(path.c_str());
+  return contents;
+}
+
+//write one VEVENT in the format save_events uses
+std::string vevent(const std::string &title, const std::string &tag, const std::string &day) {
+  return "BEGIN:VEVENT\r\nSUMMARY:" + title + "\r\nDESCRIPTION:" + tag + "\r\nDTSTART:" + day +
+         "T000000Z\r\nDTEND:" + day + "T000000Z\r\nEND:VEVENT\r\n";
+}
+
+void refresh_tests() {
+  std::string path = "/tmp/planner_refresh_test.dat";
+  std::remove((path + JOURNAL_SUFFIX).c_str());
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+  std::string head = "BEGIN:VCALENDAR\r\n" + vevent("First", "ONE", "20240101") +
+                     vevent("Second", "TWO", "20240105");
+  {
+    std::ofstream ofs(path);
+    ofs << head << "END:VCALENDAR\r\n";
+  }
+  FileWatcher watcher({path, path + JOURNAL_SUFFIX});
+  Calendar cal = Calendar();
+  cal.load_events(path);
+  cal.set_range(2024, 1, 1, 2024, 1, 31);
+  capture_fd([&](int fd) { cal.print(fd); });
+  assert(cal.refresh() == Reload::NONE);
+  watcher.changed();
+
+  //an event inserted in place before END:VCALENDAR is parsed on its own
+  {
+    std::fstream fs(path, std::fstream::in | std::fstream::out | std::fstream::binary);
+    fs.seekp(static_cast<std::streamoff>(head.length()));
+    fs << vevent("Third", "THR", "20240110") << "END:VCALENDAR\r\n";
+  }
+  assert(watcher.changed());
+  assert(cal.refresh() == Reload::INCREMENTAL);
+  assert(cal.get_events().size() == 3);
+  assert(cal.get_events()[2].get_title() == "Third");
+  std::string printed = capture_fd([&](int fd) { cal.print(fd); });
+  assert(printed.find("Third") != std::string::npos);
+
+  //records another process journals are replayed, our own are not
+  Calendar other = Calendar();
+  other.load_events(path);
+  char tag[] = "ONE";
+  other.remove_event(tag);
+  other.commit_events(path);
+  assert(cal.refresh() == Reload::INCREMENTAL);
+  assert(cal.get_events().size() == 2);
+  Date b = Date(2024, 2, 1);
+  cal.add_new_event("Mine", "MINE", b, b);
+  cal.commit_events(path);
+  assert(cal.refresh() == Reload::NONE);
+  assert(cal.get_events().size() == 3);
+
+  //a rewrite that cannot be localized reloads everything
+  {
+    std::ofstream ofs(path + ".tmp");
+    ofs << "BEGIN:VCALENDAR\r\n" << vevent("Replaced", "REP", "20240301") << "END:VCALENDAR\r\n";
+  }
+  std::rename((path + ".tmp").c_str(), path.c_str());
+  assert(watcher.changed());
+  assert(cal.refresh() == Reload::FULL);
+  //the journal still removes ONE and adds MINE on top of the new file
+  assert(cal.get_events().size() == 2);
+  assert(cal.get_events()[0].get_title() == "Replaced");
+
+  std::remove(path.c_str());
+  std::remove((path + JOURNAL_SUFFIX).c_str());
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+  std::cout << "Refresh parses appended events and journal records only" << std::endl;
+}
+
+void daemon_tests() {
+  std::string path = "/tmp/planner_daemon_test.dat";
+  std::string socket_path = path + DAEMON_SOCKET_SUFFIX;
+  std::remove((path + JOURNAL_SUFFIX).c_str());
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+  {
+    std::ofstream ofs(path);
+    ofs << "BEGIN:VCALENDAR\r\n"
+        << "BEGIN:VEVENT\r\nUID:served@test\r\nSUMMARY:Served\r\nDESCRIPTION:SERV\r\n"
+        << "DTSTART:20240102T000000Z\r\nDTEND:20240103T000000Z\r\nEND:VEVENT\r\n"
+        << "END:VCALENDAR\r\n";
+  }
+  //without a daemon requests fall through to the caller
+  assert(!daemon_request(socket_path, "LIST", STDOUT_FILENO));
+
+  pid_t daemon = fork();
+  if(daemon == 0) {
+    run_daemon(path, socket_path);
+    _exit(0);
+  }
+  std::string listed;
+  for(int i = 0; i < 1000 && listed.empty(); ++i) {
+    listed = capture_fd([&](int fd) { daemon_request(socket_path, "LIST", fd); });
+    if(listed.empty()) usleep(1000);
+  }
+  assert(listed.find("Served") != std::string::npos);
+
+  //a client that connects and never sends its request is dropped
+  int stalled = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+  assert(connect(stalled, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+  listed = capture_fd([&](int fd) { daemon_request(socket_path, "LIST", fd); });
+  assert(listed.find("Served") != std::string::npos);
+  char closed;
+  assert(read(stalled, &closed, 1) == 0);
+  close(stalled);
+
+  //the daemon renders the same calendar a direct load does
+  Calendar direct = Calendar();
+  direct.load_events(path);
+  direct.set_range(2024, 1, 1, 2024, 1, 31);
+  std::string expected = capture_fd([&](int fd) { direct.print(fd); });
+  std::string served = capture_fd([&](int fd) {
+    daemon_request(socket_path, "PRINT\t20240101T000000Z\t20240131T000000Z", fd);
+  });
+  assert(served == expected);
+
+  //changes are answered from memory and appended to the journal
+  capture_fd([&](int fd) {
+    daemon_request(socket_path, "ADD\t20240110T000000Z\t20240111T000000Z\tDMN\tAdded by daemon", fd);
+  });
+  std::string removed = capture_fd([&](int fd) { daemon_request(socket_path, "REMOVE\tSERV", fd); });
+  assert(removed.empty());
+  listed = capture_fd([&](int fd) { daemon_request(socket_path, "LIST", fd); });
+  assert(listed.find("Added by daemon") != std::string::npos);
+  assert(listed.find("Served") == std::string::npos);
+
+  //a request the daemon fails is reported, not answered
+  bool failed = false;
+  std::string answered = capture_fd([&](int fd) {
+    try {
+      daemon_request(socket_path, "BOGUS", fd);
+    } catch(std::runtime_error &ex) {
+      failed = std::string(ex.what()) == "unknown request";
+    }
+  });
+  assert(failed && answered.empty());
+
+  //a change that cannot be journaled is refused and not kept in memory
+  std::string lock_path = path + LOCK_SUFFIX;
+  std::remove(lock_path.c_str());
+  mkdir(lock_path.c_str(), 0755);
+  failed = false;
+  try {
+    daemon_request(socket_path, "ADD\t20240112T000000Z\t20240113T000000Z\tLOST\tUnwritten", STDOUT_FILENO);
+  } catch(std::runtime_error &) {
+    failed = true;
+  }
+  rmdir(lock_path.c_str());
+  assert(failed);
+  listed = capture_fd([&](int fd) { daemon_request(socket_path, "LIST", fd); });
+  assert(listed.find("Unwritten") == std::string::npos);
+  assert(listed.find("Added by daemon") != std::string::npos);
+
+  //a save file that cannot be read is reported while it lasts, the daemon
+  //keeps serving and picks the calendar up again once it is fixed
+  std::rename(path.c_str(), (path + ".good").c_str());
+  {
+    std::ofstream ofs(path);
+    ofs << "BEGIN:VCALENDAR\r\nBEGIN:VEVENT\r\nSUMMARY:Broken\r\nDESCRIPTION:BRKN\r\n"
+        << "DTSTART:2024XX02T000000Z\r\nDTEND:20240103T000000Z\r\nEND:VEVENT\r\nEND:VCALENDAR\r\n";
+  }
+  failed = false;
+  try {
+    daemon_request(socket_path, "LIST", STDOUT_FILENO);
+  } catch(std::runtime_error &) {
+    failed = true;
+  }
+  assert(failed);
+  std::rename((path + ".good").c_str(), path.c_str());
+  listed = capture_fd([&](int fd) { daemon_request(socket_path, "LIST", fd); });
+  assert(listed.find("Added by daemon") != std::string::npos);
+  kill(daemon, SIGTERM);
+  waitpid(daemon, nullptr, 0);
+
+  Calendar reloaded = Calendar();
+  reloaded.load_events(path);
+  assert(reloaded.get_events().size() == 1);
+  assert(reloaded.get_events()[0].get_title() == "Added by daemon");
+  std::ifstream sock(socket_path);
+  assert(!sock.good());
+  std::remove(path.c_str());
+  std::remove((path + JOURNAL_SUFFIX).c_str());
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+  std::cout << "Daemon serves the calendar and journals its changes" << std::endl;
+}
+
+void profile_tests() {
+  profile.enabled = true;
+  profile_reset();
+  Calendar cal = Calendar();
+  cal.load_events("tests/test.dat");
+  {
+    Date b = Date(2023, 12, 1);
+    Date e = Date(2023, 12, 31);
+    CalendarRange range = CalendarRange(b, e);
+    EventIndex index(&cal.get_events());
+    range.set_events(index);
+    FILE *null_file = fopen("/dev/null", "w");
+    range.print_cal(fileno(null_file));
+    fclose(null_file);
+  }
+  assert(profile.calls[PHASE_LOAD] == 1);
+  assert(profile.calls[PHASE_FILTER] == 1);
+  assert(profile.calls[PHASE_RENDER] == 1);
+  assert(profile.counters[COUNT_EVENTS_LOADED] == 1);
+  assert(profile.counters[COUNT_EVENTS_IN_RANGE] == 1);
+  assert(profile.counters[COUNT_DAYS_ITERATED] == 31);
+  assert(profile.counters[COUNT_BYTES_WRITTEN] > 0);
+
+  std::ostringstream json;
+  profile_report(json, true);
+  assert(json.str().find("\"events_in_range\":1") != std::string::npos);
+  std::ostringstream text;
+  profile_report(text, false);
+  assert(text.str().find("render") != std::string::npos);
+  profile.enabled = false;
+  profile_reset();
+  std::cout << "Profile counters match the rendered range" << std::endl;
+}
+
+void rrule_tests() {
+  auto serial = [](int y, unsigned m, unsigned d) { return static_cast<int32_t>(Date(y, m, d).serial_time()); };
+  auto expand = [&](const std::string &value, int32_t dtstart, int32_t lo, int32_t hi) {
+    std::vector<int32_t> out;
+    Recurrence::parse(value, dtstart).starts(dtstart, lo, hi, out);
+    return out;
+  };
+
+  //hand checked expansions
+  int32_t jan1 = serial(2024, 1, 1);
+  std::vector<int32_t> got = expand("FREQ=MONTHLY;BYDAY=-1FR", jan1, jan1, serial(2024, 3, 31));
+  assert((got == std::vector<int32_t>{serial(2024, 1, 26), serial(2024, 2, 23), serial(2024, 3, 29)}));
+  got = expand("FREQ=WEEKLY;INTERVAL=2;BYDAY=MO,WE;COUNT=4", jan1, jan1, serial(2024, 12, 31));
+  assert((got == std::vector<int32_t>{jan1, serial(2024, 1, 3), serial(2024, 1, 15), serial(2024, 1, 17)}));
+  got = expand("FREQ=DAILY;INTERVAL=3;UNTIL=20240110T000000Z", jan1, jan1, serial(2024, 12, 31));
+  assert((got == std::vector<int32_t>{jan1, serial(2024, 1, 4), serial(2024, 1, 7), serial(2024, 1, 10)}));
+  got = expand("FREQ=MONTHLY;BYDAY=1MO,1TH", jan1, jan1, serial(2024, 2, 29));
+  assert((got == std::vector<int32_t>{jan1, serial(2024, 1, 4), serial(2024, 2, 1), serial(2024, 2, 5)}));
+
+  //the 31st is skipped in shorter months and february 29th outside leap years
+  int32_t jan31 = serial(2024, 1, 31);
+  got = expand("FREQ=MONTHLY", jan31, jan31, serial(2024, 5, 31));
+  assert((got == std::vector<int32_t>{jan31, serial(2024, 3, 31), serial(2024, 5, 31)}));
+  int32_t leap = serial(2024, 2, 29);
+  got = expand("FREQ=YEARLY", leap, leap, serial(2032, 12, 31));
+  assert((got == std::vector<int32_t>{leap, serial(2028, 2, 29), serial(2032, 2, 29)}));
+
+  //windows far into a series match a full expansion
+  const char *rules[] = {"FREQ=DAILY;BYDAY=TU,SA", "FREQ=WEEKLY;INTERVAL=3;BYDAY=SU,FR",
+                         "FREQ=MONTHLY;INTERVAL=5;BYDAY=2WE", "FREQ=YEARLY;INTERVAL=2",
+                         "FREQ=WEEKLY;COUNT=300"};
+  int32_t dtstart = serial(2001, 7, 19);
+  int32_t horizon = serial(2030, 1, 1);
+  for(const char *rule : rules) {
+    std::vector<int32_t> full = expand(rule, dtstart, dtstart, horizon);
+    for(int32_t lo = dtstart - 40; lo < horizon; lo += 397) {
+      int32_t hi = lo + 60;
+      std::vector<int32_t> expected;
+      for(int32_t s : full) if(s >= lo && s <= hi) expected.push_back(s);
+      assert(expand(rule, dtstart, lo, hi) == expected);
+    }
+  }
+
+  //unsupported rules leave a single event
+  assert(!Recurrence::parse("FREQ=HOURLY", jan1).recurs());
+  assert(!Recurrence::parse("FREQ=WEEKLY;BYSETPOS=1", jan1).recurs());
+  assert(!Recurrence::parse("FREQ=MONTHLY;BYDAY=1MO,2TU", jan1).recurs());
+  assert(Recurrence::parse("FREQ=WEEKLY;INTERVAL=2;BYDAY=MO,WE;COUNT=4", jan1).to_string()
+         == "FREQ=WEEKLY;INTERVAL=2;COUNT=4;BYDAY=MO,WE");
+
+  //a range shows the occurrences of a series but not the ones outside it
+  std::string path = "/tmp/planner_rrule_test.dat";
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+  {
+    std::ofstream ofs(path);
+    ofs << "BEGIN:VCALENDAR\r\n"
+        << "BEGIN:VEVENT\r\nSUMMARY:Standup\r\nDESCRIPTION:STAN\r\n"
+        << "DTSTART:20200106T000000Z\r\nDTEND:20200107T000000Z\r\n"
+        << "RRULE:FREQ=WEEKLY;BYDAY=MO\r\nEND:VEVENT\r\n"
+        << vevent("Once", "ONCE", "20240103")
+        << "END:VCALENDAR\r\n";
+  }
+  Calendar c = Calendar();
+  c.load_events(path);
+  assert(c.get_events().size() == 2);
+  assert(c.get_events()[0].recurs());
+  Date b = Date(2024, 1, 1);
+  Date e = Date(2024, 1, 14);
+  CalendarRange range = CalendarRange(b, e);
+  EventIndex index(&c.get_events());
+  range.set_events(index);
+  std::vector<unsigned> expected = {1, 1, 1, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0};
+  assert(range.get_concurrency() == expected);
+
+  //the rule survives a save and the snapshot of the saved file
+  std::string saved = "/tmp/planner_rrule_saved.dat";
+  std::remove((saved + SNAPSHOT_SUFFIX).c_str());
+  c.save_events(saved);
+  for(int load = 0; load < 2; ++load) {
+    Calendar reloaded = Calendar();
+    reloaded.load_events(saved);
+    assert(reloaded.get_events().size() == 2);
+    assert(reloaded.get_events()[0].get_rule() == c.get_events()[0].get_rule());
+    assert(!reloaded.get_events()[1].recurs());
+  }
+  std::vector<Event> events;
+  StringArena arena;
+  assert(load_snapshot(saved + SNAPSHOT_SUFFIX, snapshot_source(saved), events, arena));
+  assert(events[0].get_rule() == c.get_events()[0].get_rule());
+  std::cout << "Expanded " << c.get_events()[0].get_rule().to_string() << " lazily" << std::endl;
+
+  for(const std::string &p : {path, saved}) {
+    std::remove(p.c_str());
+    std::remove((p + SNAPSHOT_SUFFIX).c_str());
+    std::remove((p + JOURNAL_SUFFIX).c_str());
+  }
+}
+
+void zone_tests() {
+  //utc second of a utc civil time
+  auto utc = [](int y, unsigned m, unsigned d, int h, int min) {
+    return static_cast<int64_t>(days_from_civil(y, m, d)) * 86400 + h * 3600 + min * 60;
+  };
+  const TimeZone *berlin = TimeZone::locate("Europe/Berlin");
+  const TimeZone *new_york = TimeZone::locate("America/New_York");
+  assert(berlin && new_york);
+  assert(TimeZone::locate("Europe/Berlin") == berlin);
+  assert(!TimeZone::locate("Nowhere/Zone"));
+  assert(!TimeZone::locate("../../etc/passwd"));
+
+  //transitions from the zoneinfo tables
+  assert(berlin->offset_at(utc(2024, 1, 15, 12, 0)) == 3600);
+  assert(berlin->offset_at(utc(2024, 3, 31, 1, 0) - 1) == 3600);
+  assert(berlin->offset_at(utc(2024, 3, 31, 1, 0)) == 7200);
+  assert(new_york->offset_at(utc(2024, 3, 10, 7, 0)) == -4 * 3600);
+  assert(new_york->offset_at(utc(2024, 11, 3, 6, 0) - 1) == -4 * 3600);
+  assert(new_york->offset_at(utc(2024, 11, 3, 6, 0)) == -5 * 3600);
+  //and past them, from the TZ rule at the end of the file
+  assert(berlin->offset_at(utc(2090, 7, 1, 0, 0)) == 7200);
+  assert(berlin->offset_at(utc(2090, 12, 1, 0, 0)) == 3600);
+  assert(new_york->offset_at(utc(2095, 3, 13, 7, 0)) == -4 * 3600);
+
+  //local times skipped by a transition read with the offset before it,
+  //repeated ones resolve to the first occurrence
+  assert(berlin->to_utc(utc(2024, 3, 31, 2, 30)) == utc(2024, 3, 31, 1, 30));
+  assert(berlin->to_utc(utc(2024, 10, 27, 2, 30)) == utc(2024, 10, 27, 0, 30));
+  assert(berlin->to_utc(utc(2024, 10, 27, 3, 30)) == utc(2024, 10, 27, 2, 30));
+  for(int64_t t = utc(2023, 1, 1, 0, 0); t < utc(2025, 1, 1, 0, 0); t += 3 * 3541) {
+    assert(berlin->to_utc(berlin->to_local(t)) == t || berlin->offset_at(t) == 3600);
+  }
+
+  //ics values converted to the display zone
+  IcsTime t = parse_ics_time("20240301T093000", "TZID=Europe/Berlin", TimeZone::utc());
+  assert(t.day == Date(2024, 3, 1) && t.minute == 8 * 60 + 30);
+  t = parse_ics_time("20240301T013000Z", "", *new_york);
+  assert(t.day == Date(2024, 2, 29) && t.minute == 20 * 60 + 30);
+  t = parse_ics_time("20240301T093000", "TZID=\"Europe/Berlin\";X-PARAM=1", *berlin);
+  assert(t.day == Date(2024, 3, 1) && t.minute == 9 * 60 + 30);
+  t = parse_ics_time("20240301T000000Z", "", *new_york);
+  assert(t.day == Date(2024, 2, 29) && t.minute == 19 * 60);
+  IcsTime b, e;
+  parse_ics_span("20240301T000000Z", "20240302T000000Z", b, e, *new_york);
+  assert(b.day == Date(2024, 3, 1) && b.minute == Event::ALL_DAY && e.day == Date(2024, 3, 2));
+  parse_ics_span("20240301T220000", "20240302T000000", b, e, TimeZone::utc());
+  assert(b.minute == 22 * 60 && e.day == Date(2024, 3, 1) && e.minute == Event::MINUTES_PER_DAY);
+
+  //an event is all day only if both ends are midnight utc, timed events
+  //starting or ending then keep their times in any display zone
+  std::string_view midnights =
+    "BEGIN:VCALENDAR\r\n"
+    "BEGIN:VEVENT\r\nSUMMARY:Late\r\nDESCRIPTION:LATE\r\n"
+    "DTSTART:20240105T220000Z\r\nDTEND:20240106T000000Z\r\nEND:VEVENT\r\n"
+    "BEGIN:VEVENT\r\nSUMMARY:Early\r\nDESCRIPTION:EARL\r\n"
+    "DTSTART:20240108T000000Z\r\nDTEND:20240108T010000Z\r\nEND:VEVENT\r\n"
+    "BEGIN:VEVENT\r\nSUMMARY:Holiday\r\nDESCRIPTION:HOLI\r\n"
+    "DTSTART:20240109T000000Z\r\nDTEND:20240109T000000Z\r\nEND:VEVENT\r\n"
+    "END:VCALENDAR\r\n";
+  for(const TimeZone *zone : {&TimeZone::utc(), new_york}) {
+    std::vector<Event> parsed;
+    StringArena strings;
+    assert(parse_ics(midnights, parsed, strings, *zone));
+    assert(parsed.size() == 3 && parsed[0].is_timed() && parsed[1].is_timed() && !parsed[2].is_timed());
+    bool utc_zone = zone == &TimeZone::utc();
+    assert(parsed[0].get_begin() == Date(2024, 1, 5) && parsed[0].get_end() == Date(2024, 1, 5));
+    assert(parsed[0].get_begin_minute() == (utc_zone ? 22 : 17) * 60);
+    assert(parsed[0].get_end_minute() == (utc_zone ? Event::MINUTES_PER_DAY : 19 * 60));
+    assert(parsed[1].get_begin() == Date(2024, 1, utc_zone ? 8 : 7));
+    assert(parsed[1].get_begin_minute() == (utc_zone ? 0 : 19 * 60));
+    assert(parsed[1].get_end_minute() == (utc_zone ? 60 : 20 * 60));
+    assert(parsed[2].get_begin() == Date(2024, 1, 9) && parsed[2].get_end() == Date(2024, 1, 9));
+  }
+  t = parse_ics_time("20240301", "VALUE=DATE");
+  assert(t.minute == Event::ALL_DAY);
+  assert(format_ics_time("DTSTART", Date(2024, 3, 1), 9 * 60 + 30, *berlin)
+         == "DTSTART;TZID=Europe/Berlin:20240301T093000");
+  assert(format_ics_time("DTEND", Date(2024, 3, 1), Event::MINUTES_PER_DAY, *berlin)
+         == "DTEND;TZID=Europe/Berlin:20240302T000000");
+  assert(format_ics_time("DTEND", Date(2024, 3, 1), Event::ALL_DAY) == "DTEND:20240301T000000Z");
+  try {
+    parse_ics_time("20240301T253000");
+    assert(false);
+  } catch (std::invalid_argument &ex) {
+    std::cout << "Caught expected exception for invalid time:" << std::endl << ex.what() << std::endl;
+  }
+}
+
+void timed_event_tests() {
+  //a meeting in new york seen from berlin, one ending at midnight and an
+  //all day event on the same day
+  std::vector<Event> events;
+  StringArena arena;
+  parse_ics("BEGIN:VCALENDAR\r\n"
+            "BEGIN:VEVENT\r\nSUMMARY:Call\r\nDESCRIPTION:CALL\r\n"
+            "DTSTART;TZID=America/New_York:20240301T190000\r\n"
+            "DTEND;TZID=America/New_York:20240301T200000\r\nEND:VEVENT\r\n"
+            "BEGIN:VEVENT\r\nSUMMARY:Late\r\nDESCRIPTION:LATE\r\n"
+            "DTSTART;TZID=Europe/Berlin:20240301T230000\r\n"
+            "DTEND;TZID=Europe/Berlin:20240302T000000\r\nEND:VEVENT\r\n"
+            "END:VCALENDAR\r\n", events, arena, *TimeZone::locate("Europe/Berlin"));
+  assert(events.size() == 2);
+  assert(events[0].is_timed());
+  assert(events[0].get_begin() == Date(2024, 3, 2) && events[0].get_begin_minute() == 60);
+  assert(events[0].get_end() == Date(2024, 3, 2) && events[0].get_end_minute() == 120);
+  assert(events[1].get_end() == Date(2024, 3, 1));
+  assert(events[1].get_end_minute() == Event::MINUTES_PER_DAY);
+
+  std::string path = "/tmp/planner_timed_test.dat";
+  std::string saved = "/tmp/planner_timed_saved.dat";
+  for(const std::string &p : {path, saved}) {
+    std::remove((p + SNAPSHOT_SUFFIX).c_str());
+    std::remove((p + JOURNAL_SUFFIX).c_str());
+  }
+  {
+    std::ofstream ofs(path);
+    ofs << "BEGIN:VCALENDAR\r\n"
+        << "BEGIN:VEVENT\r\nSUMMARY:Standup\r\nDESCRIPTION:STAN\r\n"
+        << "DTSTART;TZID=Europe/Berlin:20240304T093000\r\n"
+        << "DTEND;TZID=Europe/Berlin:20240304T094500\r\nEND:VEVENT\r\n"
+        << vevent("Holiday", "HOLI", "20240304")
+        << "END:VCALENDAR\r\n";
+  }
+  Calendar c = Calendar();
+  c.load_events(path);
+  assert(c.get_events().size() == 2);
+  //all day events sort before timed ones starting the same day
+  assert(!c.get_events()[0].is_timed());
+  assert(c.get_events()[1].get_begin_minute() == 8 * 60 + 30);
+  Date day = Date(2024, 3, 4);
+  c.add_new_event("Review", "REVW", day, day, 8 * 60 + 45, 10 * 60);
+  c.commit_events(path);
+
+  //the journal and a save keep the times, the snapshot of the save too
+  Calendar journaled = Calendar();
+  journaled.load_events(path);
+  assert(journaled.get_events().size() == 3);
+  assert(journaled.get_events()[2].get_begin_minute() == 8 * 60 + 45);
+  assert(journaled.get_events()[2].get_end_minute() == 10 * 60);
+  journaled.save_events(saved);
+  std::ifstream ifs(saved);
+  std::string contents((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  assert(contents.find("DTSTART;TZID=UTC:20240304T083000\r\n") != std::string::npos);
+  assert(contents.find("DTSTART:20240304T000000Z\r\n") != std::string::npos);
+  for(int load = 0; load < 2; ++load) {
+    Calendar reloaded = Calendar();
+    reloaded.load_events(saved);
+    const std::vector<Event> &e = reloaded.get_events();
+    assert(e.size() == 3);
+    for(size_t i = 0; i < e.size(); ++i) {
+      assert(e[i].get_begin_minute() == journaled.get_events()[i].get_begin_minute());
+      assert(e[i].get_end_minute() == journaled.get_events()[i].get_end_minute());
+    }
+  }
+
+  //the grid shows start times, the day view lays the events out by hour
+  journaled.set_range(2024, 3, 4, 2024, 3, 4);
+  std::string grid = capture_fd([&](int fd) { journaled.print(fd); });
+  assert(grid.find("0830") != std::string::npos);
+  assert(grid.find("08:30-08:45 Standup") != std::string::npos);
+  std::string view = capture_fd([&](int fd) { journaled.print_day(fd); });
+  assert(view.find("MON 4 MAR 2024") == 0);
+  assert(view.find("all day ") != std::string::npos);
+  size_t eight = view.find("08:00");
+  size_t nine = view.find("09:00");
+  assert(eight != std::string::npos && nine != std::string::npos && view.find("19:00") != std::string::npos);
+  assert(view.find("0830", eight) < nine && view.find("0845", eight) < nine);
+  assert(view.find("06:00") == std::string::npos);
+  std::cout << view.substr(0, view.find("07:00")) << std::flush;
+
+  //an event ending at midnight is journaled as 00:00 the next day and
+  //replayed as 24:00 of its own day
+  {
+    std::string late_path = "/tmp/planner_midnight_test.dat";
+    std::remove((late_path + JOURNAL_SUFFIX).c_str());
+    std::remove((late_path + SNAPSHOT_SUFFIX).c_str());
+    std::remove(late_path.c_str());
+    Calendar late = Calendar();
+    late.load_events(late_path);
+    Date sunday(2024, 3, 3);
+    Date same_day = sunday;
+    late.add_new_event("Late", "LATE", sunday, same_day, 22 * 60, Event::MINUTES_PER_DAY);
+    late.commit_events(late_path);
+    Calendar replayed = Calendar();
+    replayed.load_events(late_path);
+    const Event &e = replayed.get_events().at(0);
+    assert(e.get_end() == sunday && e.get_end_minute() == Event::MINUTES_PER_DAY);
+    assert(Calendar::agenda_line(e) == "SUN 2024-03-03 22:00-24:00 LATE Late");
+    std::remove((late_path + JOURNAL_SUFFIX).c_str());
+    std::remove((late_path + SNAPSHOT_SUFFIX).c_str());
+    std::remove((late_path + LOCK_SUFFIX).c_str());
+    std::remove(late_path.c_str());
+  }
+
+  for(const std::string &p : {path, saved}) {
+    std::remove(p.c_str());
+    std::remove((p + SNAPSHOT_SUFFIX).c_str());
+    std::remove((p + JOURNAL_SUFFIX).c_str());
+  }
+}
+
+//true if a and b hold the same events field by field
+static bool same_events(const std::vector<Event> &a, const std::vector<Event> &b) {
+  if(a.size() != b.size()) return false;
+  for(size_t i = 0; i < a.size(); ++i) {
+    if(a[i].get_title() != b[i].get_title() || a[i].get_tag() != b[i].get_tag() ||
+       a[i].get_uid() != b[i].get_uid() || !(a[i].get_begin() == b[i].get_begin()) ||
+       !(a[i].get_end() == b[i].get_end()) || a[i].get_begin_minute() != b[i].get_begin_minute() ||
+       a[i].get_end_minute() != b[i].get_end_minute() || !(a[i].get_rule() == b[i].get_rule())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void parallel_parse_tests() {
+  std::string buf = "BEGIN:VCALENDAR\r\n";
+  for(int i = 0; i < 2000; ++i) {
+    std::string day = "2024" + std::string(i % 12 < 9 ? "0" : "") + std::to_string(i % 12 + 1)
+                    + std::string(i % 28 < 9 ? "0" : "") + std::to_string(i % 28 + 1);
+    if(i % 5 == 0) {
+      buf += "BEGIN:VEVENT\r\nUID:" + std::to_string(i) + "@test\r\nSUMMARY:Timed " + std::to_string(i)
+           + "\r\nDESCRIPTION:T" + std::to_string(i % 100) + "\r\nDTSTART;TZID=Europe/Berlin:" + day
+           + "T091500\r\nDTEND;TZID=Europe/Berlin:" + day + "T101500\r\nRRULE:FREQ=WEEKLY\r\nEND:VEVENT\r\n";
+    } else if(i % 7 == 0) {
+      //no SUMMARY, the title must not leak in from the event before
+      buf += "BEGIN:VEVENT\nDESCRIPTION:BARE\nDTSTART:" + day + "T000000Z\nDTEND:" + day + "T000000Z\nEND:VEVENT\n";
+    } else {
+      buf += vevent("Event " + std::to_string(i), "E" + std::to_string(i % 1000), day);
+    }
+  }
+  buf += "END:VCALENDAR\r\n";
+
+  std::vector<Event> sequential;
+  StringArena sequential_arena;
+  assert(parse_ics(buf, sequential, sequential_arena));
+  assert(sequential.size() == 2000);
+  assert(sequential[7].get_title().empty());
+  for(unsigned threads : {1u, 2u, 3u, 8u}) {
+    std::vector<Event> parallel;
+    StringArena parallel_arena;
+    parallel_arena.store("already here");
+    parse_ics_parallel(buf, parallel, parallel_arena, threads, 512);
+    assert(same_events(sequential, parallel));
+    assert(parallel_arena.size() == sequential_arena.size() + 12);
+  }
+
+  //parsing stops at the first line that is not a property, and a bad
+  //timestamp after it is never reached
+  std::string stopped = buf;
+  size_t middle = stopped.find("BEGIN:VEVENT", stopped.length() / 3);
+  stopped.insert(middle, "\r\n");
+  size_t late = stopped.find("DTSTART:", 2 * stopped.length() / 3);
+  stopped.replace(late + 8, 4, "20X4");
+  sequential.clear();
+  assert(!parse_ics(stopped, sequential, sequential_arena));
+  std::vector<Event> parallel;
+  StringArena parallel_arena;
+  parse_ics_parallel(stopped, parallel, parallel_arena, 4, 512);
+  assert(sequential.size() < 2000);
+  assert(same_events(sequential, parallel));
+
+  //a calendar loaded on several threads matches one loaded on one
+  std::string path = "/tmp/planner_parallel_test.dat";
+  {
+    std::ofstream ofs(path);
+    ofs << buf;
+  }
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+  Calendar::set_parse_threads(1);
+  Calendar one = Calendar();
+  one.load_events(path);
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+  Calendar::set_parse_threads(4);
+  Calendar four = Calendar();
+  four.load_events(path);
+  Calendar::set_parse_threads(PARSE_THREADS);
+  assert(same_events(one.get_events(), four.get_events()));
+  std::cout << "Parsed " << one.get_events().size() << " events on 1 and 4 threads" << std::endl;
+  std::remove(path.c_str());
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+}
+
+void sources_tests() {
+  //a k-way merge of two sources renders the same calendar as both
+  //concatenated and sorted, ties going to the first source
+  auto add = [](std::vector<Event> &to, std::string_view title, std::string_view tag, Date b, Date e) {
+    to.emplace_back(title, tag, b, e);
+  };
+  std::vector<Event> work;
+  add(work, "Standup", "STAN", Date(2024, 3, 4), Date(2024, 3, 4));
+  add(work, "Offsite", "OFF", Date(2024, 3, 6), Date(2024, 3, 8));
+  add(work, "Review", "REV", Date(2024, 3, 18), Date(2024, 3, 18));
+  add(work, "Old", "OLD", Date(2024, 1, 2), Date(2024, 1, 3));
+  work[0].set_rule(Recurrence::parse("FREQ=WEEKLY", static_cast<int32_t>(Date(2024, 3, 4).serial_time())));
+  std::vector<Event> home;
+  add(home, "Dentist", "DENT", Date(2024, 3, 6), Date(2024, 3, 6));
+  add(home, "Trip", "TRIP", Date(2024, 2, 28), Date(2024, 3, 2));
+  add(home, "Party", "PRTY", Date(2024, 3, 18), Date(2024, 3, 18));
+  home[2].set_times(18 * 60, 22 * 60);
+  EventIndex work_index(&work);
+  EventIndex home_index(&home);
+  std::vector<Event> all = work;
+  all.insert(all.end(), home.begin(), home.end());
+  Date b(2024, 3, 1);
+  Date e(2024, 3, 31);
+  CalendarRange merged(b, e);
+  merged.set_events({&work_index, &home_index}, {"work", "home"});
+  CalendarRange sorted(b, e);
+  sorted.set_events(&all);
+  assert(merged.get_concurrency() == sorted.get_concurrency());
+  std::string merged_cal = merged.print_cal();
+  std::string sorted_cal = sorted.print_cal();
+  size_t body = sorted_cal.rfind("+\n") + 2;
+  assert(merged_cal.compare(0, body, sorted_cal, 0, body) == 0);
+
+  //the key groups each source's events under a band in its colour
+  std::string key = merged_cal.substr(body);
+  size_t work_band = key.find(std::string(bg_colors[0]) + BLACK " work ");
+  size_t home_band = key.find(std::string(bg_colors[1]) + BLACK " home ");
+  assert(work_band == 0 && home_band != std::string::npos);
+  assert(key.find("Offsite") < home_band && key.find("Review") < home_band);
+  assert(key.find("Dentist") > home_band && key.find("18:00-22:00 Party") > home_band);
+  assert(key.find("Old") == std::string::npos);
+  std::cout << key;
+
+  //a directory holds one source per save file, loaded on its own thread
+  std::string dir = "/tmp/planner_sources_test";
+  mkdir(dir.c_str(), 0755);
+  for(const char *file : {"/home.ics", "/home.ics.snap", "/home.ics.journal",
+                          "/work.dat", "/work.dat.snap", "/work.dat.journal"}) {
+    std::remove((dir + file).c_str());
+  }
+  {
+    std::ofstream ofs(dir + "/work.dat");
+    ofs << "BEGIN:VCALENDAR\r\n" << vevent("Planning", "PLAN", "20240305")
+        << vevent("Shared", "SHRD", "20240306") << "END:VCALENDAR\r\n";
+  }
+  {
+    std::ofstream ofs(dir + "/home.ics");
+    ofs << "BEGIN:VCALENDAR\r\n" << vevent("Shared", "SHRD", "20240307")
+        << vevent("Gym", "GYM", "20240308") << "END:VCALENDAR\r\n";
+  }
+  CalendarSources sources;
+  sources.add_source(dir);
+  assert(sources.size() == 2);
+  assert(sources.get_name(0) == "home" && sources.get_name(1) == "work");
+  //--to picks sources by name, a second work calendar is refused
+  bool duplicate = false;
+  try {
+    sources.add_source("/tmp/elsewhere/work.ics");
+  } catch(std::invalid_argument &) {
+    duplicate = true;
+  }
+  assert(duplicate && sources.size() == 2);
+  sources.load_events();
+  assert(sources[0].get_events().size() == 2 && sources[1].get_events().size() == 2);
+
+  //writes go back to the source of the event
+  Date day(2024, 3, 9);
+  bool threw = false;
+  try {
+    sources.add_new_event("play", "Lost", "LOST", day, day);
+  } catch(std::invalid_argument &) {
+    threw = true;
+  }
+  assert(threw);
+  sources.add_new_event("work", "Retro", "RETR", day, day);
+  sources.add_new_event("", "Chores", "CHOR", day, day);
+  std::ostringstream out;
+  sources.remove_event("GYM", out);
+  assert(out.str().empty());
+  sources.remove_event("SHRD", out);
+  assert(out.str().find("SHRD matches 2 events") == 0);
+  assert(out.str().find("[work]") < out.str().find("[home]"));
+  sources.commit_events();
+
+  Calendar home_cal = Calendar();
+  home_cal.load_events(dir + "/home.ics");
+  Calendar work_cal = Calendar();
+  work_cal.load_events(dir + "/work.dat");
+  assert(home_cal.get_events().size() == 2 && work_cal.get_events().size() == 3);
+  assert(home_cal.find_events("CHOR").size() == 1 && home_cal.find_events("GYM").empty());
+  assert(work_cal.find_events("RETR").size() == 1 && work_cal.find_events("CHOR").empty());
+
+  std::ostringstream listed;
+  sources.list_events(listed);
+  assert(listed.str().find("== home ==") < listed.str().find("== work =="));
+  //sources are committed in turn, a failure names those already written
+  std::string work_lock = dir + "/work.dat" + LOCK_SUFFIX;
+  std::remove(work_lock.c_str());
+  mkdir(work_lock.c_str(), 0755);
+  sources.add_new_event("home", "Laundry", "LNDR", day, day);
+  sources.add_new_event("work", "Unwritten", "UNWR", day, day);
+  std::string what;
+  try {
+    sources.commit_events();
+  } catch(std::runtime_error &ex) {
+    what = ex.what();
+  }
+  rmdir(work_lock.c_str());
+  assert(what.find("changes to home were written, the rest were not") != std::string::npos);
+  Calendar partial = Calendar();
+  partial.load_events(dir + "/home.ics");
+  assert(partial.find_events("LNDR").size() == 1);
+  std::cout << "Merged " << sources.size() << " calendars from " << dir << std::endl;
+}
+
+void save_tests() {
+  std::string path = "/tmp/planner_save_test.dat";
+  std::string journal_path = path + JOURNAL_SUFFIX;
+  for(const std::string &file : {path, journal_path, path + SNAPSHOT_SUFFIX, path + LOCK_SUFFIX}) {
+    std::remove(file.c_str());
+  }
+  {
+    std::ofstream ofs(path);
+    ofs << "BEGIN:VCALENDAR\r\n" << vevent("First", "ONE", "20240101")
+        << vevent("Second", "TWO", "20240105") << "END:VCALENDAR\r\n";
+  }
+
+  //a calendar that did not change is not written
+  Calendar cal = Calendar();
+  cal.load_events(path);
+  SnapshotSource before = snapshot_source(path);
+  cal.save_events(path);
+  assert(snapshot_source(path) == before);
+
+  //a change replaces the file through a rename, leaving no temporary file
+  Date day(2024, 1, 9);
+  cal.add_new_event("Third", "THRE", day, day);
+  cal.save_events(path);
+  assert(snapshot_source(path).inode != before.inode);
+  DIR *tmp = opendir("/tmp");
+  while(dirent *entry = readdir(tmp)) {
+    assert(std::string(entry->d_name).rfind("planner_save_test.dat.tmp", 0) != 0);
+  }
+  closedir(tmp);
+  before = snapshot_source(path);
+  cal.save_events(path);
+  assert(snapshot_source(path) == before);
+
+  //a failed write throws and leaves nothing behind
+  bool threw = false;
+  try {
+    cal.save_events("/tmp/planner_missing_dir/save.dat");
+  } catch(std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+
+  //a compaction that saved but did not get to truncate the journal: the
+  //journal belongs to an older generation and is not replayed again
+  Calendar writer = Calendar();
+  writer.load_events(path);
+  writer.add_new_event("Fourth", "FOUR", day, day);
+  writer.commit_events(path);
+  Calendar compactor = Calendar();
+  compactor.load_events(path);
+  assert(compactor.get_events().size() == 4);
+  compactor.save_events(path);
+  assert(snapshot_source(journal_path).size > 0);
+  Calendar reloaded = Calendar();
+  reloaded.load_events(path);
+  assert(reloaded.get_events().size() == 4);
+
+  //the next writer starts the journal over for the new generation
+  reloaded.add_new_event("Fifth", "FIVE", day, day);
+  reloaded.commit_events(path);
+  {
+    std::ifstream ifs(journal_path);
+    std::string first;
+    std::getline(ifs, first);
+    assert(first.rfind("GEN\t", 0) == 0);
+  }
+  Calendar latest = Calendar();
+  latest.load_events(path);
+  assert(latest.get_events().size() == 5);
+
+  //writers wait for the lock, readers do not
+  int ready[2];
+  assert(pipe(ready) == 0);
+  pid_t holder = fork();
+  if(holder == 0) {
+    FileLock lock(path + LOCK_SUFFIX);
+    write(ready[1], "L", 1);
+    usleep(300000);
+    _exit(0);
+  }
+  char c;
+  assert(read(ready[0], &c, 1) == 1);
+  close(ready[0]);
+  close(ready[1]);
+  Calendar reader = Calendar();
+  reader.load_events(path);
+  assert(reader.get_events().size() == 5);
+  int status;
+  assert(waitpid(holder, &status, WNOHANG) == 0);
+  reader.add_new_event("Sixth", "SIX", day, day);
+  reader.commit_events(path);
+  assert(waitpid(holder, &status, WNOHANG) == holder);
+  std::cout << "Saved atomically, writers serialized on " << path << LOCK_SUFFIX << std::endl;
+
+  for(const std::string &file : {path, journal_path, path + SNAPSHOT_SUFFIX, path + LOCK_SUFFIX}) {
+    std::remove(file.c_str());
+  }
+}
+
+void agenda_tests() {
+  //history, ongoing and future single events around endless and ended series
+  std::vector<Event> events;
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<int> start(-3000, 400);
+  std::uniform_int_distribution<int> length(0, 6);
+  Date origin(2024, 3, 1);
+  for(int i = 0; i < 3000; ++i) {
+    Date b = origin;
+    b.change_day(start(rng));
+    Date e = b;
+    e.change_day(length(rng) == 6 ? 40 : length(rng));
+    events.emplace_back("Single " + std::to_string(i), "S", b, e);
+    if(i % 3 == 0) events.back().set_times(i % 1440, std::min(i % 1440 + 30, Event::MINUTES_PER_DAY));
+  }
+  //one event in progress since before all the history
+  Date lease(2010, 1, 1);
+  Date lease_end(2028, 1, 1);
+  events.emplace_back("Lease", "LEAS", lease, lease_end);
+  Date weekly(2020, 1, 6);
+  events.emplace_back("Weekly", "WEEK", weekly, weekly);
+  events.back().set_rule(Recurrence::parse("FREQ=WEEKLY", static_cast<int32_t>(weekly.serial_time())));
+  Date ended(2023, 1, 2);
+  events.emplace_back("Ended", "END", ended, ended);
+  events.back().set_rule(Recurrence::parse("FREQ=DAILY;COUNT=30", static_cast<int32_t>(ended.serial_time())));
+  Date sparse(2024, 6, 1);
+  events.emplace_back("Yearly", "YEAR", sparse, sparse);
+  events.back().set_rule(Recurrence::parse("FREQ=YEARLY", static_cast<int32_t>(sparse.serial_time())));
+  std::sort(events.begin(), events.end(), Event::starts_before);
+  EventIndex index(&events);
+
+  //the same answer as expanding everything and sorting
+  for(size_t count : {1ul, 5ul, 50ul, 2000ul}) {
+    for(unsigned days : {0u, 1u, 10u, 200u}) {
+      long int from = origin.serial_time();
+      long int last = (days == 0) ? from + 20000 : from + days - 1;
+      Date b = origin;
+      std::chrono::sys_days l{std::chrono::days{last}};
+      TimeRange range(b, Date(l));
+      std::vector<Event> all;
+      for(const Event &e : events) e.occurrences(range, all);
+      std::stable_sort(all.begin(), all.end(), Event::starts_before);
+      if(all.size() > count) all.resize(count);
+
+      std::vector<Event> upcoming;
+      index.upcoming(from, (days == 0) ? LONG_MAX : last, count, upcoming);
+      assert(upcoming.size() == all.size());
+      for(size_t i = 0; i < all.size(); ++i) {
+        assert(!Event::starts_before(all[i], upcoming[i]) && !Event::starts_before(upcoming[i], all[i]));
+        assert(upcoming[i].get_end() >= origin);
+      }
+    }
+  }
+
+  //endless series fill the agenda past the last single event
+  std::vector<Event> upcoming;
+  index.upcoming(Date(2030, 1, 1).serial_time(), LONG_MAX, 3, upcoming);
+  assert(upcoming.size() == 3 && upcoming[0].get_title() == "Weekly");
+
+  std::string path = "/tmp/planner_agenda_test.dat";
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+  std::remove((path + JOURNAL_SUFFIX).c_str());
+  {
+    std::ofstream ofs(path);
+    ofs << "BEGIN:VCALENDAR\r\n" << vevent("Long ago", "OLD", "20200101")
+        << vevent("Today", "NOW", "20240301")
+        << "BEGIN:VEVENT\r\nSUMMARY:Call\r\nDESCRIPTION:CALL\r\nDTSTART:20240302T093000Z\r\n"
+        << "DTEND:20240302T100000Z\r\nEND:VEVENT\r\n"
+        << vevent("Later", "LATE", "20240320") << "END:VCALENDAR\r\n";
+  }
+  Calendar cal = Calendar();
+  cal.load_events(path);
+  std::ostringstream out;
+  cal.print_agenda(origin, 2, 0, out);
+  assert(out.str() == "FRI 2024-03-01 all day     NOW  Today\n"
+                      "SAT 2024-03-02 09:30-10:00 CALL Call\n");
+  out.str("");
+  cal.print_agenda(origin, 10, 7, out);
+  assert(out.str().find("Later") == std::string::npos);
+  std::cout << out.str();
+  std::remove(path.c_str());
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+}
+
+void freebusy_tests() {
+  //free runs agree with the days a per day count leaves empty, over years
+  std::vector<Event> events;
+  std::mt19937 rng(11);
+  std::uniform_int_distribution<int> start(0, 5 * 365);
+  std::uniform_int_distribution<int> length(0, 4);
+  Date origin(2020, 1, 1);
+  for(int i = 0; i < 400; ++i) {
+    Date b = origin;
+    b.change_day(start(rng));
+    Date e = b;
+    e.change_day(length(rng));
+    events.emplace_back("Busy", "BUSY", b, e);
+  }
+  Date monthly(2019, 12, 15);
+  events.emplace_back("Monthly", "MON", monthly, monthly);
+  events.back().set_rule(Recurrence::parse("FREQ=MONTHLY", static_cast<int32_t>(monthly.serial_time())));
+  std::sort(events.begin(), events.end(), Event::starts_before);
+  Date b(2020, 2, 1);
+  Date e(2024, 11, 30);
+  CalendarRange range(b, e);
+  range.set_events(&events);
+  const std::vector<unsigned> &per_day = range.get_concurrency();
+  for(unsigned min_days : {1u, 3u, 10u}) {
+    std::vector<TimeRange> gaps = free_spans(range, range.get_events(), min_days);
+    std::vector<TimeRange> expected;
+    size_t run = 0;
+    for(size_t d = 0; d <= per_day.size(); ++d) {
+      if(d < per_day.size() && per_day[d] == 0) {
+        ++run;
+        continue;
+      }
+      if(run >= min_days) {
+        Date gap_begin = b;
+        gap_begin.change_day(static_cast<int>(d - run));
+        Date gap_end = b;
+        gap_end.change_day(static_cast<int>(d - 1));
+        expected.push_back(TimeRange(gap_begin, gap_end));
+      }
+      run = 0;
+    }
+    assert(gaps.size() == expected.size());
+    for(size_t i = 0; i < gaps.size(); ++i) {
+      assert(gaps[i].get_begin() == expected[i].get_begin());
+      assert(gaps[i].get_end() == expected[i].get_end());
+    }
+  }
+  std::vector<TimeRange> busy = busy_spans(range, range.get_events());
+  for(size_t i = 1; i < busy.size(); ++i) {
+    assert(busy[i].get_begin().serial_time() > busy[i - 1].get_end().serial_time() + 1);
+  }
+
+  //times are compared only when both events are timed
+  Date day(2024, 3, 4);
+  Date next(2024, 3, 5);
+  Event morning("Morning", "AM", day, day);
+  morning.set_times(9 * 60, 10 * 60);
+  Event later("Later", "PM", day, day);
+  later.set_times(10 * 60, 11 * 60);
+  Event overnight("Overnight", "NITE", day, next);
+  overnight.set_times(23 * 60, 60);
+  Event all_day("All day", "DAY", next, next);
+  assert(!events_overlap(morning, later));
+  assert(events_overlap(overnight, all_day));
+  assert(events_overlap(morning, Event("Whole", "WHL", day, day)));
+  assert(!events_overlap(morning, all_day));
+
+  std::string path = "/tmp/planner_freebusy_test.dat";
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+  std::remove((path + JOURNAL_SUFFIX).c_str());
+  {
+    std::ofstream ofs(path);
+    ofs << "BEGIN:VCALENDAR\r\n" << vevent("Offsite", "OFF", "20240304")
+        << "BEGIN:VEVENT\r\nSUMMARY:Call\r\nDESCRIPTION:CALL\r\nDTSTART:20240305T093000Z\r\n"
+        << "DTEND:20240305T100000Z\r\nEND:VEVENT\r\n"
+        << vevent("Trip", "TRIP", "20240320") << "END:VCALENDAR\r\n";
+  }
+  Calendar cal = Calendar();
+  cal.load_events(path);
+  Event proposed("Review", "REV", day, next);
+  proposed.set_times(12 * 60, 9 * 60 + 45);
+  std::ostringstream out;
+  assert(cal.print_conflicts(proposed, out) == 2);
+  assert(out.str() == "Overlaps 2 event(s):\n"
+                      "  MON 2024-03-04 all day     OFF  Offsite\n"
+                      "  TUE 2024-03-05 09:30-10:00 CALL Call\n");
+  out.str("");
+  cal.set_range(2024, 3, 1, 2024, 3, 31);
+  cal.print_free(5, out);
+  assert(out.str() == "2024-03-06 to 2024-03-19  14 days\n"
+                      "2024-03-21 to 2024-03-31  11 days\n");
+  std::cout << out.str();
+  std::remove(path.c_str());
+  std::remove((path + SNAPSHOT_SUFFIX).c_str());
+}
+
+void occupancy_tests() {
+  //aggregations agree with a scan of the events on every day, with ranges
+  //not aligned to bitset words
+  std::vector<Event> events;
+  std::mt19937 rng(23);
+  std::uniform_int_distribution<int> start(0, 3 * 365);
+  std::uniform_int_distribution<int> length(0, 6);
+  const char *tags[] = {"WORK", "HOME", "GYM"};
+  Date origin(2021, 1, 1);
+  for(int i = 0; i < 600; ++i) {
+    Date b = origin;
+    b.change_day(start(rng));
+    Date e = b;
+    e.change_day(length(rng));
+    events.emplace_back("Event", tags[i % 3], b, e);
+  }
+  std::sort(events.begin(), events.end(), Event::starts_before);
+  Date b(2021, 3, 17);
+  Date e(2023, 8, 5);
+  CalendarRange range(b, e);
+  range.track_tags({"WORK", "HOME"});
+  range.set_events(&events);
+  const Occupancy &occupancy = range.get_occupancy();
+  assert(occupancy.size() == static_cast<size_t>(e.serial_time() - b.serial_time() + 1));
+  assert(occupancy.get_counts() == range.get_concurrency());
+
+  auto on_day = [&](size_t day, std::string_view tag) {
+    long int serial = b.serial_time() + static_cast<long int>(day);
+    return std::any_of(events.begin(), events.end(), [&](const Event &ev) {
+      return (tag.empty() || ev.get_tag() == tag) && ev.get_begin().serial_time() <= serial
+          && ev.get_end().serial_time() >= serial;
+    });
+  };
+  std::uniform_int_distribution<size_t> pick(0, occupancy.size() - 1);
+  for(int i = 0; i < 50; ++i) {
+    size_t day = pick(rng);
+    size_t n = std::min(pick(rng) % 200 + 1, occupancy.size() - day);
+    unsigned peak = 0;
+    size_t busy = 0, work = 0, home = 0, both = 0;
+    for(size_t d = day; d < day + n; ++d) {
+      peak = std::max(peak, occupancy.get_counts()[d]);
+      busy += on_day(d, "");
+      work += on_day(d, "WORK");
+      home += on_day(d, "HOME");
+      both += on_day(d, "WORK") && on_day(d, "HOME");
+    }
+    assert(occupancy.peak(day, n) == peak);
+    assert(occupancy.busy_days(day, n) == busy);
+    assert(occupancy.tag_days_in({"WORK"}, day, n) == work);
+    assert(occupancy.tag_days_in({"HOME"}, day, n) == home);
+    assert(occupancy.tag_days_in({"WORK", "HOME"}, day, n) == both);
+  }
+  bool threw = false;
+  try {
+    occupancy.tag_days_in({"GYM"}, 0, 1);
+  } catch(std::invalid_argument &) {
+    threw = true;
+  }
+  assert(threw);
+
+  //the stats mode reads the same occupancy as the calendar
+  std::vector<Event> few;
+  Date d1(2024, 1, 30);
+  Date d2(2024, 2, 2);
+  Date d3(2024, 2, 1);
+  few.emplace_back("Trip", "TRIP", d1, d2);
+  few.emplace_back("Call", "WORK", d3, d3);
+  Date jan(2024, 1, 15);
+  Date feb(2024, 2, 29);
+  CalendarRange months(jan, feb);
+  months.track_tags({"TRIP", "WORK"});
+  months.set_events(&few);
+  std::ostringstream out;
+  write_stats(months, {"TRIP", "WORK"}, out);
+  assert(out.str() == "month     days  busy  peak  TRIP  WORK   all\n"
+                      "2024-01     17     2     1     2     0     0\n"
+                      "2024-02     29     2     2     2     1     1\n"
+                      "total       46     4     2     4     1     1\n");
+  std::cout << out.str();
+  assert(split_tags("WORK,,HOME,") == std::vector<std::string>({"WORK", "HOME"}));
+  assert(split_tags("").empty());
+}
+
+void search_tests() {
+  std::vector<std::string> words;
+  SearchIndex::tokenize("Dentist: Dr. M\xc3\xbcller, 3pm (dentist)", words);
+  assert(words == std::vector<std::string>({"dentist", "dr", "m\xc3\xbcller", "3pm"}));
+
+  std::string path = "/tmp/planner_search_test.dat";
+  std::string search_path = path + SEARCH_SUFFIX;
+  for(const std::string &file : {path, path + JOURNAL_SUFFIX, path + SNAPSHOT_SUFFIX, search_path,
+                                 path + LOCK_SUFFIX}) {
+    std::remove(file.c_str());
+  }
+  const char *pool[] = {"dentist", "team", "meeting", "call", "review", "lunch", "march", "trip"};
+  std::mt19937 rng(31);
+  std::uniform_int_distribution<int> word(0, 7);
+  std::uniform_int_distribution<int> day(0, 364);
+  auto title = [&] {
+    return std::string(pool[word(rng)]) + " " + pool[word(rng)] + " " + pool[word(rng)];
+  };
+  {
+    std::ofstream ofs(path);
+    ofs << "BEGIN:VCALENDAR\r\n";
+    for(int i = 0; i < 300; ++i) {
+      Date d(2024, 1, 1);
+      d.change_day(day(rng));
+      ofs << vevent(title(), i % 2 ? "WORK" : "HOME", d.to_tz_tstamp().substr(0, 8));
+    }
+    ofs << "END:VCALENDAR\r\n";
+  }
+
+  //uids of the events of cal holding every word of query, found by a scan
+  auto scan = [](Calendar &cal, std::string_view query) {
+    std::vector<std::string> wanted;
+    SearchIndex::tokenize(query, wanted);
+    std::vector<std::string> uids;
+    for(const Event &e : cal.get_events()) {
+      std::vector<std::string> held;
+      SearchIndex::tokenize(e.get_title(), held);
+      SearchIndex::tokenize(e.get_tag(), held);
+      bool all = !wanted.empty();
+      for(const std::string &w : wanted) all = all && std::count(held.begin(), held.end(), w);
+      if(all) uids.emplace_back(e.get_uid());
+    }
+    std::sort(uids.begin(), uids.end());
+    return uids;
+  };
+  auto found = [](Calendar &cal, std::string_view query) {
+    std::vector<std::string> uids;
+    for(const Event *e : cal.search_events(query)) uids.emplace_back(e->get_uid());
+    std::sort(uids.begin(), uids.end());
+    return uids;
+  };
+  const char *queries[] = {"dentist", "Team meeting", "call review work", "lunch trip home",
+                           "march", "nothing", ""};
+  auto check = [&](Calendar &cal) {
+    for(const char *q : queries) assert(found(cal, q) == scan(cal, q));
+  };
+
+  //the first search builds the index and writes the search file
+  Calendar cal = Calendar();
+  cal.load_events(path);
+  check(cal);
+  assert(snapshot_source(search_path).size > 0);
+
+  //adds and removes keep a built index current
+  std::ostringstream sink;
+  for(int i = 0; i < 40; ++i) {
+    Date d(2024, 6, 1);
+    d.change_day(day(rng));
+    cal.add_new_event(title(), "NEW", d, d);
+    std::string uid(cal.get_events()[static_cast<size_t>(day(rng)) % cal.get_events().size()].get_uid());
+    cal.remove_event(uid.data(), sink);
+  }
+  check(cal);
+  cal.commit_events(path);
+
+  //a later load replays the journal on top of the search file
+  SnapshotSource written = snapshot_source(search_path);
+  Calendar replayed = Calendar();
+  replayed.load_events(path);
+  check(replayed);
+  assert(snapshot_source(search_path) == written);
+
+  //a search file of another save file is rebuilt
+  {
+    std::ofstream ofs(search_path, std::ofstream::trunc);
+    ofs << "not an index";
+  }
+  Calendar rebuilt = Calendar();
+  rebuilt.load_events(path);
+  check(rebuilt);
+  written = snapshot_source(search_path);
+  Calendar reloaded = Calendar();
+  reloaded.load_events(path);
+  check(reloaded);
+  assert(snapshot_source(search_path) == written);
+
+  //saving writes the search file for the new save file
+  reloaded.save_events(path);
+  written = snapshot_source(search_path);
+  Calendar saved = Calendar();
+  saved.load_events(path);
+  check(saved);
+  assert(snapshot_source(search_path) == written);
+
+  //dates narrow the words
+  Date mar_b(2024, 3, 1);
+  Date mar_e(2024, 3, 31);
+  std::optional<TimeRange> march = TimeRange(mar_b, mar_e);
+  std::vector<const Event *> in_march = saved.search_events("dentist", march);
+  for(const Event *e : in_march) {
+    assert(e->get_begin() >= mar_b && e->get_begin() <= mar_e);
+  }
+  size_t expected = 0;
+  for(const Event *e : saved.search_events("dentist")) expected += march->contains(e->get_begin());
+  assert(in_march.size() == expected);
+  std::cout << "search: " << saved.get_events().size() << " events, " << in_march.size()
+            << " dentist events in march" << std::endl;
+
+  for(const std::string &file : {path, path + JOURNAL_SUFFIX, path + SNAPSHOT_SUFFIX, search_path,
+                                 path + LOCK_SUFFIX}) {
+    std::remove(file.c_str());
+  }
+}
+
+void batch_tests() {
+  Date day;
+  int minute;
+  assert(parse_us_date("02/29/2024", day) && day == Date(2024, 2, 29));
+  assert(!parse_us_date("02/29/2023", day));
+  assert(!parse_us_date("13/01/2024", day));
+  assert(!parse_us_date("1/2", day));
+  assert(!parse_us_date("aa/01/2024", day));
+  assert(parse_clock("9:30", minute) && minute == 9 * 60 + 30);
+  assert(parse_clock("24:00", minute) && minute == Event::MINUTES_PER_DAY);
+  assert(!parse_clock("24:01", minute));
+  assert(!parse_clock("12:60", minute));
+  assert(!parse_clock("noon", minute));
+  assert(check_span(Date(2024, 3, 4), Date(2024, 3, 4), 9 * 60, 10 * 60).empty());
+  assert(check_span(Date(2024, 3, 4), Date(2024, 3, 4), Event::ALL_DAY, Event::ALL_DAY).empty());
+  assert(check_span(Date(2024, 3, 4), Date(2024, 3, 5), 23 * 60, 60).empty());
+  assert(check_span(Date(2024, 3, 4), Date(2024, 3, 4), 10 * 60, 9 * 60) == "ends before it begins");
+  assert(check_span(Date(2024, 3, 4), Date(2024, 3, 4), 9 * 60, 9 * 60) == "ends before it begins");
+  assert(check_span(Date(2024, 3, 5), Date(2024, 3, 4), Event::ALL_DAY, Event::ALL_DAY) ==
+         "ends before it begins");
+
+  //the interactive prompt rejects the same spans
+  {
+    std::istringstream answers("Backwards\nBACK 03/04/2024 03/04/2024\n10:00 09:00\n");
+    std::streambuf *saved = std::cin.rdbuf(answers.rdbuf());
+    std::ostringstream prompts;
+    std::streambuf *shown = std::cout.rdbuf(prompts.rdbuf());
+    std::string title, tag;
+    Date b_dt, e_dt;
+    int b_min, e_min;
+    bool rejected = false;
+    try {
+      Calendar::prompt_event(title, tag, b_dt, e_dt, b_min, e_min);
+    } catch(const std::invalid_argument &e) {
+      rejected = std::string(e.what()) == "Event ends before it begins";
+    }
+    std::cin.rdbuf(saved);
+    std::cout.rdbuf(shown);
+    assert(rejected);
+  }
+
+  //every format in one stream, bad records reported with their line
+  std::istringstream in(
+    "date,end,start,stop,tag,title\n"
+    "03/01/2024,03/02/2024,,,TRIP,\"Lisbon, Porto\"\n"
+    "03/04/2024,,09:00,10:30,WORK,Planning, part two\n"
+    "# a comment\n"
+    "\n"
+    "03/05/2024 DENT Dentist checkup\n"
+    "03/06/2024 03/07/2024 14:00 16:00 CONF Conference talk\n"
+    "BEGIN:VCALENDAR\r\n"
+    "PRODID:-//Other//EN\r\n"
+    "BEGIN:VEVENT\r\n"
+    "UID:imported-1@other\r\n"
+    "SUMMARY:Imported\r\n"
+    "DESCRIPTION:IMP\r\n"
+    "DTSTART:20240308T120000Z\r\n"
+    "DTEND:20240308T130000Z\r\n"
+    "END:VEVENT\r\n"
+    "END:VCALENDAR\r\n"
+    "-OLD\n"
+    "02/30/2024 BAD Not a day\n"
+    "03/09/2024 25:00 26:00 BAD Not a time\n"
+    "03/10/2024,,09:00,,BAD,One time\n"
+    "03/12/2024 03/11/2024 BAD Backwards\n"
+    "03/13/2024 NOTI\n"
+    "BEGIN:VEVENT\n"
+    "SUMMARY:Weekly\n"
+    "DTSTART:20240301\n"
+    "DTEND:20240301\n"
+    "RRULE:FREQ=WEEKLY\n"
+    "END:VEVENT\n"
+    "-\n");
+  std::vector<BatchRecord> records;
+  std::vector<BatchError> errors;
+  read_batch(in, records, errors);
+  assert(records.size() == 6);
+  assert(records[0].title == "Lisbon, Porto" && records[0].tag == "TRIP");
+  assert(records[0].begin == Date(2024, 3, 1) && records[0].end == Date(2024, 3, 2));
+  assert(records[1].title == "Planning, part two" && records[1].begin_minute == 9 * 60);
+  assert(records[1].end_minute == 10 * 60 + 30 && records[1].end == records[1].begin);
+  assert(records[2].title == "Dentist checkup" && records[2].begin_minute == Event::ALL_DAY);
+  assert(records[3].end == Date(2024, 3, 7) && records[3].begin_minute == 14 * 60);
+  assert(records[4].uid == "imported-1@other" && records[4].begin_minute == 12 * 60);
+  assert(records[4].line == 10);
+  assert(records[5].remove == "OLD");
+  std::vector<size_t> lines;
+  for(const BatchError &e : errors) lines.push_back(e.line);
+  assert(lines == std::vector<size_t>({19, 20, 21, 22, 23, 24, 30}));
+  std::ostringstream report;
+  write_batch_errors(errors, report);
+  std::cout << report.str();
+
+  //one load, one commit: a failed removal leaves the journal unwritten
+  std::string path = "/tmp/planner_batch_test.dat";
+  for(const std::string &file : {path, path + JOURNAL_SUFFIX, path + SNAPSHOT_SUFFIX, path + LOCK_SUFFIX}) {
+    std::remove(file.c_str());
+  }
+  {
+    std::ofstream ofs(path);
+    ofs << "BEGIN:VCALENDAR\r\n" << vevent("Old", "OLD", "20240101")
+        << vevent("Twice", "TWO", "20240102") << vevent("Twice", "TWO", "20240103")
+        << "END:VCALENDAR\r\n";
+  }
+  Calendar cal = Calendar();
+  cal.load_events(path);
+  errors.clear();
+  BatchRecord ambiguous = records[5];
+  ambiguous.remove = "TWO";
+  ambiguous.line = 99;
+  records.push_back(ambiguous);
+  assert(cal.apply_batch(records, errors) == 6);
+  assert(errors.size() == 1 && errors[0].line == 99);
+
+  Calendar clean = Calendar();
+  clean.load_events(path);
+  records.pop_back();
+  errors.clear();
+  assert(clean.apply_batch(records, errors) == 6 && errors.empty());
+  assert(clean.get_events().size() == 3 - 1 + 5);
+  clean.commit_events(path);
+
+  Calendar loaded = Calendar();
+  loaded.load_events(path);
+  assert(loaded.get_events().size() == 7);
+  assert(loaded.find_events("imported-1@other").size() == 1);
+  assert(loaded.find_events("OLD").empty());
+  //importing the same uid again is an error
+  errors.clear();
+  assert(!loaded.apply_record(records[4], errors) && errors.size() == 1);
+  for(const std::string &file : {path, path + JOURNAL_SUFFIX, path + SNAPSHOT_SUFFIX, path + LOCK_SUFFIX}) {
+    std::remove(file.c_str());
+  }
+}
+
 void calendar_tests() {
   Calendar cal = Calendar();
-  cal.load_events("/Users/ct/projects/plan/planner/tests/test.dat");
+  cal.load_events("tests/test.dat");
+  assert(cal.get_events().size() == 1);
+  Event loaded = cal.get_events()[0];
+  assert(loaded.get_title() == "A Test Calendar Event");
+  assert(loaded.get_tag() == "TEST");
+  assert(loaded.get_begin() == Date(2023, 12, 4));
+  assert(loaded.get_end() == Date(2023, 12, 10));
   cal.set_range(2023, 12, 1, 2023, 12, 31);
   //cal.new_event();
   cal.print();
-  cal.save_events("/Users/ct/projects/plan/planner/tests/test.out");
+  cal.save_events("tests/test.out");
 }
 
 int main() {
+  //timed events are shown in the display zone, keep it fixed
+  setenv("TZ", "UTC", 1);
   date_tests();
   timerange_tests();
   event_tests();
   calendarrange_tests();
+  index_tests();
+  concurrency_tests();
+  slot_tests();
+  allocation_tests();
+  arena_tests();
+  ics_tests();
+  journal_tests();
+  snapshot_tests();
+  uid_tests();
+  refresh_tests();
+  daemon_tests();
+  profile_tests();
+  rrule_tests();
+  zone_tests();
+  timed_event_tests();
+  parallel_parse_tests();
+  sources_tests();
+  save_tests();
+  agenda_tests();
+  freebusy_tests();
+  occupancy_tests();
+  search_tests();
+  batch_tests();
   calendar_tests();
   return 0;
 }
@@ -0,0 +1,54 @@
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "watch.h"
+
+// === FileWatcher ===
+FileWatcher::FileWatcher(const std::vector<std::string> &paths) : fd(-1) {
+  if(paths.empty()) return;
+  size_t slash = paths[0].rfind('/');
+  std::string dir = (slash == std::string::npos) ? "." : paths[0].substr(0, slash + 1);
+  for(const std::string &path : paths) {
+    names.push_back(slash == std::string::npos ? path : path.substr(path.rfind('/') + 1));
+  }
+
+  fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if(fd < 0) return;
+  uint32_t mask = IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM;
+  if(inotify_add_watch(fd, dir.c_str(), mask) < 0) {
+    close(fd);
+    fd = -1;
+  }
+}
+
+FileWatcher::~FileWatcher() {
+  if(fd >= 0) close(fd);
+}
+
+int FileWatcher::get_fd() const {
+  return fd;
+}
+
+bool FileWatcher::changed() {
+  if(fd < 0) return true;
+  bool relevant = false;
+  alignas(inotify_event) char buf[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+  while(true) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if(n < 0 && errno == EINTR) continue;
+    if(n <= 0) break;
+    for(char *p = buf; p < buf + n; ) {
+      const inotify_event *event = reinterpret_cast<const inotify_event *>(p);
+      //an overflowed queue may have dropped events for our files
+      if(event->mask & IN_Q_OVERFLOW) relevant = true;
+      for(const std::string &name : names) {
+        if(event->len > 0 && name == event->name) relevant = true;
+      }
+      p += sizeof(inotify_event) + event->len;
+    }
+  }
+  return relevant;
+}
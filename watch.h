@@ -0,0 +1,37 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <string>
+#include <vector>
+
+//watches files for changes with inotify. the directory holding them is
+//watched rather than the files, so replacing a file by rename and
+//creating a missing one are seen too. if inotify is unavailable get_fd
+//returns -1 and changed always returns true.
+class FileWatcher {
+private:
+  int fd;
+  std::vector<std::string> names;
+
+public:
+  // === Constructors ===
+
+  //watch paths, which must share a directory
+  FileWatcher(const std::vector<std::string> &paths);
+  ~FileWatcher();
+  FileWatcher(const FileWatcher &) = delete;
+  FileWatcher &operator=(const FileWatcher &) = delete;
+
+  // === Accessors ===
+
+  //descriptor that polls readable when events are pending
+  int get_fd() const;
+
+  // === Modifiers ===
+
+  //drain pending events without blocking, return true if any of them
+  //concerned a watched file
+  bool changed();
+};
+
+#endif
@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "config.h"
+#include "datetime.h"
+#include "ics.h"
+#include "zone.h"
+
+#define SECONDS_PER_DAY 86400
+
+//read an n byte big endian signed integer
+static int64_t read_be(const char *p, size_t n) {
+  uint64_t v = 0;
+  for(size_t i = 0; i < n; ++i) v = (v << 8) | static_cast<unsigned char>(p[i]);
+  if(n == 4) return static_cast<int32_t>(static_cast<uint32_t>(v));
+  return static_cast<int64_t>(v);
+}
+
+// === POSIX TZ rules ===
+
+//one end of a daylight saving period: Mm.w.d, Jn or n, plus a time
+struct TransitionRule {
+  char kind; //'M', 'J' or 'N'
+  int month, week, day;
+  int32_t time;
+};
+
+//skip a zone abbreviation, plain or <quoted>
+static bool skip_abbrev(std::string_view &s) {
+  size_t n = 0;
+  if(!s.empty() && s[0] == '<') {
+    n = s.find('>');
+    if(n == std::string_view::npos) return false;
+    ++n;
+  } else {
+    while(n < s.length() && isalpha(static_cast<unsigned char>(s[n]))) ++n;
+    if(n < 3) return false;
+  }
+  s.remove_prefix(n);
+  return true;
+}
+
+static bool read_number(std::string_view &s, int &n) {
+  size_t i = 0;
+  n = 0;
+  while(i < s.length() && isdigit(static_cast<unsigned char>(s[i]))) n = n * 10 + (s[i++] - '0');
+  s.remove_prefix(i);
+  return i > 0;
+}
+
+//read [+-]hh[:mm[:ss]] as seconds
+static bool read_hms(std::string_view &s, int32_t &seconds) {
+  int sign = 1;
+  if(!s.empty() && (s[0] == '+' || s[0] == '-')) {
+    if(s[0] == '-') sign = -1;
+    s.remove_prefix(1);
+  }
+  int h, m = 0, sec = 0;
+  if(!read_number(s, h)) return false;
+  if(!s.empty() && s[0] == ':') {
+    s.remove_prefix(1);
+    if(!read_number(s, m)) return false;
+    if(!s.empty() && s[0] == ':') {
+      s.remove_prefix(1);
+      if(!read_number(s, sec)) return false;
+    }
+  }
+  seconds = sign * (h * 3600 + m * 60 + sec);
+  return true;
+}
+
+static bool read_rule(std::string_view &s, TransitionRule &rule) {
+  rule.time = 2 * 3600;
+  rule.month = rule.week = rule.day = 0;
+  if(!s.empty() && s[0] == 'M') {
+    rule.kind = 'M';
+    s.remove_prefix(1);
+    if(!read_number(s, rule.month) || s.empty() || s[0] != '.') return false;
+    s.remove_prefix(1);
+    if(!read_number(s, rule.week) || s.empty() || s[0] != '.') return false;
+    s.remove_prefix(1);
+    if(!read_number(s, rule.day)) return false;
+    if(rule.month < 1 || rule.month > 12 || rule.week < 1 || rule.week > 5 || rule.day > 6) return false;
+  } else {
+    rule.kind = 'N';
+    if(!s.empty() && s[0] == 'J') {
+      rule.kind = 'J';
+      s.remove_prefix(1);
+    }
+    if(!read_number(s, rule.day)) return false;
+  }
+  if(!s.empty() && s[0] == '/') {
+    s.remove_prefix(1);
+    if(!read_hms(s, rule.time)) return false;
+  }
+  return true;
+}
+
+//day serial rule falls on in year
+static int64_t rule_day(const TransitionRule &rule, int year) {
+  int64_t jan1 = days_from_civil(year, 1, 1);
+  if(rule.kind == 'J') return jan1 + rule.day - 1 + (is_leap_year(year) && rule.day >= 60);
+  if(rule.kind == 'N') return jan1 + rule.day;
+  unsigned month = static_cast<unsigned>(rule.month);
+  int64_t first = days_from_civil(year, month, 1);
+  int64_t wd = (first + 4) % DAYS_IN_WEEK;
+  if(wd < 0) wd += DAYS_IN_WEEK;
+  int64_t day = first + (rule.day - wd + DAYS_IN_WEEK) % DAYS_IN_WEEK + (rule.week - 1) * DAYS_IN_WEEK;
+  //week 5 is the last such weekday of the month
+  while(day >= first + days_in_month(year, month)) day -= DAYS_IN_WEEK;
+  return day;
+}
+
+// === TimeZone ===
+TimeZone::TimeZone(std::string name, int32_t offset)
+  : name(std::move(name)), utc_starts{INT64_MIN}, local_starts{INT64_MIN}, offsets{offset} {}
+
+TimeZone::TimeZone(std::string name, std::string_view tzif) : TimeZone(std::move(name), 0) {
+  parse_tzif(tzif);
+}
+
+void TimeZone::add_transition(int64_t utc, int32_t offset) {
+  if(offset == offsets.back() || utc <= utc_starts.back()) return;
+  utc_starts.push_back(utc);
+  local_starts.push_back(utc + offset);
+  offsets.push_back(offset);
+}
+
+void TimeZone::parse_tzif(std::string_view data) {
+  const size_t header_size = 44;
+  if(data.length() < header_size || data.substr(0, 4) != "TZif") {
+    throw std::runtime_error("Invalid zoneinfo file");
+  }
+  //counts of the data block following a header
+  auto counts = [&](size_t at, size_t c[6]) {
+    for(int i = 0; i < 6; ++i) c[i] = static_cast<size_t>(read_be(data.data() + at + 20 + 4 * i, 4));
+  };
+  enum { ISUT, ISSTD, LEAP, TIME, TYPE, CHAR };
+  size_t c[6];
+  counts(0, c);
+  size_t pos = header_size;
+  size_t time_size = 4;
+  auto block_size = [&](size_t ts) {
+    return c[TIME] * ts + c[TIME] + c[TYPE] * 6 + c[CHAR] + c[LEAP] * (ts + 4) + c[ISSTD] + c[ISUT];
+  };
+  //version 2 and later repeat the data with 64 bit times after the first block
+  if(data[4] >= '2') {
+    pos += block_size(4);
+    if(data.length() < pos + header_size || data.substr(pos, 4) != "TZif") {
+      throw std::runtime_error("Invalid zoneinfo file");
+    }
+    counts(pos, c);
+    pos += header_size;
+    time_size = 8;
+  }
+  if(c[TYPE] == 0 || data.length() < pos + block_size(time_size)) {
+    throw std::runtime_error("Invalid zoneinfo file");
+  }
+
+  const char *times = data.data() + pos;
+  const char *indices = times + c[TIME] * time_size;
+  const char *types = indices + c[TIME];
+  auto type_offset = [&](size_t type) {
+    if(type >= c[TYPE]) throw std::runtime_error("Invalid zoneinfo file");
+    return static_cast<int32_t>(read_be(types + 6 * type, 4));
+  };
+  //times before the first transition use the first type
+  offsets[0] = type_offset(0);
+  for(size_t i = 0; i < c[TIME]; ++i) {
+    add_transition(read_be(times + i * time_size, time_size),
+                   type_offset(static_cast<unsigned char>(indices[i])));
+  }
+
+  size_t footer = pos + block_size(time_size);
+  if(time_size == 8 && footer < data.length() && data[footer] == '\n') {
+    size_t end = data.find('\n', footer + 1);
+    if(end != std::string_view::npos) apply_footer(data.substr(footer + 1, end - footer - 1));
+  }
+}
+
+void TimeZone::apply_footer(std::string_view rule) {
+  int32_t std_offset, dst_offset;
+  if(!skip_abbrev(rule) || !read_hms(rule, std_offset)) return;
+  //POSIX offsets count hours west of utc
+  std_offset = -std_offset;
+  if(utc_starts.size() == 1) offsets[0] = std_offset;
+  if(rule.empty()) return;
+
+  if(!skip_abbrev(rule)) return;
+  dst_offset = std_offset + 3600;
+  if(!rule.empty() && rule[0] != ',') {
+    if(!read_hms(rule, dst_offset)) return;
+    dst_offset = -dst_offset;
+  }
+  TransitionRule start, end;
+  if(rule.empty()) {
+    //no rule given, the US rules are the POSIX default
+    start = TransitionRule{'M', 3, 2, 0, 2 * 3600};
+    end = TransitionRule{'M', 11, 1, 0, 2 * 3600};
+  } else {
+    if(rule[0] != ',') return;
+    rule.remove_prefix(1);
+    if(!read_rule(rule, start) || rule.empty() || rule[0] != ',') return;
+    rule.remove_prefix(1);
+    if(!read_rule(rule, end)) return;
+  }
+
+  int64_t last = utc_starts.back();
+  int first_year = (last == INT64_MIN) ? 1970
+    : civil_from_days(static_cast<int32_t>(last / SECONDS_PER_DAY)).year;
+  for(int year = first_year; year <= ZONE_RULE_LAST_YEAR; ++year) {
+    //daylight time starts at a standard time and ends at a daylight time
+    int64_t on = rule_day(start, year) * SECONDS_PER_DAY + start.time - std_offset;
+    int64_t off = rule_day(end, year) * SECONDS_PER_DAY + end.time - dst_offset;
+    if(on < off) {
+      add_transition(on, dst_offset);
+      add_transition(off, std_offset);
+    } else {
+      add_transition(off, std_offset);
+      add_transition(on, dst_offset);
+    }
+  }
+}
+
+const TimeZone *TimeZone::locate(std::string_view name) {
+  static std::mutex lock;
+  static std::map<std::string, std::unique_ptr<TimeZone>, std::less<> > zones;
+
+  std::lock_guard<std::mutex> guard(lock);
+  auto found = zones.find(name);
+  if(found != zones.end()) return found->second.get();
+
+  std::unique_ptr<TimeZone> zone;
+  //names come from calendar files, keep them inside the database
+  if(!name.empty() && name[0] != '/' && name.find("..") == std::string_view::npos) {
+    const char *dir = getenv("TZDIR");
+    std::string path = std::string(dir && *dir ? dir : ZONEINFO_DIR).append("/").append(name);
+    MappedFile file(path);
+    try {
+      if(!file.view().empty()) zone = std::make_unique<TimeZone>(std::string(name), file.view());
+    } catch(std::runtime_error &) {
+      zone.reset();
+    }
+  }
+  if(!zone && (name == "UTC" || name == "Etc/UTC")) zone = std::make_unique<TimeZone>(std::string(name), 0);
+  const TimeZone *result = zone.get();
+  zones.emplace(std::string(name), std::move(zone));
+  return result;
+}
+
+const TimeZone *TimeZone::load_local() {
+  const char *tz = getenv("TZ");
+  std::string path;
+  if(tz && *tz) {
+    if(*tz == ':') ++tz;
+    if(*tz != '/') {
+      if(const TimeZone *zone = locate(tz)) return zone;
+      //not in the database, $TZ may be a POSIX rule like EST5EDT
+      static TimeZone rule("", 0);
+      rule.apply_footer(tz);
+      return &rule;
+    }
+    path = tz;
+  } else {
+    path = "/etc/localtime";
+    char target[PATH_MAX];
+    ssize_t n = readlink(path.c_str(), target, sizeof(target) - 1);
+    if(n > 0) path.assign(target, static_cast<size_t>(n));
+  }
+  //name the zone after its path in the database when it has one
+  size_t at = path.find("zoneinfo/");
+  if(at != std::string::npos) {
+    if(const TimeZone *zone = locate(path.substr(at + 9))) return zone;
+  }
+  MappedFile file(path);
+  if(file.view().empty()) return &utc();
+  try {
+    static TimeZone unnamed("", file.view());
+    return &unnamed;
+  } catch(std::runtime_error &) {
+    return &utc();
+  }
+}
+
+const TimeZone &TimeZone::local() {
+  static const TimeZone *zone = load_local();
+  return *zone;
+}
+
+const TimeZone &TimeZone::utc() {
+  static TimeZone zone("UTC", 0);
+  return zone;
+}
+
+const std::string &TimeZone::get_name() const {
+  return name;
+}
+
+size_t TimeZone::interval_at(int64_t utc) const {
+  return static_cast<size_t>(std::upper_bound(utc_starts.begin(), utc_starts.end(), utc)
+                             - utc_starts.begin()) - 1;
+}
+
+int32_t TimeZone::offset_at(int64_t utc) const {
+  return offsets[interval_at(utc)];
+}
+
+int64_t TimeZone::to_local(int64_t utc) const {
+  return utc + offset_at(utc);
+}
+
+int64_t TimeZone::to_utc(int64_t local) const {
+  size_t i = static_cast<size_t>(std::upper_bound(local_starts.begin(), local_starts.end(), local)
+                                 - local_starts.begin()) - 1;
+  //a local time repeated after a transition back is first read with the
+  //offset before the transition
+  if(i > 0 && local - offsets[i - 1] < utc_starts[i]) --i;
+  return local - offsets[i];
+}
@@ -0,0 +1,60 @@
+#ifndef ZONE_H
+#define ZONE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//a time zone read from a TZif file of the zoneinfo database. the file's
+//transitions, followed by the transitions its POSIX TZ footer produces
+//up to ZONE_RULE_LAST_YEAR, are converted once into flat tables so a
+//conversion is a binary search. zones are loaded once per process and
+//shared, see TimeZone::locate.
+class TimeZone {
+private:
+  std::string name;
+  std::vector<int64_t> utc_starts;   //utc second offsets[i] takes effect, [0] = INT64_MIN
+  std::vector<int64_t> local_starts; //utc_starts[i] + offsets[i]
+  std::vector<int32_t> offsets;      //seconds east of utc
+
+  //index of the offset in effect at utc
+  size_t interval_at(int64_t utc) const;
+  void add_transition(int64_t utc, int32_t offset);
+  //parse TZif data, throws std::runtime_error if it is not a TZif file
+  void parse_tzif(std::string_view data);
+  //extend the tables with the transitions of POSIX TZ string rule
+  void apply_footer(std::string_view rule);
+  //load the zone named by $TZ or /etc/localtime
+  static const TimeZone *load_local();
+
+public:
+  // === Constructors ===
+
+  //fixed offset zone, seconds east of utc
+  TimeZone(std::string name, int32_t offset);
+  //zone read from TZif data
+  TimeZone(std::string name, std::string_view tzif);
+
+  //return the zone called name from the zoneinfo database, loading it on
+  //first use. returns nullptr if there is no such zone. thread safe.
+  static const TimeZone *locate(std::string_view name);
+  //return the zone named by $TZ, else /etc/localtime, else utc
+  static const TimeZone &local();
+  static const TimeZone &utc();
+
+  // === Accessors ===
+
+  //return the zone name, empty if the local zone could not be named
+  const std::string &get_name() const;
+  //return the utc offset in seconds at utc second utc
+  int32_t offset_at(int64_t utc) const;
+  //return the local second of utc second utc
+  int64_t to_local(int64_t utc) const;
+  //return the utc second of local second local. a local time skipped by a
+  //transition is read with the offset before it and one that occurs
+  //twice resolves to the first occurrence, as RFC 5545 asks.
+  int64_t to_utc(int64_t local) const;
+};
+
+#endif